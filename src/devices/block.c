@@ -1,9 +1,48 @@
 #include "devices/block.h"
 #include <list.h>
+#include <round.h>
 #include <string.h>
 #include <stdio.h>
 #include "devices/ide.h"
+#include "devices/timer.h"
 #include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* Request queues.
+
+   Each block device that has a driver of its own, as opposed to
+   a partition, has a queue of pending requests, kept sorted by
+   sector, and a dispatcher thread that hands them to the driver
+   one batch at a time.  The dispatcher serves the queue in
+   C-LOOK order, sweeping upward through the sectors and then
+   jumping back to the lowest pending sector, so that the disk
+   head moves in one direction and no request waits for more
+   than one sweep.  Adjacent requests in the same direction are
+   merged into a single driver call of up to MERGE_MAX sectors,
+   staged through a per-device buffer.  A driver that supplies
+   transfer_batch instead receives up to BATCH_MAX requests per
+   call, taken in the same order, and may overlap them.
+
+   block_read() and block_write() and their multi-sector versions
+   submit a request and wait for it, so requests from a single
+   thread still complete in the order they were made.  Only
+   requests from different threads are reordered.
+
+   Statistics.  Each device, including each partition, keeps the
+   statistics in struct block_stats, among them histograms of the
+   time requests spend queued and with the driver.  A request to
+   a partition counts toward both the partition and the device
+   whose queue it joins.  A device's queue_lock protects the
+   statistics of the device and of its partitions. */
+
+/* Most sectors in a merged batch. */
+#define MERGE_MAX 128
+#define MERGE_PAGES DIV_ROUND_UP (MERGE_MAX * BLOCK_SECTOR_SIZE, PGSIZE)
+
+/* Most requests passed to a driver's transfer_batch at once. */
+#define BATCH_MAX 32
 
 /* A block device. */
 struct block
@@ -19,6 +58,17 @@ struct block
 
     unsigned long long read_cnt;        /* Number of sectors read. */
     unsigned long long write_cnt;       /* Number of sectors written. */
+    block_sector_t last_sector;         /* Sector last read or written. */
+    unsigned long long seek_distance;   /* Total sectors between accesses. */
+    struct block_stats stats;           /* Other statistics. */
+
+    /* Request queue.  Unused if the device remaps its requests
+       onto another device. */
+    struct lock queue_lock;             /* Protects the members below. */
+    struct condition queue_ready;       /* Signaled on new request. */
+    struct list queue;                  /* Pending requests, by sector. */
+    block_sector_t next_sector;         /* Sector after last dispatched. */
+    uint8_t *merge_buffer;              /* MERGE_MAX sectors, or null. */
   };
 
 /* List of all block devices. */
@@ -28,6 +78,9 @@ static struct list all_blocks = LIST_INITIALIZER (all_blocks);
 static struct block *block_by_role[BLOCK_ROLE_CNT];
 
 static struct block *list_elem_to_block (struct list_elem *);
+static thread_func dispatcher NO_RETURN;
+static void print_hist (const char *, const char *,
+                        const unsigned long long[BLOCK_HIST_CNT]);
 
 /* Returns a human-readable name for the given block device
    TYPE. */
@@ -113,6 +166,179 @@ check_sector (struct block *block, block_sector_t sector)
     }
 }
 
+/* Verifies that the CNT sectors starting at SECTOR are all
+   within BLOCK.  Panics if not. */
+static void
+check_sectors (struct block *block, block_sector_t sector, size_t cnt)
+{
+  ASSERT (cnt > 0);
+  check_sector (block, sector);
+  if (cnt > block->size - sector)
+    PANIC ("Access past end of device %s (sector=%"PRDSNu", count=%zu, "
+           "size=%"PRDSNu")\n", block_name (block), sector, cnt, block->size);
+}
+
+/* Returns the device whose queue takes requests to BLOCK. */
+static struct block *
+queue_of (struct block *block)
+{
+  block_sector_t sector = 0;
+
+  while (block->ops->remap != NULL)
+    block = block->ops->remap (block->aux, &sector);
+  return block;
+}
+
+/* Accounts for a transfer that reads (if WRITE is false) or
+   writes (if WRITE is true) the CNT sectors starting at SECTOR
+   in BLOCK's statistics. */
+static void
+count_transfer (struct block *block, bool write, block_sector_t sector,
+                size_t cnt)
+{
+  struct block_stats *s = &block->stats;
+
+  if (write)
+    {
+      block->write_cnt += cnt;
+      s->write_bytes += (unsigned long long) cnt * BLOCK_SECTOR_SIZE;
+    }
+  else
+    {
+      block->read_cnt += cnt;
+      s->read_bytes += (unsigned long long) cnt * BLOCK_SECTOR_SIZE;
+    }
+  s->transfer_cnt++;
+  if (sector == block->last_sector + 1)
+    s->seq_cnt++;
+  block->seek_distance += (sector > block->last_sector
+                           ? sector - block->last_sector
+                           : block->last_sector - sector);
+  block->last_sector = sector + cnt - 1;
+}
+
+/* Accounts for the arrival of a request in BLOCK's
+   statistics. */
+static void
+count_arrival (struct block *block)
+{
+  struct block_stats *s = &block->stats;
+
+  s->request_cnt++;
+  s->in_flight++;
+  s->depth_total += s->in_flight;
+  if (s->in_flight > s->in_flight_max)
+    s->in_flight_max = s->in_flight;
+}
+
+/* Returns the histogram bucket for a latency of USECS
+   microseconds.  See block-stats.h. */
+static int
+hist_bucket (int64_t usecs)
+{
+  int bucket = 0;
+
+  while (usecs >= 2 && bucket < BLOCK_HIST_CNT - 1)
+    {
+      usecs /= 2;
+      bucket++;
+    }
+  return bucket;
+}
+
+/* Accounts for the completion of a request that waited WAIT
+   microseconds in its queue and then took SERVICE microseconds
+   to carry out, in BLOCK's statistics. */
+static void
+count_completion (struct block *block, int64_t wait, int64_t service)
+{
+  struct block_stats *s = &block->stats;
+
+  s->in_flight--;
+  s->wait_usecs += wait;
+  s->service_usecs += service;
+  s->wait_hist[hist_bucket (wait)]++;
+  s->service_hist[hist_bucket (service)]++;
+}
+
+/* Returns the request that contains ELEM. */
+static struct block_request *
+elem_to_request (const struct list_elem *elem)
+{
+  return list_entry (elem, struct block_request, elem);
+}
+
+/* Orders requests by the sector they start at on their device. */
+static bool
+request_less (const struct list_elem *a, const struct list_elem *b,
+              void *aux UNUSED)
+{
+  return elem_to_request (a)->dev_sector < elem_to_request (b)->dev_sector;
+}
+
+/* Submits request R to BLOCK.  R is queued and the call returns
+   at once; the request completes later, as described in
+   block.h.
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void
+block_submit (struct block *block, struct block_request *r)
+{
+  struct block *queue = block;
+  block_sector_t sector = r->sector;
+
+  check_sectors (block, r->sector, r->cnt);
+  ASSERT (!r->write || block->type != BLOCK_FOREIGN);
+  sema_init (&r->completed, 0);
+
+  /* Pass requests to a window onto another device down to the
+     device that queues them. */
+  while (queue->ops->remap != NULL)
+    queue = queue->ops->remap (queue->aux, &sector);
+  r->block = block;
+  r->dev_sector = sector;
+
+  lock_acquire (&queue->queue_lock);
+  r->submit_usecs = timer_usecs ();
+  if (block != queue)
+    {
+      count_transfer (block, r->write, r->sector, r->cnt);
+      count_arrival (block);
+    }
+  count_arrival (queue);
+  list_insert_ordered (&queue->queue, &r->elem, request_less, NULL);
+  cond_signal (&queue->queue_ready, &queue->queue_lock);
+  lock_release (&queue->queue_lock);
+}
+
+/* Waits for request R, which must have been submitted with a
+   null completion function, to complete. */
+void
+block_wait (struct block_request *r)
+{
+  ASSERT (r->done == NULL);
+  sema_down (&r->completed);
+}
+
+/* Submits a request to BLOCK to read (if WRITE is false) or write
+   (if WRITE is true) CNT sectors starting at SECTOR, to or from
+   BUFFER, and waits for it to complete. */
+static void
+do_request (struct block *block, bool write, block_sector_t sector,
+            size_t cnt, void *buffer)
+{
+  struct block_request r;
+
+  r.write = write;
+  r.sector = sector;
+  r.cnt = cnt;
+  r.buffer = buffer;
+  r.done = NULL;
+  r.aux = NULL;
+  block_submit (block, &r);
+  block_wait (&r);
+}
+
 /* Reads sector SECTOR from BLOCK into BUFFER, which must
    have room for BLOCK_SECTOR_SIZE bytes.
    Internally synchronizes accesses to block devices, so external
@@ -120,9 +346,7 @@ check_sector (struct block *block, block_sector_t sector)
 void
 block_read (struct block *block, block_sector_t sector, void *buffer)
 {
-  check_sector (block, sector);
-  block->ops->read (block->aux, sector, buffer);
-  block->read_cnt++;
+  do_request (block, false, sector, 1, buffer);
 }
 
 /* Write sector SECTOR to BLOCK from BUFFER, which must contain
@@ -133,10 +357,230 @@ block_read (struct block *block, block_sector_t sector, void *buffer)
 void
 block_write (struct block *block, block_sector_t sector, const void *buffer)
 {
-  check_sector (block, sector);
-  ASSERT (block->type != BLOCK_FOREIGN);
-  block->ops->write (block->aux, sector, buffer);
-  block->write_cnt++;
+  do_request (block, true, sector, 1, (void *) buffer);
+}
+
+/* Reads CNT consecutive sectors starting at SECTOR from BLOCK
+   into BUFFER, which must have room for CNT * BLOCK_SECTOR_SIZE
+   bytes.  The driver transfers them in as few requests as it
+   can.
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void
+block_read_multi (struct block *block, block_sector_t sector, size_t cnt,
+                  void *buffer)
+{
+  do_request (block, false, sector, cnt, buffer);
+}
+
+/* Writes CNT consecutive sectors starting at SECTOR to BLOCK
+   from BUFFER, which must contain CNT * BLOCK_SECTOR_SIZE bytes.
+   The driver transfers them in as few requests as it can.
+   Returns after the block device has acknowledged receiving all
+   of the data.
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void
+block_write_multi (struct block *block, block_sector_t sector, size_t cnt,
+                   const void *buffer)
+{
+  do_request (block, true, sector, cnt, (void *) buffer);
+}
+
+/* Has BLOCK's driver read (if WRITE is false) or write (if WRITE
+   is true) CNT sectors starting at SECTOR, to or from BUFFER. */
+static void
+transfer (struct block *block, bool write, block_sector_t sector,
+          size_t cnt, uint8_t *buffer)
+{
+  const struct block_operations *ops = block->ops;
+  size_t i;
+
+  if (write && ops->write_multi != NULL)
+    ops->write_multi (block->aux, sector, cnt, buffer);
+  else if (!write && ops->read_multi != NULL)
+    ops->read_multi (block->aux, sector, cnt, buffer);
+  else
+    for (i = 0; i < cnt; i++)
+      {
+        if (write)
+          ops->write (block->aux, sector + i, buffer + i * BLOCK_SECTOR_SIZE);
+        else
+          ops->read (block->aux, sector + i, buffer + i * BLOCK_SECTOR_SIZE);
+      }
+}
+
+/* Removes the requests to dispatch next from BLOCK's queue,
+   which must not be empty, and moves them to BATCH.
+
+   Requests are chosen by the C-LOOK algorithm: the first is the
+   request at the lowest sector at or after the sector that
+   follows the last request dispatched, or if there is none, the
+   request at the lowest sector of all.  The requests right
+   behind it in the queue join the batch as long as they go in
+   the same direction, each starts at the sector that follows the
+   last, and together they fit in the merge buffer.
+
+   If BLOCK's driver supplies transfer_batch, the batch instead
+   takes the requests that follow the first in C-LOOK order,
+   adjacent or not, up to BATCH_MAX in all.  Each run of adjacent
+   requests in the same direction counts as one transfer.
+
+   The caller must hold BLOCK's queue_lock. */
+static void
+take_batch (struct block *block, struct list *batch)
+{
+  bool many = block->ops->transfer_batch != NULL;
+  struct list_elem *e;
+  struct block_request *first = NULL, *last = NULL;
+  size_t cnt = 0, req_cnt = 0;
+
+  for (e = list_begin (&block->queue); e != list_end (&block->queue);
+       e = list_next (e))
+    if (elem_to_request (e)->dev_sector >= block->next_sector)
+      break;
+  if (e == list_end (&block->queue))
+    e = list_begin (&block->queue);
+
+  for (;;)
+    {
+      struct block_request *r = elem_to_request (e);
+      struct list_elem *next = list_next (e);
+
+      if (first != NULL
+          && (r->write != first->write
+              || r->dev_sector != last->dev_sector + last->cnt))
+        {
+          count_transfer (block, first->write, first->dev_sector, cnt);
+          first = NULL;
+        }
+      if (first == NULL)
+        {
+          first = r;
+          cnt = 0;
+        }
+      last = r;
+      cnt += r->cnt;
+      req_cnt++;
+
+      list_remove (e);
+      list_push_back (batch, e);
+
+      if (list_empty (&block->queue))
+        break;
+      if (next == list_end (&block->queue))
+        {
+          if (!many)
+            break;
+          next = list_begin (&block->queue);
+        }
+      r = elem_to_request (next);
+      if (many
+          ? req_cnt >= BATCH_MAX
+          : (block->merge_buffer == NULL
+             || r->write != first->write
+             || r->dev_sector != last->dev_sector + last->cnt
+             || cnt + r->cnt > MERGE_MAX))
+        break;
+      e = next;
+    }
+  block->next_sector = last->dev_sector + last->cnt;
+  count_transfer (block, first->write, first->dev_sector, cnt);
+}
+
+/* Carries out the requests in BATCH, which were chosen by
+   take_batch(), with a single driver call.  Requests that were
+   merged go through BLOCK's merge buffer. */
+static void
+dispatch (struct block *block, struct list *batch)
+{
+  struct block_request *first = elem_to_request (list_front (batch));
+  struct list_elem *e;
+  size_t cnt = 0;
+  uint8_t *p;
+
+  if (block->ops->transfer_batch != NULL)
+    {
+      block->ops->transfer_batch (block->aux, batch);
+      return;
+    }
+  if (list_begin (batch) == list_rbegin (batch))
+    {
+      transfer (block, first->write, first->dev_sector, first->cnt,
+                first->buffer);
+      return;
+    }
+
+  for (e = list_begin (batch); e != list_end (batch); e = list_next (e))
+    cnt += elem_to_request (e)->cnt;
+  if (first->write)
+    for (e = list_begin (batch), p = block->merge_buffer;
+         e != list_end (batch); e = list_next (e))
+      {
+        struct block_request *r = elem_to_request (e);
+        memcpy (p, r->buffer, r->cnt * BLOCK_SECTOR_SIZE);
+        p += r->cnt * BLOCK_SECTOR_SIZE;
+      }
+  transfer (block, first->write, first->dev_sector, cnt, block->merge_buffer);
+  if (!first->write)
+    for (e = list_begin (batch), p = block->merge_buffer;
+         e != list_end (batch); e = list_next (e))
+      {
+        struct block_request *r = elem_to_request (e);
+        memcpy (r->buffer, p, r->cnt * BLOCK_SECTOR_SIZE);
+        p += r->cnt * BLOCK_SECTOR_SIZE;
+      }
+}
+
+/* Dispatcher thread for block device BLOCK_.  Carries out the
+   requests in the device's queue, one batch at a time, and
+   completes them. */
+static void
+dispatcher (void *block_)
+{
+  struct block *block = block_;
+
+  for (;;)
+    {
+      struct list batch;
+      struct list_elem *e;
+      int64_t start, service;
+
+      list_init (&batch);
+      lock_acquire (&block->queue_lock);
+      while (list_empty (&block->queue))
+        cond_wait (&block->queue_ready, &block->queue_lock);
+      take_batch (block, &batch);
+      lock_release (&block->queue_lock);
+
+      start = timer_usecs ();
+      dispatch (block, &batch);
+      service = timer_usecs () - start;
+
+      lock_acquire (&block->queue_lock);
+      for (e = list_begin (&batch); e != list_end (&batch); e = list_next (e))
+        {
+          struct block_request *r = elem_to_request (e);
+          int64_t wait = start - r->submit_usecs;
+
+          if (r->block != block)
+            count_completion (r->block, wait, service);
+          count_completion (block, wait, service);
+        }
+      lock_release (&block->queue_lock);
+
+      /* The submitter may reuse a request as soon as it
+         completes, so fetch the next one first. */
+      for (e = list_begin (&batch); e != list_end (&batch); )
+        {
+          struct block_request *r = elem_to_request (e);
+          e = list_next (e);
+          if (r->done != NULL)
+            r->done (r);
+          else
+            sema_up (&r->completed);
+        }
+    }
 }
 
 /* Returns the number of sectors in BLOCK. */
@@ -160,10 +604,22 @@ block_type (struct block *block)
   return block->type;
 }
 
+/* Stores the number of sectors read from and written to BLOCK in
+   *ACCESS_CNT and the total distance, in sectors, between
+   consecutive accesses in *SEEK_DISTANCE. */
+void
+block_seek_stats (struct block *block, unsigned long long *access_cnt,
+                  unsigned long long *seek_distance)
+{
+  *access_cnt = block->read_cnt + block->write_cnt;
+  *seek_distance = block->seek_distance;
+}
+
 /* Prints statistics for each block device used for a Pintos role. */
 void
 block_print_stats (void)
 {
+  struct list_elem *e;
   int i;
 
   /* Distributions before 2019 used BLOCK_CNT instead of BLOCK_ROLE_CNT,
@@ -173,18 +629,80 @@ block_print_stats (void)
       struct block *block = block_by_role[i];
       if (block != NULL)
         {
-          printf ("%s (%s): %llu reads, %llu writes\n",
+          unsigned long long access_cnt = block->read_cnt + block->write_cnt;
+          printf ("%s (%s): %llu reads, %llu writes, "
+                  "%llu sectors average seek\n",
                   block->name, block_type_name (block->type),
-                  block->read_cnt, block->write_cnt);
+                  block->read_cnt, block->write_cnt,
+                  access_cnt > 0 ? block->seek_distance / access_cnt : 0);
         }
     }
+
+  /* Every device that has seen a request, including devices
+     whose partitions play the roles above. */
+  for (e = list_begin (&all_blocks); e != list_end (&all_blocks);
+       e = list_next (e))
+    {
+      struct block_stats s;
+      unsigned long long n;
+
+      block_get_stats (list_entry (e, struct block, list_elem), &s);
+      n = s.request_cnt;
+      if (n == 0)
+        continue;
+      printf ("%s: %llu requests, %llu bytes read, %llu bytes written, "
+              "%llu transfers (%llu%% sequential)\n",
+              s.name, n, s.read_bytes, s.write_bytes, s.transfer_cnt,
+              s.transfer_cnt > 0 ? s.seq_cnt * 100 / s.transfer_cnt : 0);
+      printf ("%s: %llu.%llu average depth, %u max, "
+              "%llu us average wait, %llu us average service\n",
+              s.name, s.depth_total / n, s.depth_total * 10 / n % 10,
+              s.in_flight_max, s.wait_usecs / n, s.service_usecs / n);
+      print_hist (s.name, "wait", s.wait_hist);
+      print_hist (s.name, "service", s.service_hist);
+    }
+}
+
+/* Prints the nonzero buckets of latency histogram HIST, labeled
+   with device NAME and WHAT the histogram measures. */
+static void
+print_hist (const char *name, const char *what,
+            const unsigned long long hist[BLOCK_HIST_CNT])
+{
+  int i;
+
+  printf ("%s: %s", name, what);
+  for (i = 0; i < BLOCK_HIST_CNT; i++)
+    if (hist[i] != 0)
+      printf (" %s%lu:%llu", i == BLOCK_HIST_CNT - 1 ? ">=" : "<",
+              i == BLOCK_HIST_CNT - 1 ? 1ul << i : 2ul << i, hist[i]);
+  printf (" (us:count)\n");
+}
+
+/* Copies BLOCK's statistics into *STATS. */
+void
+block_get_stats (struct block *block, struct block_stats *stats)
+{
+  struct block *queue = queue_of (block);
+
+  lock_acquire (&queue->queue_lock);
+  *stats = block->stats;
+  stats->seek_distance = block->seek_distance;
+  lock_release (&queue->queue_lock);
+
+  strlcpy (stats->name, block->name, sizeof stats->name);
+  strlcpy (stats->type, block_type_name (block->type), sizeof stats->type);
+  stats->size = block->size;
+  stats->partition = block != queue;
 }
 
 /* Registers a new block device with the given NAME.  If
    EXTRA_INFO is non-null, it is printed as part of a user
    message.  The block device's SIZE in sectors and its TYPE must
    be provided, as well as the it operation functions OPS, which
-   will be passed AUX in each function call. */
+   will be passed AUX in each function call.  Unless OPS remaps
+   requests onto another device, starts a dispatcher thread for
+   the new device's request queue. */
 struct block *
 block_register (const char *name, enum block_type type,
                 const char *extra_info, block_sector_t size,
@@ -202,6 +720,25 @@ block_register (const char *name, enum block_type type,
   block->aux = aux;
   block->read_cnt = 0;
   block->write_cnt = 0;
+  block->last_sector = 0;
+  block->seek_distance = 0;
+  memset (&block->stats, 0, sizeof block->stats);
+
+  lock_init (&block->queue_lock);
+  cond_init (&block->queue_ready);
+  list_init (&block->queue);
+  block->next_sector = 0;
+  block->merge_buffer = NULL;
+  if (ops->remap == NULL)
+    {
+      char thread_name[16];
+
+      ASSERT (ops->read != NULL && ops->write != NULL);
+      if (ops->transfer_batch == NULL)
+        block->merge_buffer = palloc_get_multiple (0, MERGE_PAGES);
+      snprintf (thread_name, sizeof thread_name, "%s-io", name);
+      thread_create (thread_name, PRI_MAX, dispatcher, block);
+    }
 
   printf ("%s: %'"PRDSNu" sectors (", block->name, block->size);
   print_human_readable_size ((uint64_t) block->size * BLOCK_SECTOR_SIZE);
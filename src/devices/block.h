@@ -1,8 +1,12 @@
 #ifndef DEVICES_BLOCK_H
 #define DEVICES_BLOCK_H
 
+#include <block-stats.h>
+#include <stdbool.h>
 #include <stddef.h>
 #include <inttypes.h>
+#include <list.h>
+#include "threads/synch.h"
 
 /* Size of a block device sector in bytes.
    All IDE disks use this sector size, as do most USB and SCSI
@@ -53,18 +57,82 @@ struct block *block_next (struct block *);
 block_sector_t block_size (struct block *);
 void block_read (struct block *, block_sector_t, void *);
 void block_write (struct block *, block_sector_t, const void *);
+void block_read_multi (struct block *, block_sector_t, size_t cnt, void *);
+void block_write_multi (struct block *, block_sector_t, size_t cnt,
+                        const void *);
 const char *block_name (struct block *);
 enum block_type block_type (struct block *);
 
+/* Asynchronous requests. */
+struct block_request;
+typedef void block_request_func (struct block_request *);
+
+/* A request to read or write CNT consecutive sectors, submitted
+   with block_submit().  The submitter fills in the members up to
+   AUX and must not touch the request again until it completes.
+
+   On completion, the block layer calls DONE, if it is non-null,
+   or else ups the request's semaphore, for block_wait() to
+   notice.  DONE runs in the device's dispatcher thread, so it
+   must not sleep for long, and must not wait for another request
+   to the same device. */
+struct block_request
+  {
+    bool write;                 /* Write, instead of read? */
+    block_sector_t sector;      /* First sector. */
+    size_t cnt;                 /* Number of sectors. */
+    void *buffer;               /* CNT * BLOCK_SECTOR_SIZE bytes. */
+    block_request_func *done;   /* Completion function, or null. */
+    void *aux;                  /* For use by DONE. */
+
+    /* Owned by the block layer. */
+    struct list_elem elem;      /* Element in a device's queue. */
+    struct block *block;        /* Device submitted to. */
+    block_sector_t dev_sector;  /* SECTOR on the queueing device. */
+    struct semaphore completed; /* Up'd on completion if DONE is null. */
+    int64_t submit_usecs;       /* When the request was queued. */
+  };
+
+void block_submit (struct block *, struct block_request *);
+void block_wait (struct block_request *);
+
 /* Statistics. */
+void block_seek_stats (struct block *, unsigned long long *access_cnt,
+                       unsigned long long *seek_distance);
+void block_get_stats (struct block *, struct block_stats *);
 void block_print_stats (void);
 
 /* Lower-level interface to block device drivers. */
 
+/* Driver operations, called by the device's dispatcher thread
+   one request at a time.  READ_MULTI and WRITE_MULTI transfer CNT
+   consecutive sectors in one request.  Either may be null, in
+   which case the block layer transfers one sector at a time with
+   READ or WRITE.
+
+   A driver that can keep many requests outstanding at once may
+   also supply TRANSFER_BATCH, which carries out every request in
+   BATCH, a list of struct block_request linked through their ELEM
+   members, and returns once all of them are done.  Each
+   request's DEV_SECTOR is its sector on the device.  The block
+   layer then passes such a driver several requests at a time, in
+   C-LOOK order, instead of merging adjacent requests itself.
+
+   A device that is a window onto part of another device, such as
+   a partition, instead supplies only REMAP, which returns the
+   underlying device and converts *SECTOR to the corresponding
+   sector on it.  Requests to such a device join the underlying
+   device's queue. */
 struct block_operations
   {
     void (*read) (void *aux, block_sector_t, void *buffer);
     void (*write) (void *aux, block_sector_t, const void *buffer);
+    void (*read_multi) (void *aux, block_sector_t, size_t cnt,
+                        void *buffer);
+    void (*write_multi) (void *aux, block_sector_t, size_t cnt,
+                         const void *buffer);
+    struct block *(*remap) (void *aux, block_sector_t *sector);
+    void (*transfer_batch) (void *aux, struct list *batch);
   };
 
 struct block *block_register (const char *name, enum block_type,
@@ -5,13 +5,23 @@
 #include <stdio.h>
 #include "devices/block.h"
 #include "devices/partition.h"
+#include "devices/pci.h"
 #include "devices/timer.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
+#include "threads/loader.h"
 #include "threads/synch.h"
+#include "threads/vaddr.h"
 
 /* The code in this file is an interface to an ATA (IDE)
-   controller.  It attempts to comply to [ATA-3]. */
+   controller.  It attempts to comply to [ATA-3].
+
+   If the controller is a PCI bus-master IDE controller, such as
+   the PIIX found in QEMU and Bochs PCs, data moves between the
+   disk and memory by DMA, as described in SFF-8038i, and the CPU
+   is free while a command is in progress.  Otherwise, and for
+   buffers that DMA cannot reach, the CPU moves every word itself
+   in PIO mode. */
 
 /* ATA command block port addresses. */
 #define reg_data(CHANNEL) ((CHANNEL)->reg_base + 0)     /* Data. */
@@ -30,10 +40,16 @@
 #define reg_ctl(CHANNEL) ((CHANNEL)->reg_base + 0x206)  /* Control (w/o). */
 #define reg_alt_status(CHANNEL) reg_ctl (CHANNEL)       /* Alt Status (r/o). */
 
+/* Bus master IDE port addresses. */
+#define reg_bm_command(CHANNEL) ((CHANNEL)->bm_base + 0) /* Command. */
+#define reg_bm_status(CHANNEL) ((CHANNEL)->bm_base + 2)  /* Status. */
+#define reg_bm_prdt(CHANNEL) ((CHANNEL)->bm_base + 4)    /* PRD table. */
+
 /* Alternate Status Register bits. */
 #define STA_BSY 0x80            /* Busy. */
 #define STA_DRDY 0x40           /* Device Ready. */
 #define STA_DRQ 0x08            /* Data Request. */
+#define STA_ERR 0x01            /* Error. */
 
 /* Control Register bits. */
 #define CTL_SRST 0x04           /* Software Reset. */
@@ -43,12 +59,54 @@
 #define DEV_LBA 0x40            /* Linear based addressing. */
 #define DEV_DEV 0x10            /* Select device: 0=master, 1=slave. */
 
+/* PCI class of IDE controllers, and programming interface bits
+   that say how one works. */
+#define PCI_CLASS_STORAGE 0x01          /* Mass storage controller. */
+#define PCI_SUBCLASS_IDE 0x01           /* IDE controller. */
+#define IDE_IF_NATIVE0 0x01             /* Primary in native mode. */
+#define IDE_IF_NATIVE1 0x04             /* Secondary in native mode. */
+#define IDE_IF_BUS_MASTER 0x80          /* Supports bus mastering. */
+#define IDE_BAR_BUS_MASTER 4            /* BAR of bus master ports. */
+
+/* Bus master Command Register bits. */
+#define BM_CMD_START 0x01       /* Start transfer. */
+#define BM_CMD_TO_MEMORY 0x08   /* Transfer from disk to memory. */
+
+/* Bus master Status Register bits.  Writing 1 clears ERROR and
+   INTR. */
+#define BM_ST_ERROR 0x02        /* Transfer failed. */
+#define BM_ST_INTR 0x04         /* Disk interrupted. */
+
 /* Commands.
    Many more are defined but this is the small subset that we
    use. */
 #define CMD_IDENTIFY_DEVICE 0xec        /* IDENTIFY DEVICE. */
 #define CMD_READ_SECTOR_RETRY 0x20      /* READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30     /* WRITE SECTOR with retries. */
+#define CMD_READ_DMA 0xc8               /* READ DMA. */
+#define CMD_WRITE_DMA 0xca              /* WRITE DMA. */
+
+/* Most sectors transferred by one READ SECTOR, WRITE SECTOR,
+   READ DMA or WRITE DMA command.  A sector count of 0 in the
+   command means 256. */
+#define MAX_SECTORS_PER_CMD 256
+
+/* A physical region descriptor, which tells a bus-master
+   controller where in memory a piece of a DMA transfer goes.  A
+   region may not cross a PRD_SPAN boundary. */
+struct prd
+  {
+    uint32_t addr;              /* Physical address. */
+    uint16_t size;              /* Size in bytes, with 0 meaning 64 kB. */
+    uint16_t flags;             /* PRD_EOT in the last descriptor. */
+  };
+
+#define PRD_SPAN 0x10000        /* 64 kB. */
+#define PRD_EOT 0x8000          /* End of table. */
+
+/* Number of descriptors in a channel's PRD table: enough for
+   MAX_SECTORS_PER_CMD sectors, wherever they start. */
+#define PRD_CNT (MAX_SECTORS_PER_CMD * BLOCK_SECTOR_SIZE / PRD_SPAN + 1)
 
 /* An ATA device. */
 struct ata_disk
@@ -57,6 +115,7 @@ struct ata_disk
     struct channel *channel;    /* Channel that disk is attached to. */
     int dev_no;                 /* Device 0 or 1 for master or slave. */
     bool is_ata;                /* Is device an ATA disk? */
+    bool dma;                   /* Transfer data by DMA? */
   };
 
 /* An ATA channel (aka controller).
@@ -73,6 +132,10 @@ struct channel
     struct semaphore completion_wait;   /* Up'd by interrupt handler. */
 
     struct ata_disk devices[2];     /* The devices on this channel. */
+
+    uint16_t bm_base;           /* Bus master I/O port, or 0 if none. */
+    struct prd prdt[PRD_CNT]    /* PRD table for DMA.  Aligned so */
+      __attribute__ ((aligned (32)));   /* as not to cross 64 kB. */
   };
 
 /* We support the two "legacy" ATA channels found in a standard PC. */
@@ -81,12 +144,13 @@ static struct channel channels[CHANNEL_CNT];
 
 static struct block_operations ide_operations;
 
+static uint16_t find_bus_master (size_t chan_no);
 static void reset_channel (struct channel *);
 static bool check_device_type (struct ata_disk *);
 static void identify_ata_device (struct ata_disk *);
 
-static void select_sector (struct ata_disk *, block_sector_t);
-static void issue_pio_command (struct channel *, uint8_t command);
+static void select_sectors (struct ata_disk *, block_sector_t, size_t cnt);
+static void issue_command (struct channel *, uint8_t command);
 static void input_sector (struct channel *, void *);
 static void output_sector (struct channel *, const void *);
 
@@ -126,6 +190,10 @@ ide_init (void)
       lock_init (&c->lock);
       c->expecting_interrupt = false;
       sema_init (&c->completion_wait, 0);
+      c->bm_base = find_bus_master (chan_no);
+      if (c->bm_base != 0)
+        printf ("%s: bus-master DMA at port %#"PRIx16"\n",
+                c->name, c->bm_base);
  
       /* Initialize devices. */
       for (dev_no = 0; dev_no < 2; dev_no++)
@@ -136,6 +204,7 @@ ide_init (void)
           d->channel = c;
           d->dev_no = dev_no;
           d->is_ata = false;
+          d->dma = false;
         }
 
       /* Register interrupt handler. */
@@ -159,6 +228,36 @@ ide_init (void)
 
 static char *descramble_ata_string (char *, int size);
 
+/* Returns the first port of the bus master registers for the
+   legacy ATA channel CHAN_NO, enabling bus mastering on the PCI
+   IDE controller that drives it, or returns 0 if no controller
+   can do DMA on that channel. */
+static uint16_t
+find_bus_master (size_t chan_no)
+{
+  uint8_t native = chan_no == 0 ? IDE_IF_NATIVE0 : IDE_IF_NATIVE1;
+  struct pci_dev *dev = NULL;
+
+  while ((dev = pci_find_class (PCI_CLASS_STORAGE, PCI_SUBCLASS_IDE, dev))
+         != NULL)
+    {
+      uint16_t base;
+
+      /* A channel in native mode has ports other than the legacy
+         ones that we use, so it must belong to some other
+         controller. */
+      if (!(dev->prog_if & IDE_IF_BUS_MASTER) || (dev->prog_if & native))
+        continue;
+      base = pci_io_base (dev, IDE_BAR_BUS_MASTER);
+      if (base == 0)
+        continue;
+
+      pci_enable (dev, true);
+      return base + chan_no * 8;
+    }
+  return 0;
+}
+
 /* Resets an ATA channel and waits for any devices present on it
    to finish the reset. */
 static void
@@ -272,7 +371,7 @@ identify_ata_device (struct ata_disk *d)
      indicating the device's response is ready, and read the data
      into our buffer. */
   select_device_wait (d);
-  issue_pio_command (c, CMD_IDENTIFY_DEVICE);
+  issue_command (c, CMD_IDENTIFY_DEVICE);
   sema_down (&c->completion_wait);
   if (!wait_while_busy (d))
     {
@@ -282,8 +381,10 @@ identify_ata_device (struct ata_disk *d)
   input_sector (c, id);
 
   /* Calculate capacity.
+     Check for DMA support.
      Read model name and serial number. */
   capacity = *(uint32_t *) &id[60 * 2];
+  d->dma = c->bm_base != 0 && (*(uint16_t *) &id[49 * 2] & 0x0100) != 0;
   model = descramble_ata_string (&id[10 * 2], 20);
   serial = descramble_ata_string (&id[27 * 2], 40);
   snprintf (extra_info, sizeof extra_info,
@@ -337,63 +438,240 @@ descramble_ata_string (char *string, int size)
   return string;
 }
 
-/* Reads sector SEC_NO from disk D into BUFFER, which must have
-   room for BLOCK_SECTOR_SIZE bytes.
+/* Reads CNT sectors, which must be between 1 and
+   MAX_SECTORS_PER_CMD, starting at SEC_NO from disk D into
+   BUFFER in PIO mode.  The disk interrupts as each sector
+   becomes ready.  The caller must hold D's channel's lock. */
+static void
+pio_read (struct ata_disk *d, block_sector_t sec_no, size_t cnt,
+          uint8_t *buffer)
+{
+  struct channel *c = d->channel;
+  size_t i;
+
+  select_sectors (d, sec_no, cnt);
+  issue_command (c, CMD_READ_SECTOR_RETRY);
+  for (i = 0; i < cnt; i++)
+    {
+      sema_down (&c->completion_wait);
+      if (!wait_while_busy (d))
+        PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no + i);
+      input_sector (c, buffer);
+      buffer += BLOCK_SECTOR_SIZE;
+    }
+}
+
+/* Writes CNT sectors, which must be between 1 and
+   MAX_SECTORS_PER_CMD, starting at SEC_NO to disk D from BUFFER
+   in PIO mode.  The disk interrupts as it finishes with each
+   sector.  The caller must hold D's channel's lock. */
+static void
+pio_write (struct ata_disk *d, block_sector_t sec_no, size_t cnt,
+           const uint8_t *buffer)
+{
+  struct channel *c = d->channel;
+  size_t i;
+
+  select_sectors (d, sec_no, cnt);
+  issue_command (c, CMD_WRITE_SECTOR_RETRY);
+  for (i = 0; i < cnt; i++)
+    {
+      if (!wait_while_busy (d))
+        PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no + i);
+      output_sector (c, buffer);
+      buffer += BLOCK_SECTOR_SIZE;
+      sema_down (&c->completion_wait);
+    }
+}
+
+/* Returns true if the SIZE bytes at BUFFER can take part in a
+   DMA transfer: they must be word-aligned and lie in the
+   kernel's mapping of physical memory, which leaves out
+   vmalloc() space. */
+static bool
+dma_ok (const void *buffer, size_t size)
+{
+  return ((uintptr_t) buffer % 2 == 0
+          && is_kernel_vaddr (buffer)
+          && vtop (buffer) + size <= (uintptr_t) init_ram_pages * PGSIZE);
+}
+
+/* Fills in channel C's PRD table to describe the SIZE bytes at
+   BUFFER, which must satisfy dma_ok().  A region may not cross a
+   64 kB boundary, so the buffer is split at each one. */
+static void
+setup_prdt (struct channel *c, const void *buffer, size_t size)
+{
+  uintptr_t addr = vtop (buffer);
+  size_t i;
+
+  for (i = 0; ; i++)
+    {
+      size_t room = PRD_SPAN - addr % PRD_SPAN;
+      size_t chunk = size < room ? size : room;
+
+      ASSERT (i < PRD_CNT);
+      c->prdt[i].addr = addr;
+      c->prdt[i].size = chunk;          /* 64 kB becomes 0, as required. */
+      c->prdt[i].flags = 0;
+      addr += chunk;
+      size -= chunk;
+      if (size == 0)
+        break;
+    }
+  c->prdt[i].flags = PRD_EOT;
+}
+
+/* Tries to transfer CNT sectors, which must be between 1 and
+   MAX_SECTORS_PER_CMD, starting at SEC_NO between disk D and
+   BUFFER by bus-master DMA: from the disk into BUFFER if WRITE
+   is false, or from BUFFER to the disk if WRITE is true.  The
+   disk interrupts once, at the end.  Returns true if successful.
+   Returns false if the transfer could not be done by DMA or
+   failed, in which case the caller should fall back to PIO.  The
+   caller must hold D's channel's lock. */
+static bool
+dma_transfer (struct ata_disk *d, block_sector_t sec_no, size_t cnt,
+              void *buffer, bool write)
+{
+  struct channel *c = d->channel;
+  uint8_t direction = write ? 0 : BM_CMD_TO_MEMORY;
+  uint8_t bm_status, status;
+
+  if (!d->dma || !dma_ok (buffer, cnt * BLOCK_SECTOR_SIZE))
+    return false;
+
+  setup_prdt (c, buffer, cnt * BLOCK_SECTOR_SIZE);
+  outl (reg_bm_prdt (c), vtop (c->prdt));
+  outb (reg_bm_command (c), direction);
+  outb (reg_bm_status (c), inb (reg_bm_status (c)) | BM_ST_ERROR | BM_ST_INTR);
+
+  /* The controller reads BUFFER and the PRD table, or writes
+     BUFFER, behind the compiler's back. */
+  barrier ();
+  select_sectors (d, sec_no, cnt);
+  issue_command (c, write ? CMD_WRITE_DMA : CMD_READ_DMA);
+  outb (reg_bm_command (c), direction | BM_CMD_START);
+  sema_down (&c->completion_wait);
+  outb (reg_bm_command (c), direction);
+  barrier ();
+
+  bm_status = inb (reg_bm_status (c));
+  outb (reg_bm_status (c), bm_status | BM_ST_ERROR | BM_ST_INTR);
+  wait_until_idle (d);
+  status = inb (reg_alt_status (c));
+  if ((bm_status & BM_ST_ERROR) || (status & STA_ERR))
+    {
+      printf ("%s: DMA %s failed, sector=%"PRDSNu", using PIO from now on\n",
+              d->name, write ? "write" : "read", sec_no);
+      d->dma = false;
+      return false;
+    }
+  return true;
+}
+
+/* Reads CNT sectors starting at SEC_NO from disk D into BUFFER,
+   which must have room for CNT * BLOCK_SECTOR_SIZE bytes.  Each
+   command transfers up to MAX_SECTORS_PER_CMD sectors, by DMA if
+   the disk's controller supports it and otherwise in PIO mode.
    Internally synchronizes accesses to disks, so external
    per-disk locking is unneeded. */
 static void
-ide_read (void *d_, block_sector_t sec_no, void *buffer)
+ide_read_multi (void *d_, block_sector_t sec_no, size_t cnt, void *buffer_)
 {
   struct ata_disk *d = d_;
   struct channel *c = d->channel;
+  uint8_t *buffer = buffer_;
+
   lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_READ_SECTOR_RETRY);
-  sema_down (&c->completion_wait);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
-  input_sector (c, buffer);
+  while (cnt > 0)
+    {
+      size_t n = cnt < MAX_SECTORS_PER_CMD ? cnt : MAX_SECTORS_PER_CMD;
+
+      if (!dma_transfer (d, sec_no, n, buffer, false))
+        pio_read (d, sec_no, n, buffer);
+      buffer += n * BLOCK_SECTOR_SIZE;
+      sec_no += n;
+      cnt -= n;
+    }
   lock_release (&c->lock);
 }
 
-/* Write sector SEC_NO to disk D from BUFFER, which must contain
-   BLOCK_SECTOR_SIZE bytes.  Returns after the disk has
-   acknowledged receiving the data.
+/* Writes CNT sectors starting at SEC_NO to disk D from BUFFER,
+   which must contain CNT * BLOCK_SECTOR_SIZE bytes.  Each
+   command transfers up to MAX_SECTORS_PER_CMD sectors, by DMA if
+   the disk's controller supports it and otherwise in PIO mode.
+   Returns after the disk has acknowledged receiving all of the
+   data.
    Internally synchronizes accesses to disks, so external
    per-disk locking is unneeded. */
 static void
-ide_write (void *d_, block_sector_t sec_no, const void *buffer)
+ide_write_multi (void *d_, block_sector_t sec_no, size_t cnt,
+                 const void *buffer_)
 {
   struct ata_disk *d = d_;
   struct channel *c = d->channel;
+  const uint8_t *buffer = buffer_;
+
   lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
-  output_sector (c, buffer);
-  sema_down (&c->completion_wait);
+  while (cnt > 0)
+    {
+      size_t n = cnt < MAX_SECTORS_PER_CMD ? cnt : MAX_SECTORS_PER_CMD;
+
+      if (!dma_transfer (d, sec_no, n, (void *) buffer, true))
+        pio_write (d, sec_no, n, buffer);
+      buffer += n * BLOCK_SECTOR_SIZE;
+      sec_no += n;
+      cnt -= n;
+    }
   lock_release (&c->lock);
 }
 
+/* Reads sector SEC_NO from disk D into BUFFER, which must have
+   room for BLOCK_SECTOR_SIZE bytes.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+static void
+ide_read (void *d, block_sector_t sec_no, void *buffer)
+{
+  ide_read_multi (d, sec_no, 1, buffer);
+}
+
+/* Write sector SEC_NO to disk D from BUFFER, which must contain
+   BLOCK_SECTOR_SIZE bytes.  Returns after the disk has
+   acknowledged receiving the data.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+static void
+ide_write (void *d, block_sector_t sec_no, const void *buffer)
+{
+  ide_write_multi (d, sec_no, 1, buffer);
+}
+
 static struct block_operations ide_operations =
   {
     ide_read,
-    ide_write
+    ide_write,
+    ide_read_multi,
+    ide_write_multi,
+    NULL,
+    NULL
   };
-
+
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
-   use LBA mode.) */
+   writes SEC_NO and CNT, which must be between 1 and
+   MAX_SECTORS_PER_CMD, to the disk's sector selection registers.
+   (We use LBA mode.) */
 static void
-select_sector (struct ata_disk *d, block_sector_t sec_no)
+select_sectors (struct ata_disk *d, block_sector_t sec_no, size_t cnt)
 {
   struct channel *c = d->channel;
 
-  ASSERT (sec_no < (1UL << 28));
+  ASSERT (cnt > 0 && cnt <= MAX_SECTORS_PER_CMD);
+  ASSERT (sec_no + cnt <= (1UL << 28));
   
   select_device_wait (d);
-  outb (reg_nsect (c), 1);
+  outb (reg_nsect (c), cnt == MAX_SECTORS_PER_CMD ? 0 : cnt);
   outb (reg_lbal (c), sec_no);
   outb (reg_lbam (c), sec_no >> 8);
   outb (reg_lbah (c), (sec_no >> 16));
@@ -404,7 +682,7 @@ select_sector (struct ata_disk *d, block_sector_t sec_no)
 /* Writes COMMAND to channel C and prepares for receiving a
    completion interrupt. */
 static void
-issue_pio_command (struct channel *c, uint8_t command) 
+issue_command (struct channel *c, uint8_t command) 
 {
   /* Interrupts must be enabled or our semaphore will never be
      up'd by the completion handler. */
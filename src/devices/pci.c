@@ -0,0 +1,222 @@
+#include "devices/pci.h"
+#include <debug.h>
+#include <stddef.h>
+#include <stdio.h>
+#include "threads/interrupt.h"
+#include "threads/io.h"
+
+/* The code in this file finds the functions on the PCI buses and
+   gives access to their configuration space, using
+   configuration mechanism #1 from [PCI]. */
+
+/* Configuration mechanism #1 ports. */
+#define PCI_CONFIG_ADDRESS 0xcf8        /* Selects a register. */
+#define PCI_CONFIG_DATA 0xcfc           /* Selected register's data. */
+#define PCI_CONFIG_ENABLE 0x80000000    /* Enables configuration cycle. */
+
+/* Header registers read by pci_init(). */
+#define PCI_REG_ID 0x00         /* Vendor ID, device ID. */
+#define PCI_REG_CLASS 0x08      /* Revision, prog IF, subclass, class. */
+#define PCI_REG_HEADER 0x0e     /* Header type. */
+#define PCI_REG_IRQ 0x3c        /* Interrupt line. */
+
+#define PCI_HEADER_MULTI 0x80   /* Header type: multifunction device. */
+#define PCI_BAR_IO 0x01         /* Base address is in I/O space. */
+
+/* Limits of the bus hierarchy. */
+#define PCI_BUS_CNT 256
+#define PCI_SLOT_CNT 32
+#define PCI_FUNC_CNT 8
+
+/* PCI functions found by pci_init(). */
+#define PCI_DEV_MAX 32
+static struct pci_dev devices[PCI_DEV_MAX];
+static size_t dev_cnt;
+
+static uint32_t config_read (uint8_t bus, uint8_t slot, uint8_t func,
+                             uint8_t reg);
+static void found_function (uint8_t bus, uint8_t slot, uint8_t func);
+
+/* Scans the PCI buses and records the functions on them. */
+void
+pci_init (void)
+{
+  int bus, slot, func;
+
+  for (bus = 0; bus < PCI_BUS_CNT; bus++)
+    for (slot = 0; slot < PCI_SLOT_CNT; slot++)
+      {
+        if ((config_read (bus, slot, 0, PCI_REG_ID) & 0xffff) == 0xffff)
+          continue;
+        found_function (bus, slot, 0);
+
+        if ((config_read (bus, slot, 0, PCI_REG_HEADER & ~3)
+             >> (PCI_REG_HEADER & 3) * 8) & PCI_HEADER_MULTI)
+          for (func = 1; func < PCI_FUNC_CNT; func++)
+            if ((config_read (bus, slot, func, PCI_REG_ID) & 0xffff)
+                != 0xffff)
+              found_function (bus, slot, func);
+      }
+  printf ("pci: %zu functions found\n", dev_cnt);
+}
+
+/* Records the function FUNC of device SLOT on BUS. */
+static void
+found_function (uint8_t bus, uint8_t slot, uint8_t func)
+{
+  struct pci_dev *dev;
+  uint32_t id, class;
+
+  if (dev_cnt >= PCI_DEV_MAX)
+    {
+      printf ("pci: too many functions, ignoring %02x:%02x.%x\n",
+              bus, slot, func);
+      return;
+    }
+
+  dev = &devices[dev_cnt++];
+  dev->bus = bus;
+  dev->slot = slot;
+  dev->func = func;
+  id = config_read (bus, slot, func, PCI_REG_ID);
+  dev->vendor_id = id;
+  dev->device_id = id >> 16;
+  class = config_read (bus, slot, func, PCI_REG_CLASS);
+  dev->prog_if = class >> 8;
+  dev->subclass = class >> 16;
+  dev->class = class >> 24;
+  dev->irq = config_read (bus, slot, func, PCI_REG_IRQ);
+}
+
+/* Returns the next PCI function after PREV, or the first one if
+   PREV is a null pointer, with the given CLASS and SUBCLASS.
+   Returns a null pointer if there are no more. */
+struct pci_dev *
+pci_find_class (uint8_t class, uint8_t subclass, struct pci_dev *prev)
+{
+  struct pci_dev *dev;
+
+  for (dev = prev != NULL ? prev + 1 : devices; dev < devices + dev_cnt;
+       dev++)
+    if (dev->class == class && dev->subclass == subclass)
+      return dev;
+  return NULL;
+}
+
+/* Returns the next PCI function after PREV, or the first one if
+   PREV is a null pointer, with the given VENDOR_ID and
+   DEVICE_ID.  Returns a null pointer if there are no more. */
+struct pci_dev *
+pci_find_id (uint16_t vendor_id, uint16_t device_id, struct pci_dev *prev)
+{
+  struct pci_dev *dev;
+
+  for (dev = prev != NULL ? prev + 1 : devices; dev < devices + dev_cnt;
+       dev++)
+    if (dev->vendor_id == vendor_id && dev->device_id == device_id)
+      return dev;
+  return NULL;
+}
+
+/* Selects register REG, which must be a multiple of 4, of
+   function FUNC of device SLOT on BUS.  Interrupts must be off,
+   so that nothing else selects a register before the caller
+   accesses this one. */
+static void
+select_register (uint8_t bus, uint8_t slot, uint8_t func, uint8_t reg)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (reg % 4 == 0);
+
+  outl (PCI_CONFIG_ADDRESS, (PCI_CONFIG_ENABLE | (uint32_t) bus << 16
+                             | (uint32_t) slot << 11 | (uint32_t) func << 8
+                             | reg));
+}
+
+/* Reads the 32-bit register REG, which must be a multiple of 4,
+   of function FUNC of device SLOT on BUS. */
+static uint32_t
+config_read (uint8_t bus, uint8_t slot, uint8_t func, uint8_t reg)
+{
+  enum intr_level old_level = intr_disable ();
+  uint32_t data;
+
+  select_register (bus, slot, func, reg);
+  data = inl (PCI_CONFIG_DATA);
+  intr_set_level (old_level);
+  return data;
+}
+
+/* Reads DEV's 32-bit configuration register REG, which must be a
+   multiple of 4. */
+uint32_t
+pci_read32 (const struct pci_dev *dev, uint8_t reg)
+{
+  return config_read (dev->bus, dev->slot, dev->func, reg);
+}
+
+/* Reads DEV's 16-bit configuration register REG, which must be a
+   multiple of 2. */
+uint16_t
+pci_read16 (const struct pci_dev *dev, uint8_t reg)
+{
+  ASSERT (reg % 2 == 0);
+  return pci_read32 (dev, reg & ~3) >> (reg & 3) * 8;
+}
+
+/* Reads DEV's 8-bit configuration register REG. */
+uint8_t
+pci_read8 (const struct pci_dev *dev, uint8_t reg)
+{
+  return pci_read32 (dev, reg & ~3) >> (reg & 3) * 8;
+}
+
+/* Writes DATA to DEV's 32-bit configuration register REG, which
+   must be a multiple of 4. */
+void
+pci_write32 (const struct pci_dev *dev, uint8_t reg, uint32_t data)
+{
+  enum intr_level old_level = intr_disable ();
+  select_register (dev->bus, dev->slot, dev->func, reg);
+  outl (PCI_CONFIG_DATA, data);
+  intr_set_level (old_level);
+}
+
+/* Writes DATA to DEV's 16-bit configuration register REG, which
+   must be a multiple of 2. */
+void
+pci_write16 (const struct pci_dev *dev, uint8_t reg, uint16_t data)
+{
+  enum intr_level old_level;
+
+  ASSERT (reg % 2 == 0);
+  old_level = intr_disable ();
+  select_register (dev->bus, dev->slot, dev->func, reg & ~3);
+  outw (PCI_CONFIG_DATA + (reg & 3), data);
+  intr_set_level (old_level);
+}
+
+/* Returns the base I/O port of DEV's base address register BAR,
+   or 0 if BAR is unused or maps memory rather than I/O ports. */
+uint16_t
+pci_io_base (const struct pci_dev *dev, int bar)
+{
+  uint32_t base;
+
+  ASSERT (bar >= 0 && bar < PCI_BAR_CNT);
+  base = pci_read32 (dev, PCI_REG_BAR0 + bar * 4);
+  return base & PCI_BAR_IO ? base & ~3u : 0;
+}
+
+/* Lets DEV respond to accesses to its I/O ports and memory, and
+   if BUS_MASTER is true, lets it access memory itself. */
+void
+pci_enable (const struct pci_dev *dev, bool bus_master)
+{
+  uint16_t command = pci_read16 (dev, PCI_REG_COMMAND);
+
+  command |= PCI_CMD_IO | PCI_CMD_MEMORY;
+  if (bus_master)
+    command |= PCI_CMD_MASTER;
+  pci_write16 (dev, PCI_REG_COMMAND, command);
+}
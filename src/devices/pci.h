@@ -0,0 +1,46 @@
+#ifndef DEVICES_PCI_H
+#define DEVICES_PCI_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* A PCI function found on the bus. */
+struct pci_dev
+  {
+    uint8_t bus;                /* Bus number. */
+    uint8_t slot;               /* Device number on the bus. */
+    uint8_t func;               /* Function number within device. */
+    uint16_t vendor_id;         /* Vendor ID. */
+    uint16_t device_id;         /* Device ID. */
+    uint8_t class;              /* Base class code. */
+    uint8_t subclass;           /* Subclass code. */
+    uint8_t prog_if;            /* Programming interface. */
+    uint8_t irq;                /* Interrupt line, as routed by BIOS. */
+  };
+
+/* Configuration space registers. */
+#define PCI_REG_COMMAND 0x04    /* Command (16 bits). */
+#define PCI_REG_BAR0 0x10       /* First base address (32 bits). */
+#define PCI_BAR_CNT 6           /* Number of base address registers. */
+
+/* Command register bits. */
+#define PCI_CMD_IO 0x0001       /* Respond to I/O space accesses. */
+#define PCI_CMD_MEMORY 0x0002   /* Respond to memory space accesses. */
+#define PCI_CMD_MASTER 0x0004   /* Allow bus mastering. */
+
+void pci_init (void);
+struct pci_dev *pci_find_class (uint8_t class, uint8_t subclass,
+                                struct pci_dev *prev);
+struct pci_dev *pci_find_id (uint16_t vendor_id, uint16_t device_id,
+                             struct pci_dev *prev);
+
+uint32_t pci_read32 (const struct pci_dev *, uint8_t reg);
+uint16_t pci_read16 (const struct pci_dev *, uint8_t reg);
+uint8_t pci_read8 (const struct pci_dev *, uint8_t reg);
+void pci_write32 (const struct pci_dev *, uint8_t reg, uint32_t);
+void pci_write16 (const struct pci_dev *, uint8_t reg, uint16_t);
+
+uint16_t pci_io_base (const struct pci_dev *, int bar);
+void pci_enable (const struct pci_dev *, bool bus_master);
+
+#endif /* devices/pci.h */
@@ -77,6 +77,31 @@ timer_ticks (void)
     return t;
 }
 
+/* Returns the number of microseconds since the OS booted.  Reads
+   the PIT's count within the current tick, so the resolution is
+   about a microsecond rather than a whole tick. */
+    int64_t
+timer_usecs (void)
+{
+    const int64_t pit_per_tick = (PIT_HZ + TIMER_FREQ / 2) / TIMER_FREQ;
+    enum intr_level old_level = intr_disable ();
+    int64_t t = ticks;
+    int64_t count = pit_read_counter (0);
+
+    /* If the count started over since the last timer interrupt,
+       the interrupt is still waiting for interrupts to come back
+       on, and the tick it would count has already begun. */
+    if (intr_ext_pending (0x20))
+    {
+        t++;
+        count = pit_read_counter (0);
+    }
+    intr_set_level (old_level);
+
+    return (t * (1000 * 1000 / TIMER_FREQ)
+            + (pit_per_tick - count) * 1000 * 1000 / PIT_HZ);
+}
+
 /* Returns the number of timer ticks elapsed since THEN, which
    should be a value once returned by timer_ticks(). */
     int64_t
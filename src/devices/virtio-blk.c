@@ -0,0 +1,600 @@
+#include "devices/virtio-blk.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <round.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/block.h"
+#include "devices/partition.h"
+#include "devices/pci.h"
+#include "threads/interrupt.h"
+#include "threads/io.h"
+#include "threads/loader.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* The code in this file drives virtio block devices, the
+   paravirtualized disks that QEMU attaches with "-drive
+   if=virtio", through the legacy PCI interface described in
+   version 0.9.5 of the virtio specification.
+
+   Unlike an IDE disk, a virtio disk has no registers to program
+   per command.  The driver describes each request with a chain
+   of descriptors in a "virtqueue" in memory, which the device
+   reads and writes directly, then rings a doorbell.  Requests
+   placed in the queue together cost a single doorbell and a
+   single interrupt, however many there are.
+
+   The block layer passes the driver batches of requests through
+   transfer_batch (see block.h).  Each run of adjacent requests in
+   the same direction becomes one virtio request, with one data
+   descriptor per block request, so they need no staging buffer.
+   The driver makes every virtio request in the batch available
+   at once and sleeps until the device has completed them all. */
+
+/* PCI IDs of a legacy or transitional virtio block device. */
+#define VIRTIO_VENDOR_ID 0x1af4
+#define VIRTIO_BLK_DEVICE_ID 0x1001
+
+/* Legacy virtio registers, as offsets from the I/O ports in BAR
+   0. */
+#define REG_HOST_FEATURES 0x00  /* Features the device offers. */
+#define REG_GUEST_FEATURES 0x04 /* Features the driver accepts. */
+#define REG_QUEUE_PFN 0x08      /* Physical page of selected queue. */
+#define REG_QUEUE_SIZE 0x0c     /* Entries in selected queue (r/o). */
+#define REG_QUEUE_SELECT 0x0e   /* Selects a queue. */
+#define REG_QUEUE_NOTIFY 0x10   /* Doorbell: queue with new requests. */
+#define REG_STATUS 0x12         /* Device status. */
+#define REG_ISR 0x13            /* Interrupt status, cleared by read. */
+#define REG_CONFIG 0x14         /* Device-specific configuration. */
+
+/* Device status bits. */
+#define STATUS_ACK 0x01         /* Driver noticed the device. */
+#define STATUS_DRIVER 0x02      /* Driver knows how to drive it. */
+#define STATUS_DRIVER_OK 0x04   /* Driver is ready. */
+#define STATUS_FAILED 0x80      /* Driver gave up on the device. */
+
+/* Interrupt status bits. */
+#define ISR_QUEUE 0x01          /* A queue has new used entries. */
+
+/* Block device features. */
+#define F_SIZE_MAX (1u << 1)    /* CFG_SIZE_MAX is valid. */
+#define F_SEG_MAX (1u << 2)     /* CFG_SEG_MAX is valid. */
+
+/* Block device configuration, as offsets from REG_CONFIG. */
+#define CFG_CAPACITY 0          /* Size in sectors (64 bits). */
+#define CFG_SIZE_MAX 8          /* Most bytes in a data descriptor. */
+#define CFG_SEG_MAX 12          /* Most data descriptors per request. */
+
+/* A virtqueue descriptor: one buffer in a request. */
+struct vring_desc
+  {
+    uint64_t addr;              /* Physical address. */
+    uint32_t len;               /* Length in bytes. */
+    uint16_t flags;             /* VRING_DESC_F_* flags. */
+    uint16_t next;              /* Next descriptor, with F_NEXT. */
+  };
+
+#define VRING_DESC_F_NEXT 1     /* Request continues in NEXT. */
+#define VRING_DESC_F_WRITE 2    /* Device writes, instead of reads. */
+
+/* The "available" ring, where the driver places requests. */
+struct vring_avail
+  {
+    uint16_t flags;             /* No flags are used. */
+    uint16_t idx;               /* Where the next entry will go. */
+    uint16_t ring[];            /* First descriptor of each request. */
+  };
+
+/* An entry in the "used" ring. */
+struct vring_used_elem
+  {
+    uint32_t id;                /* First descriptor of the request. */
+    uint32_t len;               /* Bytes written by the device. */
+  };
+
+/* The "used" ring, where the device returns completed requests. */
+struct vring_used
+  {
+    uint16_t flags;             /* VRING_USED_F_* flags. */
+    uint16_t idx;               /* Where the next entry will go. */
+    struct vring_used_elem ring[];
+  };
+
+#define VRING_USED_F_NO_NOTIFY 1 /* Device needs no doorbell. */
+
+/* The header that starts each block request. */
+struct req_header
+  {
+    uint32_t type;              /* REQ_IN or REQ_OUT. */
+    uint32_t reserved;          /* Must be zero. */
+    uint64_t sector;            /* First sector. */
+  };
+
+#define REQ_IN 0                /* Read. */
+#define REQ_OUT 1               /* Write. */
+#define REQ_STATUS_OK 0         /* Status byte on success. */
+
+/* Most virtio requests in the queue at once. */
+#define REQ_MAX 32
+
+/* Buffers that the device cannot reach, such as those from
+   vmalloc(), are staged through a bounce buffer of this many
+   pages. */
+#define BOUNCE_PAGES 8
+#define BOUNCE_SIZE (BOUNCE_PAGES * PGSIZE)
+
+/* Data to copy out of the bounce buffer once a read completes. */
+struct bounce_copy
+  {
+    void *dst;                  /* Caller's buffer. */
+    const void *src;            /* Data in the bounce buffer. */
+    size_t size;                /* Number of bytes. */
+  };
+
+/* A virtio disk.
+
+   Only the disk's dispatcher thread calls into the driver, so
+   nothing here needs a lock.  The interrupt handler touches only
+   USED_IDX and PENDING, and only while requests are pending. */
+struct disk
+  {
+    char name[8];               /* Name, e.g. "vda". */
+    uint16_t io_base;           /* First I/O port. */
+    uint8_t irq;                /* Interrupt vector. */
+    size_t seg_max;             /* Most data descriptors per request. */
+    size_t size_max;            /* Most bytes per data descriptor. */
+
+    /* The virtqueue. */
+    uint16_t queue_size;        /* Number of descriptors. */
+    struct vring_desc *desc;    /* Descriptor table. */
+    struct vring_avail *avail;  /* Available ring. */
+    volatile struct vring_used *used;   /* Used ring. */
+    uint16_t used_idx;          /* Next used entry to reap. */
+    int pending;                /* Requests the device has not used. */
+    struct semaphore done;      /* Up'd when PENDING drops to 0. */
+
+    /* Requests being built for the next flush(). */
+    struct req_header *headers; /* REQ_MAX request headers. */
+    uint8_t *status;            /* REQ_MAX status bytes. */
+    uint16_t heads[REQ_MAX];    /* First descriptor of each request. */
+    size_t req_cnt;             /* Number of requests. */
+    size_t desc_cnt;            /* Number of descriptors used. */
+    bool req_open;              /* Is the last request unfinished? */
+    bool req_write;             /* Does the open request write? */
+    block_sector_t next_sector; /* Sector after the open request. */
+    size_t data_cnt;            /* Data descriptors in it. */
+
+    /* Bounce buffer. */
+    uint8_t *bounce;            /* BOUNCE_SIZE bytes, or null. */
+    size_t bounce_used;         /* Bytes used by pending requests. */
+    struct bounce_copy copies[BOUNCE_SIZE / BLOCK_SECTOR_SIZE];
+    size_t copy_cnt;            /* Number of COPIES. */
+  };
+
+#define DISK_MAX 8
+static struct disk disks[DISK_MAX];
+static size_t disk_cnt;
+
+/* Interrupt vectors that interrupt_handler() is registered for.
+   PCI devices may share a vector. */
+static bool vector_registered[16];
+
+static struct block_operations virtio_blk_operations;
+
+static void probe (struct pci_dev *);
+static void interrupt_handler (struct intr_frame *);
+
+/* Finds the virtio disks on the PCI bus and registers a block
+   device for each. */
+void
+virtio_blk_init (void)
+{
+  struct pci_dev *dev = NULL;
+
+  while ((dev = pci_find_id (VIRTIO_VENDOR_ID, VIRTIO_BLK_DEVICE_ID, dev))
+         != NULL)
+    {
+      if (disk_cnt >= DISK_MAX)
+        {
+          printf ("virtio-blk: too many disks, ignoring the rest\n");
+          break;
+        }
+      probe (dev);
+    }
+}
+
+/* Returns the offset of the used ring in a legacy virtqueue of
+   N entries.  The descriptor table and the available ring come
+   first, and the used ring starts on the next page boundary. */
+static size_t
+vring_used_ofs (size_t n)
+{
+  return ROUND_UP (sizeof (struct vring_desc) * n
+                   + sizeof (uint16_t) * (3 + n), PGSIZE);
+}
+
+/* Returns the number of bytes in a legacy virtqueue of N
+   entries. */
+static size_t
+vring_size (size_t n)
+{
+  return (vring_used_ofs (n)
+          + ROUND_UP (sizeof (uint16_t) * 3
+                      + sizeof (struct vring_used_elem) * n, PGSIZE));
+}
+
+/* Tells disk D's device that we are giving up on it, and prints
+   MESSAGE about it. */
+static void
+fail (struct disk *d, const char *message)
+{
+  outb (d->io_base + REG_STATUS, STATUS_FAILED);
+  printf ("%s: %s, ignoring disk\n", d->name, message);
+}
+
+/* Initializes virtio disk DEV and registers it. */
+static void
+probe (struct pci_dev *dev)
+{
+  struct disk *d = &disks[disk_cnt];
+  uint16_t config;
+  uint32_t features;
+  uint64_t capacity;
+  size_t ring_pages;
+  uint8_t *ring;
+  char extra_info[64];
+  struct block *block;
+
+  snprintf (d->name, sizeof d->name, "vd%c", 'a' + (int) disk_cnt);
+  d->io_base = pci_io_base (dev, 0);
+  if (d->io_base == 0 || dev->irq == 0 || dev->irq >= 16)
+    {
+      printf ("%s: no legacy I/O ports or interrupt, ignoring disk\n",
+              d->name);
+      return;
+    }
+  pci_enable (dev, true);
+
+  /* Reset the device and negotiate features. */
+  outb (d->io_base + REG_STATUS, 0);
+  outb (d->io_base + REG_STATUS, STATUS_ACK);
+  outb (d->io_base + REG_STATUS, STATUS_ACK | STATUS_DRIVER);
+  features = inl (d->io_base + REG_HOST_FEATURES) & (F_SIZE_MAX | F_SEG_MAX);
+  outl (d->io_base + REG_GUEST_FEATURES, features);
+
+  config = d->io_base + REG_CONFIG;
+  capacity = (inl (config + CFG_CAPACITY)
+              | (uint64_t) inl (config + CFG_CAPACITY + 4) << 32);
+  if (capacity > (block_sector_t) -1)
+    {
+      fail (d, "too many sectors");
+      return;
+    }
+  d->size_max = features & F_SIZE_MAX ? inl (config + CFG_SIZE_MAX) : 0;
+  d->size_max = ROUND_DOWN (d->size_max, BLOCK_SECTOR_SIZE);
+  if (d->size_max == 0 || d->size_max > BOUNCE_SIZE)
+    d->size_max = BOUNCE_SIZE;
+  d->seg_max = features & F_SEG_MAX ? inl (config + CFG_SEG_MAX) : 0;
+
+  /* Set up the virtqueue, whose size the device dictates. */
+  outw (d->io_base + REG_QUEUE_SELECT, 0);
+  d->queue_size = inw (d->io_base + REG_QUEUE_SIZE);
+  if (d->queue_size < 3)
+    {
+      fail (d, "no usable queue");
+      return;
+    }
+  if (d->seg_max == 0 || d->seg_max > d->queue_size - 2u)
+    d->seg_max = d->queue_size - 2;
+  ring_pages = vring_size (d->queue_size) / PGSIZE;
+  ring = palloc_get_multiple (PAL_ZERO, ring_pages);
+  d->headers = palloc_get_page (PAL_ZERO);
+  d->bounce = palloc_get_multiple (0, BOUNCE_PAGES);
+  if (ring == NULL || d->headers == NULL || d->bounce == NULL)
+    {
+      palloc_free_multiple (ring, ring_pages);
+      palloc_free_page (d->headers);
+      palloc_free_multiple (d->bounce, BOUNCE_PAGES);
+      fail (d, "out of memory");
+      return;
+    }
+  d->status = (uint8_t *) (d->headers + REQ_MAX);
+  d->desc = (struct vring_desc *) ring;
+  d->avail = (struct vring_avail *) (ring + sizeof *d->desc * d->queue_size);
+  d->used = (struct vring_used *) (ring + vring_used_ofs (d->queue_size));
+  d->used_idx = 0;
+  d->pending = 0;
+  sema_init (&d->done, 0);
+  d->req_cnt = d->desc_cnt = 0;
+  d->req_open = false;
+  d->bounce_used = d->copy_cnt = 0;
+  outl (d->io_base + REG_QUEUE_PFN, vtop (ring) / PGSIZE);
+
+  /* Register interrupt handler, unless another virtio disk on the
+     same interrupt line already did. */
+  d->irq = dev->irq + 0x20;
+  if (!vector_registered[dev->irq])
+    {
+      intr_register_ext (d->irq, interrupt_handler, "virtio-blk");
+      vector_registered[dev->irq] = true;
+    }
+  disk_cnt++;
+  outb (d->io_base + REG_STATUS,
+        STATUS_ACK | STATUS_DRIVER | STATUS_DRIVER_OK);
+
+  /* Register. */
+  snprintf (extra_info, sizeof extra_info,
+            "virtio at port %#"PRIx16", %"PRIu16"-entry queue",
+            d->io_base, d->queue_size);
+  block = block_register (d->name, BLOCK_RAW, extra_info, capacity,
+                          &virtio_blk_operations, d);
+  partition_scan (block);
+}
+
+/* Returns true if the device can reach the SIZE bytes at BUFFER
+   directly.  That is only so for memory in the kernel's mapping
+   of physical memory, which leaves out vmalloc() space. */
+static bool
+dma_ok (const void *buffer, size_t size)
+{
+  return (is_kernel_vaddr (buffer)
+          && vtop (buffer) + size <= (uintptr_t) init_ram_pages * PGSIZE);
+}
+
+/* Appends a descriptor for the SIZE bytes at physical address
+   ADDR to D's open request.  The device writes the bytes if
+   DEVICE_WRITES is true, otherwise it reads them. */
+static void
+add_desc (struct disk *d, uintptr_t addr, size_t size, bool device_writes)
+{
+  struct vring_desc *desc = &d->desc[d->desc_cnt];
+
+  ASSERT (d->desc_cnt < d->queue_size);
+  desc->addr = addr;
+  desc->len = size;
+  desc->flags = device_writes ? VRING_DESC_F_WRITE : 0;
+  desc->next = 0;
+  if (d->desc_cnt != d->heads[d->req_cnt])
+    {
+      desc[-1].flags |= VRING_DESC_F_NEXT;
+      desc[-1].next = d->desc_cnt;
+    }
+  d->desc_cnt++;
+}
+
+/* Makes the requests built up in D available to the device and
+   waits for it to complete them.  Panics if any of them
+   failed. */
+static void
+flush (struct disk *d)
+{
+  size_t i;
+
+  ASSERT (!d->req_open);
+  if (d->req_cnt == 0)
+    return;
+
+  for (i = 0; i < d->req_cnt; i++)
+    d->avail->ring[(d->avail->idx + i) % d->queue_size] = d->heads[i];
+  d->pending = d->req_cnt;
+
+  /* The device reads the rings and buffers, and writes the used
+     ring and read buffers, behind the compiler's back. */
+  barrier ();
+  d->avail->idx += d->req_cnt;
+  barrier ();
+  if (!(d->used->flags & VRING_USED_F_NO_NOTIFY))
+    outw (d->io_base + REG_QUEUE_NOTIFY, 0);
+  sema_down (&d->done);
+  barrier ();
+
+  for (i = 0; i < d->req_cnt; i++)
+    if (d->status[i] != REQ_STATUS_OK)
+      PANIC ("%s: disk %s failed, sector=%"PRDSNu, d->name,
+             d->headers[i].type == REQ_OUT ? "write" : "read",
+             (block_sector_t) d->headers[i].sector);
+  for (i = 0; i < d->copy_cnt; i++)
+    memcpy (d->copies[i].dst, d->copies[i].src, d->copies[i].size);
+
+  d->req_cnt = d->desc_cnt = 0;
+  d->bounce_used = d->copy_cnt = 0;
+}
+
+/* Starts a new request in D to read (if WRITE is false) or write
+   (if WRITE is true) starting at SECTOR, first flushing the
+   requests already built if there is no room for another. */
+static void
+open_request (struct disk *d, bool write, block_sector_t sector)
+{
+  struct req_header *h;
+
+  ASSERT (!d->req_open);
+  if (d->req_cnt >= REQ_MAX || d->desc_cnt + 3u > d->queue_size)
+    flush (d);
+
+  h = &d->headers[d->req_cnt];
+  h->type = write ? REQ_OUT : REQ_IN;
+  h->reserved = 0;
+  h->sector = sector;
+  d->heads[d->req_cnt] = d->desc_cnt;
+  add_desc (d, vtop (h), sizeof *h, false);
+
+  d->req_open = true;
+  d->req_write = write;
+  d->next_sector = sector;
+  d->data_cnt = 0;
+}
+
+/* Finishes D's open request with its status byte. */
+static void
+close_request (struct disk *d)
+{
+  ASSERT (d->req_open);
+  d->status[d->req_cnt] = ~REQ_STATUS_OK;
+  add_desc (d, vtop (&d->status[d->req_cnt]), 1, true);
+  d->req_cnt++;
+  d->req_open = false;
+}
+
+/* Adds a transfer of the SIZE bytes at BUFFER to or from the
+   disk starting at SECTOR to D's requests, extending the open
+   request if the transfer follows on from it.  The data reaches
+   the disk, or BUFFER, only once flush() returns. */
+static void
+add_transfer (struct disk *d, bool write, block_sector_t sector,
+              uint8_t *buffer, size_t size)
+{
+  while (size > 0)
+    {
+      size_t chunk = size < d->size_max ? size : d->size_max;
+      bool bounce = !dma_ok (buffer, chunk);
+      uintptr_t addr;
+
+      if (d->req_open
+          && (d->req_write != write
+              || d->next_sector != sector
+              || d->data_cnt >= d->seg_max
+              || d->desc_cnt + 2u > d->queue_size))
+        close_request (d);
+      if (bounce && d->bounce_used == BOUNCE_SIZE)
+        {
+          if (d->req_open)
+            close_request (d);
+          flush (d);
+        }
+      if (!d->req_open)
+        open_request (d, write, sector);
+
+      if (bounce)
+        {
+          uint8_t *p = d->bounce + d->bounce_used;
+
+          if (chunk > BOUNCE_SIZE - d->bounce_used)
+            chunk = BOUNCE_SIZE - d->bounce_used;
+          if (write)
+            memcpy (p, buffer, chunk);
+          else
+            {
+              struct bounce_copy *c = &d->copies[d->copy_cnt++];
+              c->dst = buffer;
+              c->src = p;
+              c->size = chunk;
+            }
+          d->bounce_used += chunk;
+          addr = vtop (p);
+        }
+      else
+        addr = vtop (buffer);
+      add_desc (d, addr, chunk, !write);
+      d->data_cnt++;
+
+      d->next_sector += chunk / BLOCK_SECTOR_SIZE;
+      sector += chunk / BLOCK_SECTOR_SIZE;
+      buffer += chunk;
+      size -= chunk;
+    }
+}
+
+/* Submits D's requests and waits for all of them. */
+static void
+finish (struct disk *d)
+{
+  if (d->req_open)
+    close_request (d);
+  flush (d);
+}
+
+/* Carries out the block requests in BATCH.  Runs of adjacent
+   requests in the same direction become one virtio request. */
+static void
+virtio_blk_transfer_batch (void *d_, struct list *batch)
+{
+  struct disk *d = d_;
+  struct list_elem *e;
+
+  for (e = list_begin (batch); e != list_end (batch); e = list_next (e))
+    {
+      struct block_request *r = list_entry (e, struct block_request, elem);
+      add_transfer (d, r->write, r->dev_sector, r->buffer,
+                    r->cnt * BLOCK_SECTOR_SIZE);
+    }
+  finish (d);
+}
+
+/* Reads CNT sectors starting at SEC_NO from disk D into BUFFER,
+   which must have room for CNT * BLOCK_SECTOR_SIZE bytes. */
+static void
+virtio_blk_read_multi (void *d, block_sector_t sec_no, size_t cnt,
+                       void *buffer)
+{
+  add_transfer (d, false, sec_no, buffer, cnt * BLOCK_SECTOR_SIZE);
+  finish (d);
+}
+
+/* Writes CNT sectors starting at SEC_NO to disk D from BUFFER,
+   which must contain CNT * BLOCK_SECTOR_SIZE bytes.  Returns
+   after the device has reported the write complete. */
+static void
+virtio_blk_write_multi (void *d, block_sector_t sec_no, size_t cnt,
+                        const void *buffer)
+{
+  add_transfer (d, true, sec_no, (void *) buffer, cnt * BLOCK_SECTOR_SIZE);
+  finish (d);
+}
+
+/* Reads sector SEC_NO from disk D into BUFFER, which must have
+   room for BLOCK_SECTOR_SIZE bytes. */
+static void
+virtio_blk_read (void *d, block_sector_t sec_no, void *buffer)
+{
+  virtio_blk_read_multi (d, sec_no, 1, buffer);
+}
+
+/* Writes sector SEC_NO to disk D from BUFFER, which must contain
+   BLOCK_SECTOR_SIZE bytes. */
+static void
+virtio_blk_write (void *d, block_sector_t sec_no, const void *buffer)
+{
+  virtio_blk_write_multi (d, sec_no, 1, buffer);
+}
+
+static struct block_operations virtio_blk_operations =
+  {
+    virtio_blk_read,
+    virtio_blk_write,
+    virtio_blk_read_multi,
+    virtio_blk_write_multi,
+    NULL,
+    virtio_blk_transfer_batch
+  };
+
+/* virtio disk interrupt handler.  Reaps the requests that the
+   device has completed and wakes the waiting thread once all of
+   them are done. */
+static void
+interrupt_handler (struct intr_frame *f)
+{
+  size_t i;
+
+  for (i = 0; i < disk_cnt; i++)
+    {
+      struct disk *d = &disks[i];
+      bool reaped = false;
+
+      /* Reading ISR also acknowledges the interrupt. */
+      if (d->irq != f->vec_no
+          || !(inb (d->io_base + REG_ISR) & ISR_QUEUE))
+        continue;
+      while (d->used_idx != d->used->idx)
+        {
+          d->used_idx++;
+          d->pending--;
+          reaped = true;
+        }
+      if (reaped && d->pending == 0)
+        sema_up (&d->done);
+    }
+}
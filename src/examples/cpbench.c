@@ -0,0 +1,168 @@
+/* cpbench.c
+
+   Compares two ways of copying a file.  Writes a FILE_SIZE file,
+   then copies it once the way cp does, reading and writing
+   CP_BUF_SIZE bytes at a time through a user buffer, and once
+   with the copy_file_range() system call.  Prints the CPU cycles
+   taken by each copy, as counted by the processor's time-stamp
+   counter, checks that both copies match the original, and
+   removes all three files.
+
+   Needs at least 3 * FILE_SIZE bytes free in the file system,
+   e.g. "pintos-mkdisk --filesys-size=8". */
+
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+
+/* Size of the file copied, in bytes. */
+#define FILE_SIZE (2 * 1024 * 1024)
+
+/* Size of cp's buffer. */
+#define CP_BUF_SIZE 1024
+
+/* Size of the buffers used to write and check the files. */
+#define BUF_SIZE 4096
+
+static char buf[BUF_SIZE], check_buf[BUF_SIZE];
+
+/* Returns the processor's time-stamp counter. */
+static inline unsigned long long
+rdtsc (void)
+{
+  unsigned long long tsc;
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
+}
+
+/* Fills BUF with the data that belongs at offset OFS of the
+   original file. */
+static void
+fill (int ofs)
+{
+  int i;
+
+  for (i = 0; i < BUF_SIZE; i++)
+    buf[i] = (ofs + i) % 251;
+}
+
+/* Opens file NAME, exiting on failure. */
+static int
+open_file (const char *name)
+{
+  int fd = open (name);
+  if (fd < 0)
+    {
+      printf ("%s: open failed\n", name);
+      exit (EXIT_FAILURE);
+    }
+  return fd;
+}
+
+/* Creates file NAME with initial size SIZE, exiting on failure. */
+static void
+create_file (const char *name, unsigned size)
+{
+  if (!create (name, size))
+    {
+      printf ("%s: create failed\n", name);
+      exit (EXIT_FAILURE);
+    }
+}
+
+/* Copies "cpbench-src" to NAME, with a cp-style read/write loop
+   if USE_LOOP is true, otherwise with copy_file_range(), and
+   prints the cycles taken. */
+static void
+copy (const char *name, bool use_loop)
+{
+  unsigned long long start;
+  int in_fd, out_fd;
+  int bytes;
+
+  /* Like cp, create the copy at its final size, so that neither
+     method pays for allocation. */
+  create_file (name, FILE_SIZE);
+  in_fd = open_file ("cpbench-src");
+  out_fd = open_file (name);
+
+  start = rdtsc ();
+  if (use_loop)
+    {
+      static char cp_buf[CP_BUF_SIZE];
+
+      while ((bytes = read (in_fd, cp_buf, sizeof cp_buf)) > 0)
+        if (write (out_fd, cp_buf, bytes) != bytes)
+          {
+            printf ("%s: write failed\n", name);
+            exit (EXIT_FAILURE);
+          }
+    }
+  else
+    while ((bytes = copy_file_range (in_fd, out_fd, FILE_SIZE)) > 0)
+      continue;
+  printf ("%-16s %12llu cycles\n",
+          use_loop ? "read/write loop" : "copy_file_range",
+          rdtsc () - start);
+  if (bytes < 0)
+    {
+      printf ("%s: copy failed\n", name);
+      exit (EXIT_FAILURE);
+    }
+
+  close (in_fd);
+  close (out_fd);
+}
+
+/* Checks that file NAME matches the original, then removes it. */
+static void
+check (const char *name)
+{
+  int fd = open_file (name);
+  int ofs;
+
+  if (filesize (fd) != FILE_SIZE)
+    {
+      printf ("%s: size %d, expected %d\n", name, filesize (fd), FILE_SIZE);
+      exit (EXIT_FAILURE);
+    }
+  for (ofs = 0; ofs < FILE_SIZE; ofs += BUF_SIZE)
+    {
+      fill (ofs);
+      if (read (fd, check_buf, BUF_SIZE) != BUF_SIZE
+          || memcmp (buf, check_buf, BUF_SIZE))
+        {
+          printf ("%s: bad data near offset %d\n", name, ofs);
+          exit (EXIT_FAILURE);
+        }
+    }
+  close (fd);
+  remove (name);
+}
+
+int
+main (void)
+{
+  int fd;
+  int ofs;
+
+  create_file ("cpbench-src", 0);
+  fd = open_file ("cpbench-src");
+  for (ofs = 0; ofs < FILE_SIZE; ofs += BUF_SIZE)
+    {
+      fill (ofs);
+      if (write (fd, buf, BUF_SIZE) != BUF_SIZE)
+        {
+          printf ("cpbench-src: write failed\n");
+          return EXIT_FAILURE;
+        }
+    }
+  close (fd);
+
+  copy ("cpbench-loop", true);
+  copy ("cpbench-kernel", false);
+  check ("cpbench-loop");
+  check ("cpbench-kernel");
+  remove ("cpbench-src");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,74 @@
+/* iostat.c
+
+   Prints I/O statistics for each block device, including the
+   partitions of each disk, as returned by the block_stats()
+   system call. */
+
+#include <stdio.h>
+#include <syscall.h>
+
+static void print_hist (const char *name, const char *what,
+                        const unsigned long long hist[BLOCK_HIST_CNT]);
+
+int
+main (void)
+{
+  struct block_stats s;
+  int i;
+
+  for (i = 0; block_stats (i, &s); i++)
+    {
+      unsigned long long n = s.request_cnt;
+
+      printf ("%s%s (%s): %u sectors, %llu requests, "
+              "%llu bytes read, %llu bytes written\n",
+              s.partition ? "  " : "", s.name, s.type, s.size, n,
+              s.read_bytes, s.write_bytes);
+      if (n == 0)
+        continue;
+      printf ("  %llu transfers, %llu%% sequential, "
+              "%llu sectors average seek\n",
+              s.transfer_cnt,
+              s.transfer_cnt > 0 ? s.seq_cnt * 100 / s.transfer_cnt : 0,
+              s.transfer_cnt > 0 ? s.seek_distance / s.transfer_cnt : 0);
+      printf ("  %u in flight, %u max, %llu.%llu average depth\n",
+              s.in_flight, s.in_flight_max,
+              s.depth_total / n, s.depth_total * 10 / n % 10);
+      printf ("  %llu us average wait, %llu us average service\n",
+              s.wait_usecs / n, s.service_usecs / n);
+      print_hist (s.name, "wait", s.wait_hist);
+      print_hist (s.name, "service", s.service_hist);
+    }
+  return EXIT_SUCCESS;
+}
+
+/* Prints histogram HIST, labeled with device NAME and WHAT it
+   measures, one line per nonzero bucket with a bar of stars. */
+static void
+print_hist (const char *name, const char *what,
+            const unsigned long long hist[BLOCK_HIST_CNT])
+{
+  unsigned long long max = 0;
+  int i;
+
+  for (i = 0; i < BLOCK_HIST_CNT; i++)
+    if (hist[i] > max)
+      max = hist[i];
+  if (max == 0)
+    return;
+
+  printf ("  %s %s times:\n", name, what);
+  for (i = 0; i < BLOCK_HIST_CNT; i++)
+    if (hist[i] != 0)
+      {
+        int stars = hist[i] * 40 / max;
+
+        if (i == BLOCK_HIST_CNT - 1)
+          printf ("    >= %7lu us %8llu ", 1ul << i, hist[i]);
+        else
+          printf ("    <  %7lu us %8llu ", 2ul << i, hist[i]);
+        while (stars-- > 0)
+          putchar ('*');
+        putchar ('\n');
+      }
+}
@@ -0,0 +1,627 @@
+#include "filesys/cache.h"
+#include <debug.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "filesys/filesys.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Sector cache.
+
+   Keeps up to CACHE_SIZE sectors of the file system device in
+   memory.  Reads are satisfied from the cache when possible, and
+   writes only modify the cached copy and mark it dirty; dirty
+   sectors go back to disk when they are evicted or when
+   cache_flush() is called.
+
+   Replacement uses the clock algorithm: each entry has an
+   `accessed' bit that is set on every use and cleared as the
+   clock hand sweeps past, and the hand stops at the first entry
+   that has not been used since its last visit.
+
+   Locking.  cache_lock protects the mapping from sectors to
+   entries, the clock hand, each entry's pin count, and the
+   statistics.  It is never held across I/O.  Each entry's own
+   lock protects its data and its dirty bit, so threads working
+   on different sectors, including threads waiting for a disk
+   read, do not block one another.  An entry is "pinned" while
+   any thread is using or waiting for it, and pinned entries are
+   never evicted.  Since only pinned entries' locks are ever
+   held or waited on, an unpinned entry's lock is always free.
+
+   Read-ahead.  cache_read_ahead() queues a sector to be brought
+   into the cache by a background thread, so that a reader
+   working through a file sequentially finds the next sectors
+   already cached instead of waiting for each one in turn.  The
+   queue is bounded and requests that do not fit are dropped,
+   since read-ahead is only a hint.  Queued requests for
+   consecutive sectors are read from disk in a single request.
+
+   Flushing.  A flusher thread writes dirty sectors back every
+   FLUSH_INTERVAL ticks, and sooner once DIRTY_LIMIT entries are
+   dirty, so that dirty data does not linger in memory until
+   eviction or shutdown.  cache_flush() writes
+   sectors in ascending order, in runs of adjacent sectors, so
+   that the disk sees a single sweep, and writes each run with a
+   single request.
+
+   Holding.  The journal (see journal.c) "holds" each metadata
+   sector changed by a transaction that has not yet committed.
+   A held sector is neither evicted nor written back until the
+   journal releases it, so its uncommitted contents reach the
+   disk only by way of the log. */
+
+/* Number of cached sectors. */
+#define CACHE_SIZE 64
+
+/* A cached sector. */
+struct cache_entry
+  {
+    block_sector_t sector;      /* Sector held, if in_use. */
+    bool in_use;                /* Holds a sector? */
+    bool accessed;              /* Used since the clock hand passed? */
+    int pin_cnt;                /* Threads using or waiting for entry. */
+    bool held;                  /* Held by the journal?  Also protected
+                                   by lock: either suffices to read. */
+
+    struct lock lock;           /* Protects data, dirty. */
+    bool dirty;                 /* Differs from the disk? */
+    uint8_t data[BLOCK_SECTOR_SIZE];    /* Sector contents. */
+  };
+
+static struct cache_entry entries[CACHE_SIZE];
+static struct lock cache_lock;
+static struct condition cache_unpinned;  /* Signaled when pin_cnt drops. */
+static size_t clock_hand;
+
+/* Read-ahead queue, a circular buffer protected by cache_lock. */
+#define READ_AHEAD_QUEUE_SIZE 32
+static block_sector_t read_ahead_queue[READ_AHEAD_QUEUE_SIZE];
+static size_t read_ahead_head;          /* Index of oldest request. */
+static size_t read_ahead_cnt;           /* Number of queued requests. */
+static struct condition read_ahead_ready;  /* Signaled on new request. */
+#define READ_RUN_MAX 8                  /* Most sectors read at once. */
+static uint8_t read_run_buffer[READ_RUN_MAX * BLOCK_SECTOR_SIZE];
+
+static thread_func read_ahead_daemon NO_RETURN;
+
+/* Flushing. */
+#define FLUSH_INTERVAL (5 * TIMER_FREQ) /* Ticks between flushes. */
+#define DIRTY_LIMIT (CACHE_SIZE / 2)    /* Dirty entries that force one. */
+#define FLUSH_RUN_MAX 16                /* Most sectors written at once. */
+static size_t dirty_cnt;                /* Dirty entries, by cache_lock. */
+static struct semaphore flush_wanted;   /* Up'd to request a flush. */
+static struct lock flush_lock;          /* Serializes cache_flush(). */
+static uint8_t run_buffer[FLUSH_RUN_MAX * BLOCK_SECTOR_SIZE];
+
+static thread_func flush_daemon NO_RETURN;
+static thread_func flush_timer NO_RETURN;
+
+/* Statistics. */
+static unsigned long long hit_cnt;      /* Accesses found in the cache. */
+static unsigned long long miss_cnt;     /* Sectors read or allocated,
+                                           including read-ahead. */
+static unsigned long long writeback_cnt;  /* Dirty sectors written back. */
+static unsigned long long prefetch_cnt; /* Sectors read ahead. */
+static unsigned long long flush_cnt;    /* Calls to cache_flush(). */
+static unsigned long long flush_sector_cnt;  /* Sectors written by them. */
+static unsigned long long flush_run_cnt;     /* Runs they wrote. */
+static int64_t flush_ticks;             /* Total time they took. */
+static int64_t flush_max_ticks;         /* Longest one. */
+
+/* Initializes the sector cache. */
+void
+cache_init (void)
+{
+  size_t i;
+
+  lock_init (&cache_lock);
+  cond_init (&cache_unpinned);
+  cond_init (&read_ahead_ready);
+  sema_init (&flush_wanted, 0);
+  lock_init (&flush_lock);
+  for (i = 0; i < CACHE_SIZE; i++)
+    {
+      struct cache_entry *e = &entries[i];
+      e->in_use = false;
+      e->accessed = false;
+      e->pin_cnt = 0;
+      e->held = false;
+      e->dirty = false;
+      lock_init (&e->lock);
+    }
+
+  thread_create ("read-ahead", PRI_DEFAULT, read_ahead_daemon, NULL);
+  thread_create ("flusher", PRI_DEFAULT, flush_daemon, NULL);
+  thread_create ("flush-timer", PRI_DEFAULT, flush_timer, NULL);
+}
+
+/* Returns the entry holding SECTOR, or a null pointer if SECTOR
+   is not cached.  The caller must hold cache_lock. */
+static struct cache_entry *
+lookup (block_sector_t sector)
+{
+  size_t i;
+
+  for (i = 0; i < CACHE_SIZE; i++)
+    if (entries[i].in_use && entries[i].sector == sector)
+      return &entries[i];
+  return NULL;
+}
+
+/* Returns an unpinned, unheld entry to reuse, chosen by the
+   clock algorithm, or a null pointer if every entry is pinned or
+   held.  The caller must hold cache_lock. */
+static struct cache_entry *
+choose_victim (void)
+{
+  size_t i;
+
+  /* Two sweeps suffice: the first clears every accessed bit it
+     does not stop at. */
+  for (i = 0; i < 2 * CACHE_SIZE; i++)
+    {
+      struct cache_entry *e = &entries[clock_hand];
+      clock_hand = (clock_hand + 1) % CACHE_SIZE;
+
+      if (e->pin_cnt > 0 || e->held)
+        continue;
+      if (!e->in_use)
+        return e;
+      if (e->accessed)
+        e->accessed = false;
+      else
+        return e;
+    }
+  return NULL;
+}
+
+/* Writes E back to disk if it is dirty.  The caller must hold
+   E's lock. */
+static void
+write_back (struct cache_entry *e)
+{
+  ASSERT (lock_held_by_current_thread (&e->lock));
+
+  if (e->dirty)
+    {
+      block_write (fs_device, e->sector, e->data);
+      e->dirty = false;
+
+      lock_acquire (&cache_lock);
+      dirty_cnt--;
+      writeback_cnt++;
+      lock_release (&cache_lock);
+    }
+}
+
+/* Marks E dirty, asking for a flush if too much of the cache is
+   dirty.  The caller must hold E's lock. */
+static void
+mark_dirty (struct cache_entry *e)
+{
+  ASSERT (lock_held_by_current_thread (&e->lock));
+
+  if (!e->dirty)
+    {
+      e->dirty = true;
+
+      lock_acquire (&cache_lock);
+      if (++dirty_cnt == DIRTY_LIMIT)
+        sema_up (&flush_wanted);
+      lock_release (&cache_lock);
+    }
+}
+
+/* Drops the caller's pin on E.  The caller must hold
+   cache_lock. */
+static void
+unpin (struct cache_entry *e)
+{
+  ASSERT (e->pin_cnt > 0);
+  if (--e->pin_cnt == 0)
+    cond_signal (&cache_unpinned, &cache_lock);
+}
+
+/* Returns the entry for SECTOR, pinned and locked by the caller.
+   If SECTOR was already cached, sets *HIT to true.  Otherwise,
+   sets *HIT to false and returns a fresh entry for SECTOR whose
+   data the caller must fill in before unlocking it. */
+static struct cache_entry *
+get_entry (block_sector_t sector, bool *hit)
+{
+  struct cache_entry *e;
+
+  lock_acquire (&cache_lock);
+  for (;;)
+    {
+      e = lookup (sector);
+      if (e != NULL)
+        {
+          e->pin_cnt++;
+          e->accessed = true;
+          hit_cnt++;
+          lock_release (&cache_lock);
+          lock_acquire (&e->lock);
+          *hit = true;
+          return e;
+        }
+
+      e = choose_victim ();
+      if (e == NULL)
+        {
+          cond_wait (&cache_unpinned, &cache_lock);
+          continue;
+        }
+
+      if (e->dirty)
+        {
+          /* Write the victim back before reusing it, leaving it
+             mapped meanwhile so that nobody reads its sector's
+             stale contents from disk, then start over. */
+          e->pin_cnt++;
+          lock_release (&cache_lock);
+          lock_acquire (&e->lock);
+          write_back (e);
+          lock_release (&e->lock);
+          lock_acquire (&cache_lock);
+          unpin (e);
+          continue;
+        }
+
+      break;
+    }
+
+  /* E is unpinned and clean, so its lock is free.  Taking the
+     lock before releasing cache_lock makes anyone else who finds
+     SECTOR wait until its data is loaded. */
+  e->sector = sector;
+  e->in_use = true;
+  e->accessed = true;
+  e->pin_cnt = 1;
+  miss_cnt++;
+  lock_acquire (&e->lock);
+  lock_release (&cache_lock);
+  *hit = false;
+  return e;
+}
+
+/* Returns the entry for SECTOR, pinned and locked by the caller,
+   bringing SECTOR into the cache if necessary.  If LOAD is
+   false, the caller promises to overwrite the whole sector, so a
+   sector not already cached is not read from disk. */
+static struct cache_entry *
+cache_get (block_sector_t sector, bool load)
+{
+  bool hit;
+  struct cache_entry *e = get_entry (sector, &hit);
+
+  if (!hit && load)
+    block_read (fs_device, sector, e->data);
+  return e;
+}
+
+/* Unlocks and unpins E, which the caller obtained from
+   cache_get(). */
+static void
+cache_put (struct cache_entry *e)
+{
+  lock_release (&e->lock);
+  lock_acquire (&cache_lock);
+  unpin (e);
+  lock_release (&cache_lock);
+}
+
+/* Reads SIZE bytes starting at byte offset OFS within SECTOR
+   into BUFFER. */
+void
+cache_read (block_sector_t sector, void *buffer, size_t ofs, size_t size)
+{
+  struct cache_entry *e;
+
+  ASSERT (ofs <= BLOCK_SECTOR_SIZE && size <= BLOCK_SECTOR_SIZE - ofs);
+
+  e = cache_get (sector, true);
+  memcpy (buffer, e->data + ofs, size);
+  cache_put (e);
+}
+
+/* Writes SIZE bytes from BUFFER into SECTOR, starting at byte
+   offset OFS within the sector.  The data reaches the disk when
+   the sector is evicted or flushed. */
+void
+cache_write (block_sector_t sector, const void *buffer,
+             size_t ofs, size_t size)
+{
+  struct cache_entry *e;
+
+  ASSERT (ofs <= BLOCK_SECTOR_SIZE && size <= BLOCK_SECTOR_SIZE - ofs);
+
+  e = cache_get (sector, size < BLOCK_SECTOR_SIZE);
+  memcpy (e->data + ofs, buffer, size);
+  mark_dirty (e);
+  cache_put (e);
+}
+
+/* Fills SECTOR with zeros. */
+void
+cache_zero (block_sector_t sector)
+{
+  struct cache_entry *e = cache_get (sector, false);
+  memset (e->data, 0, BLOCK_SECTOR_SIZE);
+  mark_dirty (e);
+  cache_put (e);
+}
+
+/* Sets whether SECTOR is held.  See the comment at the top of
+   the file. */
+static void
+set_held (block_sector_t sector, bool held)
+{
+  struct cache_entry *e = cache_get (sector, true);
+
+  lock_acquire (&cache_lock);
+  ASSERT (e->held != held);
+  e->held = held;
+  lock_release (&cache_lock);
+  cache_put (e);
+}
+
+/* Holds SECTOR in the cache, reading it in if necessary, until
+   cache_release() is called for it.  Until then, SECTOR is not
+   written back to disk. */
+void
+cache_hold (block_sector_t sector)
+{
+  set_held (sector, true);
+}
+
+/* Releases SECTOR, which was held with cache_hold(), to be
+   written back like any other sector. */
+void
+cache_release (block_sector_t sector)
+{
+  set_held (sector, false);
+}
+
+/* Asks for SECTOR to be read into the cache in the background,
+   without waiting for it. */
+void
+cache_read_ahead (block_sector_t sector)
+{
+  lock_acquire (&cache_lock);
+  if (read_ahead_cnt < READ_AHEAD_QUEUE_SIZE)
+    {
+      size_t tail = (read_ahead_head + read_ahead_cnt) % READ_AHEAD_QUEUE_SIZE;
+      read_ahead_queue[tail] = sector;
+      read_ahead_cnt++;
+      cond_signal (&read_ahead_ready, &cache_lock);
+    }
+  lock_release (&cache_lock);
+}
+
+/* Reads the CNT fresh entries in RUN, which are for consecutive
+   sectors, from disk together, then unlocks and unpins them.
+   Only the read-ahead thread calls this. */
+static void
+read_run (struct cache_entry **run, size_t cnt)
+{
+  size_t i;
+
+  ASSERT (cnt <= READ_RUN_MAX);
+
+  if (cnt == 0)
+    return;
+  block_read_multi (fs_device, run[0]->sector, cnt, read_run_buffer);
+  for (i = 0; i < cnt; i++)
+    {
+      memcpy (run[i]->data, read_run_buffer + i * BLOCK_SECTOR_SIZE,
+              BLOCK_SECTOR_SIZE);
+      cache_put (run[i]);
+    }
+}
+
+/* Read-ahead thread.  Brings each queued sector that is not
+   already cached into the cache, reading runs of consecutive
+   sectors together. */
+static void
+read_ahead_daemon (void *aux UNUSED)
+{
+  for (;;)
+    {
+      block_sector_t sectors[READ_RUN_MAX];
+      struct cache_entry *run[READ_RUN_MAX];
+      size_t cnt = 0;
+      size_t run_cnt = 0;
+      size_t i;
+
+      /* Take the oldest request for a sector not yet cached,
+         along with the requests right behind it for the sectors
+         that follow it. */
+      lock_acquire (&cache_lock);
+      while (read_ahead_cnt == 0)
+        cond_wait (&read_ahead_ready, &cache_lock);
+      while (read_ahead_cnt > 0 && cnt < READ_RUN_MAX)
+        {
+          block_sector_t sector = read_ahead_queue[read_ahead_head];
+
+          if (cnt > 0 && sector != sectors[cnt - 1] + 1)
+            break;
+          read_ahead_head = (read_ahead_head + 1) % READ_AHEAD_QUEUE_SIZE;
+          read_ahead_cnt--;
+          if (lookup (sector) == NULL)
+            sectors[cnt++] = sector;
+          else if (cnt > 0)
+            break;
+        }
+      prefetch_cnt += cnt;
+      lock_release (&cache_lock);
+
+      /* A sector cached since we looked splits the run. */
+      for (i = 0; i < cnt; i++)
+        {
+          bool hit;
+          struct cache_entry *e = get_entry (sectors[i], &hit);
+
+          if (hit)
+            {
+              cache_put (e);
+              read_run (run, run_cnt);
+              run_cnt = 0;
+            }
+          else
+            run[run_cnt++] = e;
+        }
+      read_run (run, run_cnt);
+    }
+}
+
+/* Writes the CNT pinned entries in RUN, which hold consecutive
+   sectors, to disk together.  The caller must hold flush_lock. */
+static void
+write_run (struct cache_entry **run, size_t cnt)
+{
+  bool skip[FLUSH_RUN_MAX];
+  size_t cleaned = 0;
+  size_t written = 0, runs = 0;
+  size_t i, j;
+
+  ASSERT (cnt <= FLUSH_RUN_MAX);
+
+  /* Copying the data out and marking it clean before writing is
+     safe: the entries are pinned, so they cannot be evicted and
+     reread from disk before the write completes, and any change
+     made meanwhile marks them dirty again.  An entry held since
+     cache_flush() chose it is skipped: it may already contain
+     uncommitted changes. */
+  for (i = 0; i < cnt; i++)
+    {
+      struct cache_entry *e = run[i];
+
+      lock_acquire (&e->lock);
+      skip[i] = e->held;
+      if (!skip[i])
+        {
+          memcpy (run_buffer + i * BLOCK_SECTOR_SIZE, e->data,
+                  BLOCK_SECTOR_SIZE);
+          if (e->dirty)
+            {
+              e->dirty = false;
+              cleaned++;
+            }
+        }
+      lock_release (&e->lock);
+    }
+
+  /* Write each stretch of entries not skipped with one request. */
+  for (i = 0; i < cnt; i = j)
+    {
+      if (skip[i])
+        {
+          j = i + 1;
+          continue;
+        }
+      for (j = i + 1; j < cnt && !skip[j]; j++)
+        continue;
+      block_write_multi (fs_device, run[0]->sector + i, j - i,
+                         run_buffer + i * BLOCK_SECTOR_SIZE);
+      written += j - i;
+      runs++;
+    }
+
+  lock_acquire (&cache_lock);
+  dirty_cnt -= cleaned;
+  flush_sector_cnt += written;
+  flush_run_cnt += runs;
+  lock_release (&cache_lock);
+}
+
+/* Writes every dirty sector in the cache back to disk, in
+   ascending sector order. */
+void
+cache_flush (void)
+{
+  struct cache_entry *dirty[CACHE_SIZE];
+  size_t cnt = 0;
+  size_t i, j;
+  int64_t start, elapsed;
+
+  lock_acquire (&flush_lock);
+  start = timer_ticks ();
+
+  /* Pin the dirty entries, sorted by sector.  An entry being
+     modified right now may not be marked dirty yet; it will be
+     caught next time. */
+  lock_acquire (&cache_lock);
+  for (i = 0; i < CACHE_SIZE; i++)
+    {
+      struct cache_entry *e = &entries[i];
+
+      if (!e->in_use || !e->dirty || e->held)
+        continue;
+      e->pin_cnt++;
+      for (j = cnt++; j > 0 && dirty[j - 1]->sector > e->sector; j--)
+        dirty[j] = dirty[j - 1];
+      dirty[j] = e;
+    }
+  lock_release (&cache_lock);
+
+  /* Write them in runs of consecutive sectors. */
+  for (i = 0; i < cnt; i = j)
+    {
+      for (j = i + 1; j < cnt && j - i < FLUSH_RUN_MAX; j++)
+        if (dirty[j]->sector != dirty[j - 1]->sector + 1)
+          break;
+      write_run (dirty + i, j - i);
+    }
+
+  elapsed = timer_elapsed (start);
+  lock_acquire (&cache_lock);
+  for (i = 0; i < cnt; i++)
+    unpin (dirty[i]);
+  flush_cnt++;
+  flush_ticks += elapsed;
+  if (elapsed > flush_max_ticks)
+    flush_max_ticks = elapsed;
+  lock_release (&cache_lock);
+
+  lock_release (&flush_lock);
+}
+
+/* Flusher thread.  Flushes the cache whenever asked. */
+static void
+flush_daemon (void *aux UNUSED)
+{
+  for (;;)
+    {
+      sema_down (&flush_wanted);
+      cache_flush ();
+    }
+}
+
+/* Asks for a flush every FLUSH_INTERVAL ticks. */
+static void
+flush_timer (void *aux UNUSED)
+{
+  for (;;)
+    {
+      timer_sleep (FLUSH_INTERVAL);
+      sema_up (&flush_wanted);
+    }
+}
+
+/* Prints sector cache statistics. */
+void
+cache_print_stats (void)
+{
+  printf ("Cache: %llu hits, %llu misses, %llu read ahead, "
+          "%llu write-backs\n",
+          hit_cnt, miss_cnt, prefetch_cnt, writeback_cnt);
+  printf ("Cache: %zu dirty, %llu flushes wrote %llu sectors in %llu runs, "
+          "%lld ticks max, %lld ticks avg\n",
+          dirty_cnt, flush_cnt, flush_sector_cnt, flush_run_cnt,
+          flush_max_ticks,
+          flush_cnt > 0 ? flush_ticks / (int64_t) flush_cnt : 0);
+}
@@ -0,0 +1,17 @@
+#ifndef FILESYS_CACHE_H
+#define FILESYS_CACHE_H
+
+#include <stddef.h>
+#include "devices/block.h"
+
+void cache_init (void);
+void cache_read (block_sector_t, void *, size_t ofs, size_t size);
+void cache_write (block_sector_t, const void *, size_t ofs, size_t size);
+void cache_zero (block_sector_t);
+void cache_read_ahead (block_sector_t);
+void cache_hold (block_sector_t);
+void cache_release (block_sector_t);
+void cache_flush (void);
+void cache_print_stats (void);
+
+#endif /* filesys/cache.h */
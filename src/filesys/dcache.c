@@ -0,0 +1,222 @@
+#include "filesys/dcache.h"
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/directory.h"
+#include "threads/synch.h"
+
+/* Path component cache.
+
+   Resolving a path such as "/a/b/c" looks up each component in
+   turn in the directory named by the components before it, which
+   means opening each directory and searching its entries.  This
+   cache remembers the result of each such lookup, keyed by the
+   inode sector of the directory searched and the name looked up:
+   the inode sector that the name refers to and whether it is a
+   directory, or that no entry by that name exists (a "negative"
+   entry).  Walking a path whose components are all cached reads
+   no directory data at all.
+
+   The directory code keeps the cache correct: adding an entry
+   invalidates any negative entry for its name, removing an entry
+   replaces it by a negative entry, and removing or creating a
+   directory drops everything cached about its contents. */
+
+/* Number of cached lookups. */
+#define DCACHE_SIZE 256
+
+/* A cached lookup. */
+struct dentry
+  {
+    struct hash_elem hash_elem;         /* Element in dentries. */
+    struct list_elem lru_elem;          /* Element in lru_list. */
+    block_sector_t dir;                 /* Directory's inode sector. */
+    char name[NAME_MAX + 1];            /* Name looked up in DIR. */
+    block_sector_t sector;              /* Inode sector, 0 if none. */
+    bool is_dir;                        /* Is SECTOR a directory? */
+  };
+
+/* Sector 0 holds the free map's inode, which is never a
+   directory, so a `dir' of 0 marks an unused dentry and a
+   `sector' of 0 a negative one. */
+
+static struct dentry dentry_pool[DCACHE_SIZE];
+
+/* Cached lookups, by directory and name. */
+static struct hash dentries;
+
+/* All dentries, most recently used first.  Unused dentries are
+   kept at the back. */
+static struct list lru_list;
+
+/* Protects all of the above and the statistics. */
+static struct lock dcache_lock;
+
+/* Statistics. */
+static long long hit_cnt;               /* Positive entries found. */
+static long long negative_cnt;          /* Negative entries found. */
+static long long miss_cnt;              /* Lookups not cached. */
+
+/* Returns a hash value for dentry E. */
+static unsigned
+dentry_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct dentry *d = hash_entry (e, struct dentry, hash_elem);
+  return hash_string (d->name) ^ hash_int (d->dir);
+}
+
+/* Returns true if dentry A precedes dentry B. */
+static bool
+dentry_less (const struct hash_elem *a_, const struct hash_elem *b_,
+             void *aux UNUSED)
+{
+  const struct dentry *a = hash_entry (a_, struct dentry, hash_elem);
+  const struct dentry *b = hash_entry (b_, struct dentry, hash_elem);
+
+  if (a->dir != b->dir)
+    return a->dir < b->dir;
+  return strcmp (a->name, b->name) < 0;
+}
+
+/* Initializes the path component cache. */
+void
+dcache_init (void)
+{
+  size_t i;
+
+  if (!hash_init (&dentries, dentry_hash, dentry_less, NULL))
+    PANIC ("can't allocate dentry cache");
+  list_init (&lru_list);
+  for (i = 0; i < DCACHE_SIZE; i++)
+    list_push_back (&lru_list, &dentry_pool[i].lru_elem);
+  lock_init (&dcache_lock);
+}
+
+/* Returns the dentry for NAME in directory DIR, or a null
+   pointer if there is none.  The caller must hold
+   dcache_lock. */
+static struct dentry *
+find (block_sector_t dir, const char *name)
+{
+  struct dentry key;
+  struct hash_elem *e;
+
+  if (strlen (name) > NAME_MAX)
+    return NULL;
+  key.dir = dir;
+  strlcpy (key.name, name, sizeof key.name);
+  e = hash_find (&dentries, &key.hash_elem);
+  return e != NULL ? hash_entry (e, struct dentry, hash_elem) : NULL;
+}
+
+/* Drops dentry D from the cache.  The caller must hold
+   dcache_lock. */
+static void
+discard (struct dentry *d)
+{
+  hash_delete (&dentries, &d->hash_elem);
+  d->dir = 0;
+  list_remove (&d->lru_elem);
+  list_push_back (&lru_list, &d->lru_elem);
+}
+
+/* Looks up NAME in the directory whose inode is in sector DIR.
+   If the result is cached, returns true and sets *SECTOR to the
+   inode sector that NAME refers to, or to 0 if DIR has no entry
+   named NAME, and *IS_DIR to true if that inode is a directory.
+   Returns false if nothing is known about NAME. */
+bool
+dcache_lookup (block_sector_t dir, const char *name,
+               block_sector_t *sector, bool *is_dir)
+{
+  struct dentry *d;
+
+  lock_acquire (&dcache_lock);
+  d = find (dir, name);
+  if (d != NULL)
+    {
+      list_remove (&d->lru_elem);
+      list_push_front (&lru_list, &d->lru_elem);
+      *sector = d->sector;
+      *is_dir = d->is_dir;
+      if (d->sector != 0)
+        hit_cnt++;
+      else
+        negative_cnt++;
+    }
+  else
+    miss_cnt++;
+  lock_release (&dcache_lock);
+
+  return d != NULL;
+}
+
+/* Records that NAME in the directory whose inode is in sector
+   DIR refers to the inode in SECTOR, which is a directory if
+   IS_DIR is true, or, if SECTOR is 0, that DIR has no entry
+   named NAME. */
+void
+dcache_insert (block_sector_t dir, const char *name,
+               block_sector_t sector, bool is_dir)
+{
+  struct dentry *d;
+
+  if (strlen (name) > NAME_MAX)
+    return;
+
+  lock_acquire (&dcache_lock);
+  d = find (dir, name);
+  if (d == NULL)
+    {
+      /* Reuse the least recently used dentry. */
+      d = list_entry (list_back (&lru_list), struct dentry, lru_elem);
+      if (d->dir != 0)
+        hash_delete (&dentries, &d->hash_elem);
+      d->dir = dir;
+      strlcpy (d->name, name, sizeof d->name);
+      hash_insert (&dentries, &d->hash_elem);
+    }
+  d->sector = sector;
+  d->is_dir = is_dir;
+  list_remove (&d->lru_elem);
+  list_push_front (&lru_list, &d->lru_elem);
+  lock_release (&dcache_lock);
+}
+
+/* Forgets anything cached about NAME in the directory whose
+   inode is in sector DIR. */
+void
+dcache_invalidate (block_sector_t dir, const char *name)
+{
+  struct dentry *d;
+
+  lock_acquire (&dcache_lock);
+  d = find (dir, name);
+  if (d != NULL)
+    discard (d);
+  lock_release (&dcache_lock);
+}
+
+/* Forgets everything cached about the contents of the directory
+   whose inode is in sector DIR. */
+void
+dcache_invalidate_dir (block_sector_t dir)
+{
+  size_t i;
+
+  lock_acquire (&dcache_lock);
+  for (i = 0; i < DCACHE_SIZE; i++)
+    if (dentry_pool[i].dir == dir)
+      discard (&dentry_pool[i]);
+  lock_release (&dcache_lock);
+}
+
+/* Prints path component cache statistics. */
+void
+dcache_print_stats (void)
+{
+  printf ("Dentry cache: %lld hits, %lld negative hits, %lld misses\n",
+          hit_cnt, negative_cnt, miss_cnt);
+}
@@ -2,6 +2,8 @@
 #include <stdio.h>
 #include <string.h>
 #include <list.h>
+#include <hash.h>
+#include "filesys/dcache.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
 #include "threads/malloc.h"
@@ -21,21 +23,181 @@ struct dir_entry
     bool in_use;                        /* In use or free? */
   };
 
+/* In-memory index of a directory's entries.
+
+   Looking a name up in the directory file itself means reading
+   and comparing every entry in turn, which is slow in a large
+   directory, and adding an entry needs a second scan to find a
+   free slot.  So the first time a directory is searched or
+   modified, its entries are read once into a hash table keyed by
+   name, along with a list of its free slots, and the index is
+   kept with the directory's in-memory inode until the inode is
+   freed.  dir_add() and dir_remove() keep the index in step with
+   the directory file.  If memory for the index runs out, the
+   index is discarded and the directory is scanned as before.
+
+   Operations that search or change a directory's entries, and
+   its index, hold the directory inode's lock, taken with
+   inode_lock_dir(), so that two threads cannot add the same
+   name or claim the same free slot.  Operations on different
+   directories proceed in parallel. */
+struct dir_index
+  {
+    struct hash names;          /* In-use entries, by name. */
+    struct list free_slots;     /* Free entries. */
+    off_t end;                  /* Offset just past the last entry. */
+  };
+
+/* A directory entry in a dir_index, either in use, in `names',
+   or free, in `free_slots'. */
+struct index_entry
+  {
+    struct hash_elem hash_elem;         /* Element in `names'. */
+    struct list_elem list_elem;         /* Element in `free_slots'. */
+    off_t ofs;                          /* Offset in directory file. */
+    block_sector_t inode_sector;        /* Sector number of header. */
+    char name[NAME_MAX + 1];            /* Null terminated file name. */
+  };
+
+/* Returns a hash value for index entry E. */
+static unsigned
+index_entry_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  return hash_string (hash_entry (e, struct index_entry, hash_elem)->name);
+}
+
+/* Returns true if index entry A's name precedes B's. */
+static bool
+index_entry_less (const struct hash_elem *a, const struct hash_elem *b,
+                  void *aux UNUSED)
+{
+  return strcmp (hash_entry (a, struct index_entry, hash_elem)->name,
+                 hash_entry (b, struct index_entry, hash_elem)->name) < 0;
+}
+
+/* Frees index entry E, a hash table element. */
+static void
+index_entry_free (struct hash_elem *e, void *aux UNUSED)
+{
+  free (hash_entry (e, struct index_entry, hash_elem));
+}
+
+/* Frees INDEX, which may be null. */
+void
+dir_index_destroy (struct dir_index *index)
+{
+  if (index != NULL)
+    {
+      hash_destroy (&index->names, index_entry_free);
+      while (!list_empty (&index->free_slots))
+        free (list_entry (list_pop_front (&index->free_slots),
+                          struct index_entry, list_elem));
+      free (index);
+    }
+}
+
+/* Returns DIR's index, building it first if necessary, or a null
+   pointer if memory runs out.  The caller must hold DIR's
+   lock. */
+static struct dir_index *
+get_index (const struct dir *dir)
+{
+  struct dir_index *index = inode_get_dir_index (dir->inode);
+  struct dir_entry e;
+  off_t ofs;
+
+  if (index != NULL)
+    return index;
+
+  index = malloc (sizeof *index);
+  if (index == NULL)
+    return NULL;
+  if (!hash_init (&index->names, index_entry_hash, index_entry_less, NULL))
+    {
+      free (index);
+      return NULL;
+    }
+  list_init (&index->free_slots);
+
+  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+       ofs += sizeof e)
+    {
+      struct index_entry *ie = malloc (sizeof *ie);
+      if (ie == NULL)
+        {
+          dir_index_destroy (index);
+          return NULL;
+        }
+      ie->ofs = ofs;
+      if (e.in_use)
+        {
+          ie->inode_sector = e.inode_sector;
+          strlcpy (ie->name, e.name, sizeof ie->name);
+          hash_insert (&index->names, &ie->hash_elem);
+        }
+      else
+        list_push_back (&index->free_slots, &ie->list_elem);
+    }
+  index->end = ofs;
+
+  inode_set_dir_index (dir->inode, index);
+  return index;
+}
+
+/* Discards DIR's index, after a failure to keep it up to date. */
+static void
+drop_index (const struct dir *dir)
+{
+  dir_index_destroy (inode_get_dir_index (dir->inode));
+  inode_set_dir_index (dir->inode, NULL);
+}
+
 /* Creates a directory with space for ENTRY_CNT entries in the
-   given SECTOR.  Returns true if successful, false on failure. */
+   given SECTOR, as a subdirectory of the directory whose inode
+   is in sector PARENT.  The new directory's first two entries
+   are "." and "..", which refer to the directory itself and to
+   PARENT.  Returns true if successful, false on failure. */
 bool
-dir_create (block_sector_t sector, size_t entry_cnt)
+dir_create (block_sector_t sector, size_t entry_cnt, block_sector_t parent)
 {
-  return inode_create (sector, entry_cnt * sizeof (struct dir_entry));
+  struct dir_entry e[2];
+  struct inode *inode;
+  bool success;
+
+  if (entry_cnt < 2)
+    entry_cnt = 2;
+  if (!inode_create (sector, entry_cnt * sizeof (struct dir_entry), true))
+    return false;
+
+  /* SECTOR may have held a directory that has since been
+     removed. */
+  dcache_invalidate_dir (sector);
+
+  /* inode_create() has already allocated the space for these
+     entries, so writing them cannot run out of disk. */
+  memset (e, 0, sizeof e);
+  e[0].inode_sector = sector;
+  strlcpy (e[0].name, ".", sizeof e[0].name);
+  e[0].in_use = true;
+  e[1].inode_sector = parent;
+  strlcpy (e[1].name, "..", sizeof e[1].name);
+  e[1].in_use = true;
+
+  inode = inode_open (sector);
+  success = (inode != NULL
+             && inode_write_at (inode, e, sizeof e, 0) == sizeof e);
+  inode_close (inode);
+  return success;
 }
 
 /* Opens and returns the directory for the given INODE, of which
-   it takes ownership.  Returns a null pointer on failure. */
+   it takes ownership.  Returns a null pointer on failure,
+   including if INODE is not a directory. */
 struct dir *
 dir_open (struct inode *inode) 
 {
   struct dir *dir = calloc (1, sizeof *dir);
-  if (inode != NULL && dir != NULL)
+  if (inode != NULL && dir != NULL && inode_is_dir (inode))
     {
       dir->inode = inode;
       dir->pos = 0;
@@ -87,17 +249,45 @@ dir_get_inode (struct dir *dir)
    If successful, returns true, sets *EP to the directory entry
    if EP is non-null, and sets *OFSP to the byte offset of the
    directory entry if OFSP is non-null.
-   otherwise, returns false and ignores EP and OFSP. */
+   otherwise, returns false and ignores EP and OFSP.
+   The caller must hold DIR's lock. */
 static bool
 lookup (const struct dir *dir, const char *name,
         struct dir_entry *ep, off_t *ofsp) 
 {
+  struct dir_index *index;
+  struct index_entry *ie;
   struct dir_entry e;
   size_t ofs;
   
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
+  index = get_index (dir);
+  if (index != NULL)
+    {
+      struct index_entry key;
+      struct hash_elem *found;
+
+      if (strlen (name) > NAME_MAX)
+        return false;
+      strlcpy (key.name, name, sizeof key.name);
+      found = hash_find (&index->names, &key.hash_elem);
+      if (found == NULL)
+        return false;
+
+      ie = hash_entry (found, struct index_entry, hash_elem);
+      if (ep != NULL)
+        {
+          ep->inode_sector = ie->inode_sector;
+          strlcpy (ep->name, ie->name, sizeof ep->name);
+          ep->in_use = true;
+        }
+      if (ofsp != NULL)
+        *ofsp = ie->ofs;
+      return true;
+    }
+
   for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
        ofs += sizeof e) 
     if (e.in_use && !strcmp (name, e.name)) 
@@ -114,20 +304,46 @@ lookup (const struct dir *dir, const char *name,
 /* Searches DIR for a file with the given NAME
    and returns true if one exists, false otherwise.
    On success, sets *INODE to an inode for the file, otherwise to
-   a null pointer.  The caller must close *INODE. */
+   a null pointer.  The caller must close *INODE.
+   A directory that has been removed contains no files, not even
+   "." and "..". */
 bool
 dir_lookup (const struct dir *dir, const char *name,
             struct inode **inode) 
 {
+  block_sector_t dir_sector, sector;
   struct dir_entry e;
+  bool is_dir;
 
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
-  if (lookup (dir, name, &e, NULL))
-    *inode = inode_open (e.inode_sector);
-  else
-    *inode = NULL;
+  *inode = NULL;
+  dir_sector = inode_get_inumber (dir->inode);
+
+  /* Hold DIR's lock until the inode is open, or the result is
+     cached, so that a concurrent dir_remove() can neither free
+     the inode before we open it nor make the cache stale.  DIR
+     is marked removed under the same lock. */
+  inode_lock_dir (dir->inode);
+  if (!inode_is_removed (dir->inode))
+    {
+      if (dcache_lookup (dir_sector, name, &sector, &is_dir))
+        {
+          if (sector != 0)
+            *inode = inode_open (sector);
+        }
+      else if (lookup (dir, name, &e, NULL))
+        {
+          *inode = inode_open (e.inode_sector);
+          if (*inode != NULL)
+            dcache_insert (dir_sector, name, e.inode_sector,
+                           inode_is_dir (*inode));
+        }
+      else
+        dcache_insert (dir_sector, name, 0, false);
+    }
+  inode_unlock_dir (dir->inode);
 
   return *inode != NULL;
 }
@@ -136,11 +352,13 @@ dir_lookup (const struct dir *dir, const char *name,
    file by that name.  The file's inode is in sector
    INODE_SECTOR.
    Returns true if successful, false on failure.
-   Fails if NAME is invalid (i.e. too long) or a disk or memory
-   error occurs. */
+   Fails if NAME is invalid (i.e. too long), if DIR has been
+   removed, or if a disk or memory error occurs. */
 bool
 dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
 {
+  struct dir_index *index;
+  struct index_entry *ie = NULL;
   struct dir_entry e;
   off_t ofs;
   bool success = false;
@@ -152,21 +370,46 @@ dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
   if (*name == '\0' || strlen (name) > NAME_MAX)
     return false;
 
+  inode_lock_dir (dir->inode);
+
+  /* Don't add files to a directory that has been removed. */
+  if (inode_is_removed (dir->inode))
+    goto done;
+
   /* Check that NAME is not in use. */
   if (lookup (dir, name, NULL, NULL))
     goto done;
 
   /* Set OFS to offset of free slot.
      If there are no free slots, then it will be set to the
-     current end-of-file.
-     
-     inode_read_at() will only return a short read at end of file.
-     Otherwise, we'd need to verify that we didn't get a short
-     read due to something intermittent such as low memory. */
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e) 
-    if (!e.in_use)
-      break;
+     current end-of-file. */
+  index = get_index (dir);
+  if (index != NULL)
+    {
+      if (!list_empty (&index->free_slots))
+        {
+          ie = list_entry (list_front (&index->free_slots),
+                           struct index_entry, list_elem);
+          ofs = ie->ofs;
+        }
+      else
+        {
+          ie = NULL;
+          ofs = index->end;
+        }
+    }
+  else
+    {
+      /* inode_read_at() will only return a short read at end of
+         file.  Otherwise, we'd need to verify that we didn't get
+         a short read due to something intermittent such as low
+         memory. */
+      for (ofs = 0;
+           inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+           ofs += sizeof e) 
+        if (!e.in_use)
+          break;
+    }
 
   /* Write slot. */
   e.in_use = true;
@@ -174,24 +417,72 @@ dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
   e.inode_sector = inode_sector;
   success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
 
+  /* Update index. */
+  if (success && index != NULL)
+    {
+      if (ie != NULL)
+        list_remove (&ie->list_elem);
+      else
+        {
+          index->end = ofs + sizeof e;
+          ie = malloc (sizeof *ie);
+          if (ie == NULL)
+            {
+              drop_index (dir);
+              goto done;
+            }
+          ie->ofs = ofs;
+        }
+      ie->inode_sector = inode_sector;
+      strlcpy (ie->name, name, sizeof ie->name);
+      hash_insert (&index->names, &ie->hash_elem);
+    }
+
  done:
+  if (success)
+    dcache_invalidate (inode_get_inumber (dir->inode), name);
+  inode_unlock_dir (dir->inode);
   return success;
 }
 
+/* Returns true if DIR contains no entries other than "." and
+   "..".  The caller must hold DIR's lock. */
+static bool
+dir_is_empty (struct dir *dir)
+{
+  struct dir_entry e;
+  off_t ofs;
+
+  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+       ofs += sizeof e)
+    if (e.in_use && strcmp (e.name, ".") && strcmp (e.name, ".."))
+      return false;
+  return true;
+}
+
 /* Removes any entry for NAME in DIR.
    Returns true if successful, false on failure,
-   which occurs only if there is no file with the given NAME. */
+   which occurs if there is no file with the given NAME, if NAME
+   is "." or "..", or if NAME is a directory that is not
+   empty. */
 bool
 dir_remove (struct dir *dir, const char *name) 
 {
+  struct dir_index *index;
   struct dir_entry e;
   struct inode *inode = NULL;
+  bool inode_locked = false;
   bool success = false;
   off_t ofs;
 
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
+  if (!strcmp (name, ".") || !strcmp (name, ".."))
+    return false;
+
+  inode_lock_dir (dir->inode);
+
   /* Find directory entry. */
   if (!lookup (dir, name, &e, &ofs))
     goto done;
@@ -201,36 +492,96 @@ dir_remove (struct dir *dir, const char *name)
   if (inode == NULL)
     goto done;
 
+  /* Only remove empty directories.  Keep the directory locked
+     until it is marked removed, so that nothing can be added to
+     it meanwhile. */
+  if (inode_is_dir (inode))
+    {
+      struct dir *subdir;
+      bool empty;
+
+      inode_lock_dir (inode);
+      inode_locked = true;
+      subdir = dir_open (inode_reopen (inode));
+      empty = subdir != NULL && dir_is_empty (subdir);
+      dir_close (subdir);
+      if (!empty)
+        goto done;
+    }
+
   /* Erase directory entry. */
   e.in_use = false;
   if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e) 
     goto done;
 
+  /* Update index.  lookup() found E through the index, if there
+     is one. */
+  index = inode_get_dir_index (dir->inode);
+  if (index != NULL)
+    {
+      struct index_entry key;
+      struct index_entry *ie;
+
+      strlcpy (key.name, name, sizeof key.name);
+      ie = hash_entry (hash_delete (&index->names, &key.hash_elem),
+                       struct index_entry, hash_elem);
+      list_push_back (&index->free_slots, &ie->list_elem);
+    }
+
+  /* Update path component cache. */
+  dcache_insert (inode_get_inumber (dir->inode), name, 0, false);
+  if (inode_is_dir (inode))
+    dcache_invalidate_dir (e.inode_sector);
+
   /* Remove inode. */
   inode_remove (inode);
   success = true;
 
  done:
+  if (inode_locked)
+    inode_unlock_dir (inode);
+  inode_unlock_dir (dir->inode);
   inode_close (inode);
   return success;
 }
 
 /* Reads the next directory entry in DIR and stores the name in
    NAME.  Returns true if successful, false if the directory
-   contains no more entries. */
+   contains no more entries.  Skips "." and "..". */
 bool
 dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
 {
   struct dir_entry e;
+  bool found = false;
 
+  inode_lock_dir (dir->inode);
   while (inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e) 
     {
       dir->pos += sizeof e;
-      if (e.in_use)
+      if (e.in_use && strcmp (e.name, ".") && strcmp (e.name, ".."))
         {
           strlcpy (name, e.name, NAME_MAX + 1);
-          return true;
+          found = true;
+          break;
         } 
     }
-  return false;
+  inode_unlock_dir (dir->inode);
+  return found;
+}
+
+/* Sets the position in DIR at which dir_readdir() reads the
+   next entry to POS bytes from the start of the directory. */
+void
+dir_seek (struct dir *dir, off_t pos)
+{
+  ASSERT (pos >= 0);
+  dir->pos = pos;
+}
+
+/* Returns the position in DIR at which dir_readdir() reads the
+   next entry. */
+off_t
+dir_tell (struct dir *dir)
+{
+  return dir->pos;
 }
@@ -2,6 +2,15 @@
 #include <debug.h>
 #include "filesys/inode.h"
 #include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+/* Read-ahead window limits, in bytes.  A file read sequentially
+   starts with the minimum window, which doubles on each further
+   sequential read up to the maximum; any other read closes the
+   window again. */
+#define READ_AHEAD_MIN (2 * BLOCK_SECTOR_SIZE)
+#define READ_AHEAD_MAX (16 * BLOCK_SECTOR_SIZE)
 
 struct file
 {
@@ -10,8 +19,14 @@ struct file
     off_t pos;
     bool deny_write;
 
+    off_t ra_next;      /* Offset at which a sequential read starts. */
+    off_t ra_end;       /* End of data already read ahead. */
+    off_t ra_window;    /* Read-ahead window in bytes, 0 if none. */
+
 };
 
+static void read_ahead (struct file *, off_t ofs, off_t size);
+
 /* Opens a file for the given INODE, of which it takes ownership,
    and returns the new file.  Returns a null pointer if an
    allocation fails or if INODE is null. */
@@ -70,6 +85,7 @@ off_t
 file_read (struct file *file, void *buffer, off_t size) 
 {
   off_t readed_bytes = inode_read_at (file->inode, buffer, size, file->pos);
+  read_ahead (file, file->pos, readed_bytes);
   file->pos += readed_bytes;
   return readed_bytes;
 }
@@ -82,15 +98,16 @@ file_read (struct file *file, void *buffer, off_t size)
 off_t
 file_read_at (struct file *file, void *buffer, off_t size, off_t file_ofs) 
 {
-  return inode_read_at (file->inode, buffer, size, file_ofs);
+  off_t bytes_read = inode_read_at (file->inode, buffer, size, file_ofs);
+  read_ahead (file, file_ofs, bytes_read);
+  return bytes_read;
 }
 
 /* Writes SIZE bytes from BUFFER into FILE,
    starting at the file's current position.
    Returns the number of bytes actually written,
-   which may be less than SIZE if end of file is reached.
-   (Normally we'd grow the file in that case, but file growth is
-   not yet implemented.)
+   which may be less than SIZE if the disk is full.
+   Writing past end of file extends the file.
    Advances FILE's position by the number of bytes read. */
 off_t
 file_write (struct file *file, const void *buffer, off_t size) 
@@ -103,9 +120,8 @@ file_write (struct file *file, const void *buffer, off_t size)
 /* Writes SIZE bytes from BUFFER into FILE,
    starting at offset FILE_OFS in the file.
    Returns the number of bytes actually written,
-   which may be less than SIZE if end of file is reached.
-   (Normally we'd grow the file in that case, but file growth is
-   not yet implemented.)
+   which may be less than SIZE if the disk is full.
+   Writing past end of file extends the file.
    The file's current position is unaffected. */
 off_t
 file_write_at (struct file *file, const void *buffer, off_t size,
@@ -114,6 +130,47 @@ file_write_at (struct file *file, const void *buffer, off_t size,
   return inode_write_at (file->inode, buffer, size, file_ofs);
 }
 
+/* Copies up to SIZE bytes from IN, starting at its current
+   position, to OUT, starting at its current position, and
+   advances both positions by the number of bytes copied.  The
+   data moves a page at a time through a kernel buffer, from IN's
+   cached sectors straight to OUT's, without a trip through user
+   memory.  IN and OUT must not share an inode, or the copy could
+   overwrite data before reading it.
+   Returns the number of bytes copied, which may be less than
+   SIZE if end of IN is reached or the disk is full, or -1 if no
+   buffer could be allocated. */
+off_t
+file_copy (struct file *out, struct file *in, off_t size)
+{
+  uint8_t *buffer;
+  off_t bytes_copied = 0;
+
+  ASSERT (file_get_inode (in) != file_get_inode (out));
+  ASSERT (size >= 0);
+  buffer = palloc_get_page (0);
+  if (buffer == NULL)
+    return -1;
+
+  while (bytes_copied < size)
+    {
+      off_t chunk = size - bytes_copied < PGSIZE ? size - bytes_copied : PGSIZE;
+      off_t bytes_read = file_read (in, buffer, chunk);
+      off_t bytes_written = file_write (out, buffer, bytes_read);
+
+      bytes_copied += bytes_written;
+      if (bytes_written < chunk)
+        {
+          /* Don't leave IN past what was actually copied. */
+          in->pos -= bytes_read - bytes_written;
+          break;
+        }
+    }
+
+  palloc_free_page (buffer);
+  return bytes_copied;
+}
+
 /* Prevents write operations on FILE's underlying inode
    until file_allow_write() is called or FILE is closed. */
 void
@@ -167,3 +224,43 @@ file_tell (struct file *file)
   ASSERT (file != NULL);
   return file->pos;
 }
+
+/* Updates FILE's read-ahead state after a read of SIZE bytes at
+   offset OFS, and starts reading ahead if the reads so far look
+   sequential. */
+static void
+read_ahead (struct file *file, off_t ofs, off_t size)
+{
+  off_t start, end;
+
+  if (size == 0)
+    return;
+
+  if (ofs == file->ra_next)
+    {
+      /* Sequential: open or widen the window. */
+      if (file->ra_window == 0)
+        file->ra_window = READ_AHEAD_MIN;
+      else if (file->ra_window < READ_AHEAD_MAX)
+        file->ra_window *= 2;
+    }
+  else
+    {
+      /* Random: close the window. */
+      file->ra_window = 0;
+      file->ra_end = 0;
+    }
+  file->ra_next = ofs + size;
+
+  if (file->ra_window == 0)
+    return;
+
+  /* Read ahead only what was not already requested. */
+  start = file->ra_next > file->ra_end ? file->ra_next : file->ra_end;
+  end = file->ra_next + file->ra_window;
+  if (end > start)
+    {
+      inode_read_ahead (file->inode, end - start, start);
+      file->ra_end = end;
+    }
+}
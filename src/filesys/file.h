@@ -18,6 +18,7 @@ off_t file_read (struct file *, void *, off_t);
 off_t file_read_at (struct file *, void *, off_t size, off_t start);
 off_t file_write (struct file *, const void *, off_t);
 off_t file_write_at (struct file *, const void *, off_t size, off_t start);
+off_t file_copy (struct file *out, struct file *in, off_t size);
 
 /* Preventing writes. */
 void file_deny_write (struct file *);
@@ -2,15 +2,21 @@
 #include <debug.h>
 #include <stdio.h>
 #include <string.h>
+#include "filesys/cache.h"
+#include "filesys/dcache.h"
 #include "filesys/file.h"
 #include "filesys/free-map.h"
 #include "filesys/inode.h"
 #include "filesys/directory.h"
+#include "filesys/journal.h"
+#include "threads/thread.h"
 
 /* Partition that contains the file system. */
 struct block *fs_device;
 
 static void do_format (void);
+static bool resolve (const char *path, struct dir **dirp,
+                     char name[NAME_MAX + 1]);
 
 /* Initializes the file system module.
    If FORMAT is true, reformats the file system. */
@@ -21,12 +27,15 @@ filesys_init (bool format)
   if (fs_device == NULL)
     PANIC ("No file system device found, can't initialize file system.");
 
+  cache_init ();
+  dcache_init ();
   inode_init ();
   free_map_init ();
 
   if (format) 
     do_format ();
 
+  journal_init ();
   free_map_open ();
 }
 
@@ -36,8 +45,87 @@ void
 filesys_done (void) 
 {
   free_map_close ();
+  journal_done ();
+  cache_flush ();
 }
 
+/* Extends the file just created as NAME in DIR, whose inode is
+   in INODE_SECTOR, to INITIAL_SIZE bytes.  If that fails,
+   removes the file again.
+   Returns true if successful, false otherwise. */
+static bool
+extend_new_file (struct dir *dir, const char *name,
+                 block_sector_t inode_sector, off_t initial_size)
+{
+  struct inode *inode = inode_open (inode_sector);
+  struct inode *found;
+  bool success;
+
+  if (inode == NULL)
+    return false;
+  success = inode_extend (inode, initial_size);
+  if (!success && dir_lookup (dir, name, &found))
+    {
+      /* Someone may have replaced the file in the meantime. */
+      if (found == inode)
+        {
+          journal_begin ();
+          dir_remove (dir, name);
+          journal_end ();
+        }
+      inode_close (found);
+    }
+  inode_close (inode);
+  return success;
+}
+
+/* Creates a file or, if IS_DIR is true, an empty directory at
+   PATH, with the given INITIAL_SIZE.
+   Returns true if successful, false otherwise.
+
+   A single journal operation creates the inode and its directory
+   entry.  A file's initial length may be megabytes, more than one
+   journal operation can cover, so it is allocated afterward by
+   inode_extend(), one chunk per operation. */
+static bool
+do_create (const char *path, off_t initial_size, bool is_dir)
+{
+  block_sector_t inode_sector = 0;
+  char name[NAME_MAX + 1];
+  struct dir *dir;
+  bool created;
+  bool success;
+
+  if (!resolve (path, &dir, name))
+    return false;
+  journal_begin ();
+  created = (free_map_allocate_near (inode_get_inumber (dir_get_inode (dir)),
+                                     1, &inode_sector) == 1
+             && (is_dir
+                 ? dir_create (inode_sector, 16,
+                               inode_get_inumber (dir_get_inode (dir)))
+                 : inode_create (inode_sector, 0, false)));
+  success = created && dir_add (dir, name, inode_sector);
+  if (!success && created)
+    {
+      /* Free the new inode's data sectors along with the inode. */
+      struct inode *inode = inode_open (inode_sector);
+      if (inode != NULL)
+        {
+          inode_remove (inode);
+          inode_close (inode);
+        }
+    }
+  else if (!success && inode_sector != 0) 
+    free_map_release (inode_sector, 1);
+  journal_end ();
+  if (success && initial_size > 0)
+    success = extend_new_file (dir, name, inode_sector, initial_size);
+  dir_close (dir);
+
+  return success;
+}
+
 /* Creates a file named NAME with the given INITIAL_SIZE.
    Returns true if successful, false otherwise.
    Fails if a file named NAME already exists,
@@ -45,20 +133,20 @@ filesys_done (void)
 bool
 filesys_create (const char *name, off_t initial_size) 
 {
-  block_sector_t inode_sector = 0;
-  struct dir *dir = dir_open_root ();
-  bool success = (dir != NULL
-                  && free_map_allocate (1, &inode_sector)
-                  && inode_create (inode_sector, initial_size)
-                  && dir_add (dir, name, inode_sector));
-  if (!success && inode_sector != 0) 
-    free_map_release (inode_sector, 1);
-  dir_close (dir);
+  return do_create (name, initial_size, false);
+}
 
-  return success;
+/* Creates an empty directory named NAME.
+   Returns true if successful, false otherwise.
+   Fails if a file named NAME already exists,
+   or if internal memory allocation fails. */
+bool
+filesys_mkdir (const char *name)
+{
+  return do_create (name, 0, true);
 }
 
-/* Opens the file with the given NAME.
+/* Opens the file or directory with the given NAME.
    Returns the new file if successful or a null pointer
    otherwise.
    Fails if no file named NAME exists,
@@ -66,37 +154,175 @@ filesys_create (const char *name, off_t initial_size)
 struct file *
 filesys_open (const char *name)
 {
-  struct dir *dir = dir_open_root ();
+  char part[NAME_MAX + 1];
   struct inode *inode = NULL;
+  struct dir *dir;
 
-  if (dir != NULL)
-    dir_lookup (dir, name, &inode);
-  dir_close (dir);
+  if (resolve (name, &dir, part))
+    {
+      dir_lookup (dir, part, &inode);
+      dir_close (dir);
+    }
 
   return file_open (inode);
 }
 
 /* Deletes the file named NAME.
    Returns true if successful, false on failure.
-   Fails if no file named NAME exists,
-   or if an internal memory allocation fails. */
+   Fails if no file named NAME exists, if NAME is a directory
+   that is not empty, or if an internal memory allocation
+   fails. */
 bool
 filesys_remove (const char *name) 
 {
-  struct dir *dir = dir_open_root ();
-  bool success = dir != NULL && dir_remove (dir, name);
-  dir_close (dir); 
+  char part[NAME_MAX + 1];
+  struct dir *dir;
+  bool success = false;
+
+  if (resolve (name, &dir, part))
+    {
+      journal_begin ();
+      success = dir_remove (dir, part);
+      journal_end ();
+      dir_close (dir); 
+    }
 
   return success;
 }
+
+/* Makes the directory named NAME the current thread's working
+   directory.
+   Returns true if successful, false on failure.
+   Fails if no directory named NAME exists,
+   or if an internal memory allocation fails. */
+bool
+filesys_chdir (const char *name)
+{
+  struct thread *t = thread_current ();
+  char part[NAME_MAX + 1];
+  struct inode *inode = NULL;
+  struct dir *dir;
+
+  if (!resolve (name, &dir, part))
+    return false;
+  dir_lookup (dir, part, &inode);
+  dir_close (dir);
+
+  dir = dir_open (inode);
+  if (dir == NULL)
+    return false;
+  dir_close (t->cwd);
+  t->cwd = dir;
+  return true;
+}
+
+/* Extracts a file name part from *SRCP into PART, and updates
+   *SRCP so that the next call will return the next file name
+   part.  Returns 1 if successful, 0 at end of string, -1 for a
+   too-long file name part. */
+static int
+get_next_part (char part[NAME_MAX + 1], const char **srcp)
+{
+  const char *src = *srcp;
+  char *dst = part;
+
+  /* Skip leading slashes.  If it's all slashes, we're done. */
+  while (*src == '/')
+    src++;
+  if (*src == '\0')
+    return 0;
+
+  /* Copy up to NAME_MAX characters from SRC to DST.  Add null
+     terminator. */
+  while (*src != '/' && *src != '\0')
+    {
+      if (dst < part + NAME_MAX)
+        *dst++ = *src;
+      else
+        return -1;
+      src++;
+    }
+  *dst = '\0';
+
+  /* Advance source pointer. */
+  *srcp = src;
+  return 1;
+}
+
+/* Looks up NAME in directory *DIRP.  If NAME is a directory,
+   closes *DIRP, replaces it by NAME opened as a directory, and
+   returns true; otherwise, closes *DIRP and returns false.
+
+   dir_lookup() consults the path component cache first, so that
+   a component that has been looked up before costs no directory
+   reads.  *DIRP stays open until NAME is, so that a concurrent
+   rmdir cannot free NAME's inode, and let its sector be reused,
+   in between. */
+static bool
+step (struct dir **dirp, const char *name)
+{
+  struct inode *inode;
+
+  dir_lookup (*dirp, name, &inode);
+  dir_close (*dirp);
+  *dirp = dir_open (inode);
+  return *dirp != NULL;
+}
+
+/* Resolves PATH, which is relative to the current thread's
+   working directory, or to the root directory if PATH starts
+   with "/" or the thread has no working directory.  On success,
+   opens the directory that contains the last component of PATH
+   and stores it in *DIRP, copies the last component into NAME,
+   and returns true.  If PATH names the root directory itself,
+   opens the root directory and sets NAME to ".".  On failure,
+   returns false; the caller need not close anything. */
+static bool
+resolve (const char *path, struct dir **dirp, char name[NAME_MAX + 1])
+{
+  struct dir *cwd = thread_current ()->cwd;
+  struct dir *dir;
+  char next[NAME_MAX + 1];
+  int result;
+
+  if (*path == '\0')
+    return false;
+  if (*path == '/' || cwd == NULL)
+    dir = dir_open_root ();
+  else
+    dir = dir_reopen (cwd);
+  if (dir == NULL)
+    return false;
+
+  /* Walk down to the directory that contains the last
+     component. */
+  strlcpy (name, ".", NAME_MAX + 1);
+  result = get_next_part (name, &path);
+  if (result > 0)
+    while ((result = get_next_part (next, &path)) > 0)
+      {
+        if (!step (&dir, name))
+          return false;
+        strlcpy (name, next, NAME_MAX + 1);
+      }
+  if (result < 0)
+    {
+      dir_close (dir);
+      return false;
+    }
+
+  *dirp = dir;
+  return true;
+}
 
 /* Formats the file system. */
 static void
 do_format (void)
 {
   printf ("Formatting file system...");
+  journal_create ();
   free_map_create ();
-  if (!dir_create (ROOT_DIR_SECTOR, 16))
+  if (!dir_create (ROOT_DIR_SECTOR, 16, ROOT_DIR_SECTOR))
     PANIC ("root directory creation failed");
   free_map_close ();
   printf ("done.\n");
@@ -1,52 +1,322 @@
 #include "filesys/free-map.h"
 #include <bitmap.h>
 #include <debug.h>
+#include <round.h>
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
 
 static struct file *free_map_file;   /* Free map file. */
 static struct bitmap *free_map;      /* Free map, one bit per sector. */
 
+/* Protects free_map, the group counts, and the pending sectors
+   below, and serializes writes to the free map file.  Taken
+   after any inode lock held by the caller, and before the free
+   map file's own. */
+static struct lock free_map_lock;
+
+/* Allocation groups.
+
+   The disk is divided into groups of GROUP_SECTORS consecutive
+   sectors, and the number of free sectors in each group is kept
+   up to date as sectors are allocated and released.  Callers
+   pass a goal sector to free_map_allocate_near(): the sector
+   after a file's last data sector, or a file's own inode, or its
+   parent directory's inode, so that related sectors cluster in
+   one group and the disk head moves less.  The per-group counts
+   let searches skip groups that are full, or too full to hold
+   the run they want, without scanning their bits. */
+#define GROUP_SECTORS 1024
+static size_t group_cnt;             /* Number of groups. */
+static size_t *group_free;           /* Free sectors in each group. */
+
+/* Sectors released by the running journal transaction.
+
+   Such a sector is marked free on disk right away, in the same
+   transaction, but stays marked used in free_map, so that it is
+   not allocated again until the transaction commits: otherwise a
+   crash could leave it in use by both its old owner and its new
+   one.  free_map_commit() then marks it free in free_map too. */
+static struct bitmap *pending;
+static size_t pending_cnt;           /* Number of bits set in pending. */
+
+/* Number of bits in a sector of the free map file. */
+#define SECTOR_BITS (BLOCK_SECTOR_SIZE * 8)
+
+/* Writes the sectors of the free map file that hold the bits for
+   sectors START through START + CNT - 1, rather than the whole
+   file.  Like all file writes these only update the sector
+   cache, so changes to the same free map sector are written to
+   disk together, later.  Returns true if successful, false
+   otherwise.  Does nothing before the free map file is open. */
+static bool
+write_bits (block_sector_t start, size_t cnt)
+{
+  size_t first, end, pos;
+  bool success;
+
+  if (free_map_file == NULL)
+    return true;
+  if (pending_cnt == 0)
+    return bitmap_write_part (free_map, free_map_file, start, cnt,
+                              BLOCK_SECTOR_SIZE);
+
+  /* Write pending sectors among those whose bits are written as
+     free, by clearing their bits just while writing. */
+  first = ROUND_DOWN (start, SECTOR_BITS);
+  end = ROUND_UP (start + cnt, SECTOR_BITS);
+  if (end > bitmap_size (free_map))
+    end = bitmap_size (free_map);
+  for (pos = first; (pos = bitmap_scan (pending, pos, 1, true)) < end; pos++)
+    bitmap_reset (free_map, pos);
+  success = bitmap_write_part (free_map, free_map_file, start, cnt,
+                               BLOCK_SECTOR_SIZE);
+  for (pos = first; (pos = bitmap_scan (pending, pos, 1, true)) < end; pos++)
+    bitmap_mark (free_map, pos);
+  return success;
+}
+
+/* Marks CNT sectors starting at START as USED, or as free,
+   keeping the group counts up to date.  The sectors must all be
+   in the opposite state. */
+static void
+set_sectors (block_sector_t start, size_t cnt, bool used)
+{
+  size_t end = start + cnt;
+  size_t pos;
+
+  ASSERT (bitmap_none (free_map, start, cnt) == used);
+  bitmap_set_multiple (free_map, start, cnt, used);
+  for (pos = start; pos < end; )
+    {
+      size_t group = pos / GROUP_SECTORS;
+      size_t group_end = (group + 1) * GROUP_SECTORS;
+      size_t n = (end < group_end ? end : group_end) - pos;
+
+      if (used)
+        group_free[group] -= n;
+      else
+        group_free[group] += n;
+      pos += n;
+    }
+}
+
+/* Recounts the free sectors in each group. */
+static void
+count_groups (void)
+{
+  size_t size = bitmap_size (free_map);
+  size_t group;
+
+  for (group = 0; group < group_cnt; group++)
+    {
+      size_t start = group * GROUP_SECTORS;
+      size_t cnt = size - start < GROUP_SECTORS ? size - start : GROUP_SECTORS;
+      group_free[group] = bitmap_count (free_map, start, cnt, false);
+    }
+}
+
 /* Initializes the free map. */
 void
 free_map_init (void) 
 {
   free_map = bitmap_create (block_size (fs_device));
-  if (free_map == NULL)
+  pending = bitmap_create (block_size (fs_device));
+  if (free_map == NULL || pending == NULL)
     PANIC ("bitmap creation failed--file system device is too large");
   bitmap_mark (free_map, FREE_MAP_SECTOR);
   bitmap_mark (free_map, ROOT_DIR_SECTOR);
+  bitmap_set_multiple (free_map, JOURNAL_SECTOR, JOURNAL_SECTORS, true);
+  lock_init (&free_map_lock);
+
+  group_cnt = DIV_ROUND_UP (bitmap_size (free_map), GROUP_SECTORS);
+  group_free = malloc (group_cnt * sizeof *group_free);
+  if (group_free == NULL)
+    PANIC ("allocation group creation failed");
+  count_groups ();
 }
 
-/* Allocates CNT consecutive sectors from the free map and stores
-   the first into *SECTORP.
-   Returns true if successful, false if not enough consecutive
-   sectors were available or if the free_map file could not be
-   written. */
-bool
-free_map_allocate (size_t cnt, block_sector_t *sectorp)
+/* Looks for free runs of sectors in [START, END), remembering
+   the longest seen so far, up to CNT sectors, in *BEST_START and
+   *BEST_CNT.  Returns true as soon as it finds a run of CNT
+   sectors. */
+static bool
+find_run (size_t start, size_t end, size_t cnt,
+          size_t *best_start, size_t *best_cnt)
+{
+  size_t pos = start;
+
+  while (pos < end)
+    {
+      size_t len = 0;
+
+      if (bitmap_test (free_map, pos))
+        {
+          pos++;
+          continue;
+        }
+      while (pos + len < end && len < cnt
+             && !bitmap_test (free_map, pos + len))
+        len++;
+      if (len > *best_cnt)
+        {
+          *best_start = pos;
+          *best_cnt = len;
+          if (len == cnt)
+            return true;
+        }
+      pos += len;
+    }
+  return false;
+}
+
+/* Looks for a run of CNT free sectors in the groups from the one
+   that contains GOAL onward, wrapping around, and starting at
+   GOAL within its own group.  Skips groups with fewer than
+   MIN_FREE free sectors.  Remembers the longest run seen so far,
+   up to CNT sectors, in *BEST_START and *BEST_CNT, and returns
+   true as soon as it finds a run of CNT sectors.  Runs do not
+   cross group boundaries. */
+static bool
+search_groups (block_sector_t goal, size_t cnt, size_t min_free,
+               size_t *best_start, size_t *best_cnt)
+{
+  size_t size = bitmap_size (free_map);
+  size_t first = goal / GROUP_SECTORS;
+  size_t i;
+
+  /* The goal's group is visited twice: first from GOAL to its
+     end, and last from its start up to GOAL. */
+  for (i = 0; i <= group_cnt; i++)
+    {
+      size_t group = (first + i) % group_cnt;
+      size_t start = group * GROUP_SECTORS;
+      size_t end = start + GROUP_SECTORS < size ? start + GROUP_SECTORS : size;
+
+      if (group_free[group] < min_free || group_free[group] == 0)
+        continue;
+      if (i == 0)
+        start = goal;
+      else if (i == group_cnt)
+        end = goal;
+      if (find_run (start, end, cnt, best_start, best_cnt))
+        return true;
+    }
+  return false;
+}
+
+/* Allocates a run of up to CNT consecutive sectors near sector
+   GOAL and stores the first into *SECTORP.  Returns the number
+   of sectors allocated, which is less than CNT only if no run of
+   CNT free sectors exists within a group (or, as described
+   below, if GOAL itself is free), or 0 if the disk is full or
+   the free_map file could not be written.
+
+   If GOAL is free, the run starts there, so that a file growing
+   one piece at a time stays contiguous where it can.  Otherwise
+   the first run of CNT free sectors after GOAL is used, looking
+   first in GOAL's allocation group and then in the following
+   groups, or failing that the largest free run found. */
+size_t
+free_map_allocate_near (block_sector_t goal, size_t cnt,
+                        block_sector_t *sectorp)
 {
-  block_sector_t sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
-  if (sector != BITMAP_ERROR
-      && free_map_file != NULL
-      && !bitmap_write (free_map, free_map_file))
+  size_t size = bitmap_size (free_map);
+  size_t start = 0, len = 0;
+
+  ASSERT (cnt > 0);
+
+  if (goal >= size)
+    goal = 0;
+  lock_acquire (&free_map_lock);
+  if (!bitmap_test (free_map, goal))
+    {
+      start = goal;
+      while (len < cnt && goal + len < size
+             && !bitmap_test (free_map, goal + len))
+        len++;
+    }
+  else if (!search_groups (goal, cnt, cnt, &start, &len) && len == 0)
+    {
+      /* No group has CNT free sectors.  Settle for less. */
+      search_groups (goal, cnt, 1, &start, &len);
+    }
+  if (len > 0)
     {
-      bitmap_set_multiple (free_map, sector, cnt, false); 
-      sector = BITMAP_ERROR;
+      set_sectors (start, len, true);
+      if (!write_bits (start, len))
+        {
+          set_sectors (start, len, false);
+          len = 0;
+        }
     }
-  if (sector != BITMAP_ERROR)
-    *sectorp = sector;
-  return sector != BITMAP_ERROR;
+  lock_release (&free_map_lock);
+
+  if (len > 0)
+    *sectorp = start;
+  return len;
 }
 
-/* Makes CNT sectors starting at SECTOR available for use. */
+/* Makes CNT sectors starting at SECTOR available for use.  While
+   metadata is being journaled, they become available only once
+   the running transaction commits. */
 void
 free_map_release (block_sector_t sector, size_t cnt)
 {
+  lock_acquire (&free_map_lock);
   ASSERT (bitmap_all (free_map, sector, cnt));
-  bitmap_set_multiple (free_map, sector, cnt, false);
-  bitmap_write (free_map, free_map_file);
+  ASSERT (bitmap_none (pending, sector, cnt));
+  if (journal_active ())
+    {
+      bitmap_set_multiple (pending, sector, cnt, true);
+      pending_cnt += cnt;
+    }
+  else
+    set_sectors (sector, cnt, false);
+  write_bits (sector, cnt);
+  lock_release (&free_map_lock);
+}
+
+/* Returns true if SECTOR has been released by the running
+   journal transaction. */
+bool
+free_map_pending (block_sector_t sector)
+{
+  bool is_pending;
+
+  lock_acquire (&free_map_lock);
+  is_pending = pending_cnt > 0 && bitmap_test (pending, sector);
+  lock_release (&free_map_lock);
+  return is_pending;
+}
+
+/* Makes the sectors released by the journal transaction that
+   just committed available for use.  They are already marked
+   free on disk. */
+void
+free_map_commit (void)
+{
+  size_t pos = 0;
+
+  lock_acquire (&free_map_lock);
+  while (pending_cnt > 0)
+    {
+      size_t cnt = 1;
+
+      pos = bitmap_scan (pending, pos, 1, true);
+      ASSERT (pos != BITMAP_ERROR);
+      while (cnt < pending_cnt && pos + cnt < bitmap_size (pending)
+             && bitmap_test (pending, pos + cnt))
+        cnt++;
+      bitmap_set_multiple (pending, pos, cnt, false);
+      set_sectors (pos, cnt, false);
+      pending_cnt -= cnt;
+      pos += cnt;
+    }
+  lock_release (&free_map_lock);
 }
 
 /* Opens the free map file and reads it from disk. */
@@ -58,6 +328,7 @@ free_map_open (void)
     PANIC ("can't open free map");
   if (!bitmap_read (free_map, free_map_file))
     PANIC ("can't read free map");
+  count_groups ();
 }
 
 /* Writes the free map to disk and closes the free map file. */
@@ -73,7 +344,7 @@ void
 free_map_create (void) 
 {
   /* Create inode. */
-  if (!inode_create (FREE_MAP_SECTOR, bitmap_file_size (free_map)))
+  if (!inode_create (FREE_MAP_SECTOR, bitmap_file_size (free_map), false))
     PANIC ("free map creation failed");
 
   /* Write bitmap to file. */
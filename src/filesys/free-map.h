@@ -11,7 +11,10 @@ void free_map_create (void);
 void free_map_open (void);
 void free_map_close (void);
 
-bool free_map_allocate (size_t, block_sector_t *);
+size_t free_map_allocate_near (block_sector_t goal, size_t,
+                               block_sector_t *);
 void free_map_release (block_sector_t, size_t);
+bool free_map_pending (block_sector_t);
+void free_map_commit (void);
 
 #endif /* filesys/free-map.h */
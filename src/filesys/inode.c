@@ -1,23 +1,63 @@
 #include "filesys/inode.h"
 #include <list.h>
+#include <hash.h>
 #include <debug.h>
 #include <round.h>
 #include <string.h>
+#include "filesys/cache.h"
+#include "filesys/directory.h"
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
+#include "filesys/journal.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
 
+/* Number of sector pointers in the on-disk inode itself, and in
+   an indirect block. */
+#define DIRECT_CNT 123
+#define INDIRECT_CNT (BLOCK_SECTOR_SIZE / sizeof (block_sector_t))
+
+/* Largest supported file size, in sectors and in bytes. */
+#define MAX_SECTORS (DIRECT_CNT + INDIRECT_CNT + INDIRECT_CNT * INDIRECT_CNT)
+#define MAX_LENGTH ((off_t) (MAX_SECTORS * BLOCK_SECTOR_SIZE))
+
+/* Growth granularity for files at least this many sectors long.
+   See inode_write_at(). */
+#define PREALLOC_SECTORS 8
+
+/* Largest part of a write done as one journal operation, in
+   bytes.  See inode_write_at(). */
+#define WRITE_CHUNK (64 * BLOCK_SECTOR_SIZE)
+
+/* Number of closed inodes to keep in memory.  See inode_close(). */
+#define CLOSED_MAX 32
+
 /* On-disk inode.
-   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+   Must be exactly BLOCK_SECTOR_SIZE bytes long.
+
+   The data sectors of a file are found through a multi-level
+   index, as in the Unix file system: the first DIRECT_CNT
+   sector numbers are stored in the inode itself, the next
+   INDIRECT_CNT in an indirect block that the inode points to,
+   and the rest in indirect blocks pointed to by a doubly
+   indirect block.  That is enough for files of over 8 MB.
+
+   Sector 0 holds the free map inode, so it is never a data or
+   index sector, and a sector number of 0 in the index means that
+   nothing has been allocated there yet.  Such holes, left by
+   writing past end of file, read as zeros, and their sectors are
+   allocated only when first written. */
 struct inode_disk
   {
-    block_sector_t start;               /* First data sector. */
+    block_sector_t direct[DIRECT_CNT];  /* Direct data sectors. */
+    block_sector_t indirect;            /* Indirect block. */
+    block_sector_t doubly_indirect;     /* Doubly indirect block. */
     off_t length;                       /* File size in bytes. */
     unsigned magic;                     /* Magic number. */
-    uint32_t unused[125];               /* Not used. */
+    uint32_t is_dir;                    /* 1 for a directory, else 0. */
   };
 
 /* Returns the number of sectors to allocate for an inode SIZE
@@ -28,49 +68,357 @@ bytes_to_sectors (off_t size)
   return DIV_ROUND_UP (size, BLOCK_SECTOR_SIZE);
 }
 
-/* In-memory inode. */
+/* In-memory inode.
+
+   Locking.  inode_table_lock protects open_cnt and removed (see
+   below).  Each inode's `lock' protects its data and
+   deny_write_cnt, so that reads and writes of different files
+   never wait for one another.  It is held for the whole of a
+   write, but a read holds it only while it finds each sector,
+   so reads of one file also proceed in parallel.  A directory's
+   `dir_lock' serializes operations on its entries and protects
+   its dir_index; see directory.c.
+
+   Locks are acquired in the order: journal operation (see
+   journal.c), directory locks, parent before child, then inode
+   locks, then the free map's lock. */
 struct inode 
   {
-    struct list_elem elem;              /* Element in inode list. */
+    struct hash_elem hash_elem;         /* Element in inode_table. */
+    struct list_elem closed_elem;       /* Element in closed_inodes. */
     block_sector_t sector;              /* Sector number of disk location. */
     int open_cnt;                       /* Number of openers. */
     bool removed;                       /* True if deleted, false otherwise. */
+    struct lock dir_lock;               /* Directory operations. */
+    struct dir_index *dir_index;        /* Directory index, or null. */
+
+    struct lock lock;                   /* Protects the members below. */
     int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
     struct inode_disk data;             /* Inode content. */
   };
 
-/* Returns the block device sector that contains byte offset POS
-   within INODE.
-   Returns -1 if INODE does not contain data for a byte at offset
-   POS. */
+/* Returns true if the data of the file whose inode, DISK, is in
+   SECTOR is file system metadata, which is journaled along with
+   the inodes and index blocks: that of a directory or of the
+   free map. */
+static bool
+is_metadata (const struct inode_disk *disk, block_sector_t sector)
+{
+  return disk->is_dir || sector == FREE_MAP_SECTOR;
+}
+
+/* Allocates an index block near GOAL, fills it with zeros, and
+   returns it.  Returns 0 if the disk is full. */
 static block_sector_t
-byte_to_sector (const struct inode *inode, off_t pos) 
+allocate_sector (block_sector_t goal)
 {
-  ASSERT (inode != NULL);
-  if (pos < inode->data.length)
-    return inode->data.start + pos / BLOCK_SECTOR_SIZE;
+  block_sector_t sector;
+
+  if (free_map_allocate_near (goal, 1, &sector) == 0)
+    return 0;
+  journal_zero (sector);
+  return sector;
+}
+
+/* Returns the index block in *SLOT, a slot in an in-memory
+   inode_disk.  If there is none and NEAR is nonzero, first
+   allocates one near sector NEAR, stores it in *SLOT, and sets
+   *CHANGED to true. */
+static block_sector_t
+get_index (block_sector_t *slot, block_sector_t near, bool *changed)
+{
+  if (*slot == 0 && near != 0)
+    {
+      *slot = allocate_sector (near);
+      if (*slot != 0)
+        *changed = true;
+    }
+  return *slot;
+}
+
+/* Returns entry IDX of the index block in sector INDEX.  If it
+   is 0 and NEW is nonzero, first stores NEW there. */
+static block_sector_t
+get_entry (block_sector_t index, size_t idx, block_sector_t new)
+{
+  block_sector_t sector;
+
+  ASSERT (idx < INDIRECT_CNT);
+
+  cache_read (index, &sector, idx * sizeof sector, sizeof sector);
+  if (sector == 0 && new != 0)
+    {
+      sector = new;
+      journal_write (index, &sector, idx * sizeof sector, sizeof sector);
+    }
+  return sector;
+}
+
+/* Returns the indirect block in entry IDX of the doubly indirect
+   block OUTER.  If there is none and NEAR is nonzero, first
+   allocates one near sector NEAR. */
+static block_sector_t
+get_inner_index (block_sector_t outer, size_t idx, block_sector_t near)
+{
+  block_sector_t index = get_entry (outer, idx, 0);
+
+  if (index == 0 && near != 0)
+    {
+      index = allocate_sector (near);
+      if (index != 0)
+        get_entry (outer, idx, index);
+    }
+  return index;
+}
+
+/* Returns the data sector with index IDX within the file
+   described by DISK, or 0 if none has been allocated.  If there
+   is none and NEW is nonzero, first makes NEW that sector,
+   allocating index blocks on the way to it as needed, and sets
+   *CHANGED to true if DISK itself is modified; then 0 is
+   returned only if an index block cannot be allocated. */
+static block_sector_t
+map_sector (struct inode_disk *disk, size_t idx, block_sector_t new,
+            bool *changed)
+{
+  block_sector_t index;
+
+  ASSERT (idx < MAX_SECTORS);
+
+  if (idx < DIRECT_CNT)
+    {
+      if (disk->direct[idx] == 0 && new != 0)
+        {
+          disk->direct[idx] = new;
+          *changed = true;
+        }
+      return disk->direct[idx];
+    }
+  idx -= DIRECT_CNT;
+
+  if (idx < INDIRECT_CNT)
+    index = get_index (&disk->indirect, new, changed);
   else
-    return -1;
+    {
+      idx -= INDIRECT_CNT;
+      index = get_index (&disk->doubly_indirect, new, changed);
+      if (index != 0)
+        index = get_inner_index (index, idx / INDIRECT_CNT, new);
+      idx %= INDIRECT_CNT;
+    }
+  return index != 0 ? get_entry (index, idx, new) : 0;
+}
+
+/* Returns the block device sector that contains byte offset POS
+   within the file described by DISK, or 0 if there is none. */
+static block_sector_t
+byte_to_sector (struct inode_disk *disk, off_t pos)
+{
+  size_t idx = pos / BLOCK_SECTOR_SIZE;
+
+  ASSERT (pos >= 0);
+  return idx < MAX_SECTORS ? map_sector (disk, idx, 0, NULL) : 0;
 }
 
-/* List of open inodes, so that opening a single inode twice
-   returns the same `struct inode'. */
-static struct list open_inodes;
+/* Allocates and zeros data sectors for sector indexes FIRST
+   through LAST, inclusive, of the file described by DISK, whose
+   inode is in INODE_SECTOR, wherever there are none yet.  Sets
+   *CHANGED to true if DISK itself is modified.  Returns true if
+   successful, false if the disk filled up.
+
+   Each run of missing sectors is allocated as a single extent if
+   possible, placed right after the sector that precedes it in
+   the file (or after the inode), so that files stay contiguous
+   on disk. */
+static bool
+allocate_range (struct inode_disk *disk, block_sector_t inode_sector,
+                size_t first, size_t last, bool *changed)
+{
+  bool meta = is_metadata (disk, inode_sector);
+  size_t idx = first;
+
+  ASSERT (last < MAX_SECTORS);
+
+  while (idx <= last)
+    {
+      block_sector_t goal, start;
+      size_t cnt, got, i;
+
+      if (map_sector (disk, idx, 0, NULL) != 0)
+        {
+          idx++;
+          continue;
+        }
+
+      for (cnt = 1; idx + cnt <= last; cnt++)
+        if (map_sector (disk, idx + cnt, 0, NULL) != 0)
+          break;
+      goal = idx > 0 ? map_sector (disk, idx - 1, 0, NULL) : 0;
+      goal = goal != 0 ? goal + 1 : inode_sector + 1;
+
+      got = free_map_allocate_near (goal, cnt, &start);
+      if (got == 0)
+        return false;
+      for (i = 0; i < got; i++)
+        {
+          if (meta)
+            journal_zero (start + i);
+          else
+            cache_zero (start + i);
+          if (map_sector (disk, idx + i, start + i, changed) == 0)
+            {
+              free_map_release (start + i, got - i);
+              return false;
+            }
+        }
+      idx += got;
+    }
+  return true;
+}
+
+/* Releases the index block in SECTOR and, if LEVEL is 2, the
+   indirect blocks it points to, along with all of the data
+   sectors under them.  SECTOR may be 0. */
+static void
+release_index (block_sector_t sector, int level)
+{
+  block_sector_t *entries;
+  size_t i;
+
+  if (sector == 0)
+    return;
+
+  entries = malloc (BLOCK_SECTOR_SIZE);
+  if (entries != NULL)
+    {
+      cache_read (sector, entries, 0, BLOCK_SECTOR_SIZE);
+      for (i = 0; i < INDIRECT_CNT; i++)
+        if (entries[i] != 0)
+          {
+            if (level > 1)
+              release_index (entries[i], level - 1);
+            else
+              free_map_release (entries[i], 1);
+          }
+      free (entries);
+    }
+  free_map_release (sector, 1);
+}
+
+/* Releases all of the sectors that DISK's data occupies. */
+static void
+release_data (const struct inode_disk *disk)
+{
+  size_t i;
+
+  for (i = 0; i < DIRECT_CNT; i++)
+    if (disk->direct[i] != 0)
+      free_map_release (disk->direct[i], 1);
+  release_index (disk->indirect, 1);
+  release_index (disk->doubly_indirect, 2);
+}
+
+/* In-memory inodes, keyed by sector, so that opening a single
+   inode twice returns the same `struct inode'.
+
+   The table holds every open inode and also up to CLOSED_MAX
+   inodes that have been closed by all of their openers, kept in
+   closed_inodes with the most recently closed first.  Reopening
+   one of those needs neither a memory allocation nor a read of
+   its inode sector.  Inodes of removed files are freed as soon as
+   they are closed.
+
+   inode_table_lock protects the table, closed_inodes,
+   closed_cnt, and every inode's open_cnt and removed. */
+static struct hash inode_table;
+static struct list closed_inodes;
+static size_t closed_cnt;
+static struct lock inode_table_lock;
+
+/* Returns a hash value for inode E. */
+static unsigned
+inode_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  return hash_int (hash_entry (e, struct inode, hash_elem)->sector);
+}
+
+/* Returns true if inode A's sector precedes inode B's. */
+static bool
+inode_less (const struct hash_elem *a, const struct hash_elem *b,
+            void *aux UNUSED)
+{
+  return (hash_entry (a, struct inode, hash_elem)->sector
+          < hash_entry (b, struct inode, hash_elem)->sector);
+}
 
 /* Initializes the inode module. */
 void
 inode_init (void) 
 {
-  list_init (&open_inodes);
+  if (!hash_init (&inode_table, inode_hash, inode_less, NULL))
+    PANIC ("can't allocate inode table");
+  list_init (&closed_inodes);
+  lock_init (&inode_table_lock);
+}
+
+/* Returns the in-memory inode for SECTOR with its open count
+   incremented, or a null pointer if there is none.  The caller
+   must hold inode_table_lock. */
+static struct inode *
+lookup_open (block_sector_t sector)
+{
+  struct inode key;
+  struct hash_elem *e;
+  struct inode *inode;
+
+  key.sector = sector;
+  e = hash_find (&inode_table, &key.hash_elem);
+  if (e == NULL)
+    return NULL;
+
+  inode = hash_entry (e, struct inode, hash_elem);
+  if (inode->open_cnt++ == 0)
+    {
+      list_remove (&inode->closed_elem);
+      closed_cnt--;
+    }
+  return inode;
+}
+
+/* Frees INODE, which has been removed from inode_table, and, if
+   it has been removed from the file system, its sectors. */
+static void
+free_inode (struct inode *inode)
+{
+  dir_index_destroy (inode->dir_index);
+
+  /* Deallocate blocks if removed. */
+  if (inode->removed) 
+    {
+      journal_begin ();
+      free_map_release (inode->sector, 1);
+      release_data (&inode->data);
+      journal_end ();
+    }
+
+  free (inode); 
 }
 
 /* Initializes an inode with LENGTH bytes of data and
    writes the new inode to sector SECTOR on the file system
-   device.
+   device.  The inode is for a directory if IS_DIR is true, for
+   an ordinary file otherwise.  The data sectors are allocated
+   and zeroed now, so that writing within the initial length
+   never needs to allocate; sectors beyond it are allocated as
+   the file grows.
    Returns true if successful.
-   Returns false if memory or disk allocation fails. */
+   Returns false if memory or disk allocation fails.
+
+   The allocation is part of the caller's journal operation, so
+   LENGTH must be small, as for a new directory.  Use
+   inode_extend() to give a file a larger initial length. */
 bool
-inode_create (block_sector_t sector, off_t length)
+inode_create (block_sector_t sector, off_t length, bool is_dir)
 {
   struct inode_disk *inode_disk = NULL;
   bool success = false;
@@ -81,25 +429,28 @@ inode_create (block_sector_t sector, off_t length)
      one sector in size, and you should fix that. */
   ASSERT (sizeof *inode_disk == BLOCK_SECTOR_SIZE);
 
+  if (length > MAX_LENGTH)
+    return false;
+
   inode_disk = calloc (1, sizeof *inode_disk);
   if (inode_disk != NULL)
     {
-      size_t sectors = bytes_to_sectors (length);
+      bool changed = false;
+
+      journal_begin ();
       inode_disk->length = length;
       inode_disk->magic = INODE_MAGIC;
-      if (free_map_allocate (sectors, &inode_disk->start)) 
-        {
-          block_write (fs_device, sector, inode_disk);
-          if (sectors > 0) 
-            {
-              static char zeros[BLOCK_SECTOR_SIZE];
-              size_t i;
-              
-              for (i = 0; i < sectors; i++) 
-                block_write (fs_device, inode_disk->start + i, zeros);
-            }
-          success = true; 
-        } 
+      inode_disk->is_dir = is_dir;
+      success = (length == 0
+                 || allocate_range (inode_disk, sector, 0,
+                                    bytes_to_sectors (length) - 1,
+                                    &changed));
+
+      if (success)
+        journal_write (sector, inode_disk, 0, BLOCK_SECTOR_SIZE);
+      else
+        release_data (inode_disk);
+      journal_end ();
       free (inode_disk);
     }
   return success;
@@ -111,33 +462,43 @@ inode_create (block_sector_t sector, off_t length)
 struct inode *
 inode_open (block_sector_t sector)
 {
-  struct list_elem *e;
-  struct inode *inode;
+  struct inode *inode, *other;
 
-  /* Check whether this inode is already open. */
-  for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
-       e = list_next (e)) 
-    {
-      inode = list_entry (e, struct inode, elem);
-      if (inode->sector == sector) 
-        {
-          inode_reopen (inode);
-          return inode; 
-        }
-    }
+  /* Check whether this inode is already in memory. */
+  lock_acquire (&inode_table_lock);
+  inode = lookup_open (sector);
+  lock_release (&inode_table_lock);
+  if (inode != NULL)
+    return inode;
 
   /* Allocate memory. */
   inode = malloc (sizeof *inode);
   if (inode == NULL)
     return NULL;
 
-  /* Initialize. */
-  list_push_front (&open_inodes, &inode->elem);
+  /* Initialize.  The inode sector is read without holding
+     inode_table_lock, so another thread may open the same inode
+     meanwhile, in which case we use that one instead. */
   inode->sector = sector;
   inode->open_cnt = 1;
   inode->deny_write_cnt = 0;
   inode->removed = false;
-  block_read (fs_device, inode->sector, &inode->data);
+  lock_init (&inode->dir_lock);
+  inode->dir_index = NULL;
+  lock_init (&inode->lock);
+  cache_read (inode->sector, &inode->data, 0, BLOCK_SECTOR_SIZE);
+
+  lock_acquire (&inode_table_lock);
+  other = lookup_open (sector);
+  if (other == NULL)
+    hash_insert (&inode_table, &inode->hash_elem);
+  lock_release (&inode_table_lock);
+
+  if (other != NULL)
+    {
+      free (inode);
+      inode = other;
+    }
   return inode;
 }
 
@@ -146,7 +507,12 @@ struct inode *
 inode_reopen (struct inode *inode)
 {
   if (inode != NULL)
-    inode->open_cnt++;
+    {
+      lock_acquire (&inode_table_lock);
+      ASSERT (inode->open_cnt > 0);
+      inode->open_cnt++;
+      lock_release (&inode_table_lock);
+    }
   return inode;
 }
 
@@ -158,8 +524,10 @@ inode_get_inumber (const struct inode *inode)
 }
 
 /* Closes INODE and writes it to disk.
-   If this was the last reference to INODE, frees its memory.
-   If INODE was also a removed inode, frees its blocks. */
+   If this was the last reference to INODE and INODE was removed,
+   frees its memory and its blocks.  Otherwise, INODE stays in
+   memory until CLOSED_MAX other inodes have been closed, in case
+   it is reopened. */
 void
 inode_close (struct inode *inode) 
 {
@@ -167,22 +535,34 @@ inode_close (struct inode *inode)
   if (inode == NULL)
     return;
 
-  /* Release resources if this was the last opener. */
+  /* If this was the last opener, keep the inode among the
+     recently closed ones, unless it has been removed, and free
+     the least recently closed inode if there are too many. */
+  lock_acquire (&inode_table_lock);
   if (--inode->open_cnt == 0)
     {
-      /* Remove from inode list and release lock. */
-      list_remove (&inode->elem);
- 
-      /* Deallocate blocks if removed. */
-      if (inode->removed) 
+      if (!inode->removed)
         {
-          free_map_release (inode->sector, 1);
-          free_map_release (inode->data.start,
-                            bytes_to_sectors (inode->data.length)); 
+          list_push_front (&closed_inodes, &inode->closed_elem);
+          if (++closed_cnt <= CLOSED_MAX)
+            inode = NULL;
+          else
+            {
+              inode = list_entry (list_pop_back (&closed_inodes),
+                                  struct inode, closed_elem);
+              closed_cnt--;
+            }
         }
-
-      free (inode); 
+      if (inode != NULL)
+        hash_delete (&inode_table, &inode->hash_elem);
     }
+  else
+    inode = NULL;
+  lock_release (&inode_table_lock);
+
+  /* Release resources. */
+  if (inode != NULL)
+    free_inode (inode);
 }
 
 /* Marks INODE to be deleted when it is closed by the last caller who
@@ -191,7 +571,29 @@ void
 inode_remove (struct inode *inode) 
 {
   ASSERT (inode != NULL);
+  lock_acquire (&inode_table_lock);
   inode->removed = true;
+  lock_release (&inode_table_lock);
+}
+
+/* Returns true if INODE has been marked for removal. */
+bool
+inode_is_removed (const struct inode *inode)
+{
+  bool removed;
+
+  lock_acquire (&inode_table_lock);
+  removed = inode->removed;
+  lock_release (&inode_table_lock);
+  return removed;
+}
+
+/* Returns true if INODE is a directory, false if it is an
+   ordinary file. */
+bool
+inode_is_dir (const struct inode *inode)
+{
+  return inode->data.is_dir != 0;
 }
 
 /* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
@@ -202,41 +604,39 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
 {
   uint8_t *buffer = buffer_;
   off_t bytes_read = 0;
-  uint8_t *bounce = NULL;
 
   while (size > 0) 
     {
-      /* Disk sector to read, starting byte offset within sector. */
-      block_sector_t sector_idx = byte_to_sector (inode, offset);
-      int sector_ofs = offset % BLOCK_SECTOR_SIZE;
-
-      /* Bytes left in inode, bytes left in sector, lesser of the two. */
-      off_t inode_left = inode_length (inode) - offset;
-      int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
-      int min_left = inode_left < sector_left ? inode_left : sector_left;
+      block_sector_t sector_idx;
+      int sector_ofs, sector_left, min_left, chunk_size;
+      off_t inode_left;
+
+      /* Disk sector to read, starting byte offset within sector,
+         and bytes left in inode.  A writer extends the file only
+         after writing its new data, so the sector holds at least
+         INODE_LEFT bytes of valid data even after the lock is
+         released. */
+      lock_acquire (&inode->lock);
+      sector_idx = byte_to_sector (&inode->data, offset);
+      inode_left = inode->data.length - offset;
+      lock_release (&inode->lock);
+      sector_ofs = offset % BLOCK_SECTOR_SIZE;
+
+      /* Bytes left in sector, lesser of the two. */
+      sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
+      min_left = inode_left < sector_left ? inode_left : sector_left;
 
       /* Number of bytes to actually copy out of this sector. */
-      int chunk_size = size < min_left ? size : min_left;
+      chunk_size = size < min_left ? size : min_left;
       if (chunk_size <= 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
+      if (sector_idx != 0)
+        cache_read (sector_idx, buffer + bytes_read, sector_ofs, chunk_size);
+      else
         {
-          /* Read full sector directly into caller's buffer. */
-          block_read (fs_device, sector_idx, buffer + bytes_read);
-        }
-      else 
-        {
-          /* Read sector into bounce buffer, then partially copy
-             into caller's buffer. */
-          if (bounce == NULL) 
-            {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
-            }
-          block_read (fs_device, sector_idx, bounce);
-          memcpy (buffer + bytes_read, bounce + sector_ofs, chunk_size);
+          /* Hole in a sparse file. */
+          memset (buffer + bytes_read, 0, chunk_size);
         }
       
       /* Advance. */
@@ -244,86 +644,203 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       offset += chunk_size;
       bytes_read += chunk_size;
     }
-  free (bounce);
 
   return bytes_read;
 }
 
-/* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
-   Returns the number of bytes actually written, which may be
-   less than SIZE if end of file is reached or an error occurs.
-   (Normally a write at end of file would extend the inode, but
-   growth is not yet implemented.) */
-off_t
-inode_write_at (struct inode *inode, const void *buffer_, off_t size,
-                off_t offset) 
+/* Starts reading the sectors that hold SIZE bytes of INODE,
+   starting at position OFFSET, into the cache in the background,
+   in anticipation of their being read soon.  Bytes past end of
+   file are ignored. */
+void
+inode_read_ahead (struct inode *inode, off_t size, off_t offset)
 {
-  const uint8_t *buffer = buffer_;
+  off_t end = offset + size;
+
+  lock_acquire (&inode->lock);
+  if (end > inode->data.length)
+    end = inode->data.length;
+  for (offset = ROUND_DOWN (offset, BLOCK_SECTOR_SIZE); offset < end;
+       offset += BLOCK_SECTOR_SIZE)
+    {
+      block_sector_t sector = byte_to_sector (&inode->data, offset);
+      if (sector != 0)
+        cache_read_ahead (sector);
+    }
+  lock_release (&inode->lock);
+}
+
+/* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET,
+   as one journal operation.  SIZE must not exceed WRITE_CHUNK.
+   Returns the number of bytes actually written, as for
+   inode_write_at().  The caller must hold INODE's lock. */
+static off_t
+write_chunk (struct inode *inode, const uint8_t *buffer, off_t size,
+             off_t offset)
+{
+  bool meta = is_metadata (&inode->data, inode->sector);
   off_t bytes_written = 0;
-  uint8_t *bounce = NULL;
+  bool changed = false;
 
-  if (inode->deny_write_cnt)
-    return 0;
+  ASSERT (size <= WRITE_CHUNK);
+  ASSERT (lock_held_by_current_thread (&inode->lock));
+
+  if (size > 0 && offset < MAX_LENGTH)
+    {
+      /* Allocate the sectors to be written.  When a file that is
+         already several sectors long grows, round the allocation
+         up to a multiple of PREALLOC_SECTORS, so that files
+         appended to a little at a time, perhaps several at once,
+         still get long extents.  Directories grow a sector at a
+         time, which keeps their journal operations small.
+         Writing stops at the first sector that could not be
+         allocated. */
+      size_t first = offset / BLOCK_SECTOR_SIZE;
+      size_t last = (offset + size - 1) / BLOCK_SECTOR_SIZE;
+
+      if (offset + size > inode->data.length && !meta
+          && last + 1 >= PREALLOC_SECTORS)
+        last = ROUND_UP (last + 1, PREALLOC_SECTORS) - 1;
+      if (last >= MAX_SECTORS)
+        last = MAX_SECTORS - 1;
+      allocate_range (&inode->data, inode->sector, first, last, &changed);
+    }
 
   while (size > 0) 
     {
       /* Sector to write, starting byte offset within sector. */
-      block_sector_t sector_idx = byte_to_sector (inode, offset);
+      block_sector_t sector_idx = byte_to_sector (&inode->data, offset);
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
 
-      /* Bytes left in inode, bytes left in sector, lesser of the two. */
-      off_t inode_left = inode_length (inode) - offset;
+      /* Bytes left in sector. */
       int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
-      int min_left = inode_left < sector_left ? inode_left : sector_left;
 
       /* Number of bytes to actually write into this sector. */
-      int chunk_size = size < min_left ? size : min_left;
-      if (chunk_size <= 0)
+      int chunk_size = size < sector_left ? size : sector_left;
+      if (sector_idx == 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
-        {
-          /* Write full sector directly to disk. */
-          block_write (fs_device, sector_idx, buffer + bytes_written);
-        }
-      else 
-        {
-          /* We need a bounce buffer. */
-          if (bounce == NULL) 
-            {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
-            }
-
-          /* If the sector contains data before or after the chunk
-             we're writing, then we need to read in the sector
-             first.  Otherwise we start with a sector of all zeros. */
-          if (sector_ofs > 0 || chunk_size < sector_left) 
-            block_read (fs_device, sector_idx, bounce);
-          else
-            memset (bounce, 0, BLOCK_SECTOR_SIZE);
-          memcpy (bounce + sector_ofs, buffer + bytes_written, chunk_size);
-          block_write (fs_device, sector_idx, bounce);
-        }
+      if (meta)
+        journal_write (sector_idx, buffer + bytes_written, sector_ofs,
+                       chunk_size);
+      else
+        cache_write (sector_idx, buffer + bytes_written, sector_ofs,
+                     chunk_size);
 
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_written += chunk_size;
     }
-  free (bounce);
+
+  /* Extend the file only after its new data is in place, so
+     that nobody can read the new bytes before they are
+     written. */
+  if (bytes_written > 0 && offset > inode->data.length)
+    {
+      inode->data.length = offset;
+      changed = true;
+    }
+  if (changed)
+    journal_write (inode->sector, &inode->data, 0, BLOCK_SECTOR_SIZE);
+
+  return bytes_written;
+}
+
+/* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
+   Extends INODE if the write ends past end of file, allocating
+   sectors as needed; a gap between the old end of file and
+   OFFSET reads as zeros.
+   Returns the number of bytes actually written, which may be
+   less than SIZE if the disk fills up or the file reaches its
+   maximum size.
+
+   A large write is done as a series of journal operations of up
+   to WRITE_CHUNK bytes each, so that no single operation changes
+   more than a few index and free map sectors. */
+off_t
+inode_write_at (struct inode *inode, const void *buffer_, off_t size,
+                off_t offset) 
+{
+  const uint8_t *buffer = buffer_;
+  off_t bytes_written = 0;
+
+  while (size > 0)
+    {
+      off_t chunk = size < WRITE_CHUNK ? size : WRITE_CHUNK;
+      off_t written = 0;
+
+      /* The journal operation must start before the lock is
+         taken, since starting one may wait for a commit. */
+      journal_begin ();
+      lock_acquire (&inode->lock);
+      if (!inode->deny_write_cnt)
+        written = write_chunk (inode, buffer + bytes_written, chunk, offset);
+      lock_release (&inode->lock);
+      journal_end ();
+
+      size -= written;
+      offset += written;
+      bytes_written += written;
+      if (written < chunk)
+        break;
+    }
 
   return bytes_written;
 }
 
+/* Extends INODE to LENGTH bytes, if it is shorter, allocating
+   and zeroing the new data sectors as inode_create() does.  Like
+   inode_write_at(), works in journal operations of up to
+   WRITE_CHUNK bytes each, so LENGTH may be as large as a file
+   can be.  Returns true if successful, false if LENGTH is too
+   large or the disk fills up, in which case INODE may have been
+   extended part of the way. */
+bool
+inode_extend (struct inode *inode, off_t length)
+{
+  bool success = length <= MAX_LENGTH;
+
+  while (success)
+    {
+      bool changed = false;
+      off_t start, end;
+
+      journal_begin ();
+      lock_acquire (&inode->lock);
+      start = inode->data.length;
+      end = length - start > WRITE_CHUNK ? start + WRITE_CHUNK : length;
+      if (start < end)
+        {
+          success = allocate_range (&inode->data, inode->sector,
+                                    start / BLOCK_SECTOR_SIZE,
+                                    (end - 1) / BLOCK_SECTOR_SIZE, &changed);
+          if (success)
+            {
+              inode->data.length = end;
+              changed = true;
+            }
+          if (changed)
+            journal_write (inode->sector, &inode->data, 0, BLOCK_SECTOR_SIZE);
+        }
+      lock_release (&inode->lock);
+      journal_end ();
+
+      if (end >= length)
+        break;
+    }
+  return success;
+}
+
 /* Disables writes to INODE.
    May be called at most once per inode opener. */
 void
 inode_deny_write (struct inode *inode) 
 {
+  lock_acquire (&inode->lock);
   inode->deny_write_cnt++;
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
+  lock_release (&inode->lock);
 }
 
 /* Re-enables writes to INODE.
@@ -332,9 +849,11 @@ inode_deny_write (struct inode *inode)
 void
 inode_allow_write (struct inode *inode) 
 {
+  lock_acquire (&inode->lock);
   ASSERT (inode->deny_write_cnt > 0);
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
   inode->deny_write_cnt--;
+  lock_release (&inode->lock);
 }
 
 /* Returns the length, in bytes, of INODE's data. */
@@ -343,3 +862,61 @@ inode_length (const struct inode *inode)
 {
   return inode->data.length;
 }
+
+/* Returns the number of extents, that is, maximal runs of
+   consecutive sectors, that INODE's data occupies on disk.
+   Holes do not count. */
+size_t
+inode_extent_cnt (struct inode *inode)
+{
+  size_t sector_cnt;
+  block_sector_t prev = 0;
+  size_t extent_cnt = 0;
+  size_t idx;
+
+  lock_acquire (&inode->lock);
+  sector_cnt = bytes_to_sectors (inode->data.length);
+  for (idx = 0; idx < sector_cnt; idx++)
+    {
+      block_sector_t sector = map_sector (&inode->data, idx, 0, NULL);
+      if (sector != 0 && (prev == 0 || sector != prev + 1))
+        extent_cnt++;
+      prev = sector;
+    }
+  lock_release (&inode->lock);
+  return extent_cnt;
+}
+
+/* Acquires directory INODE's lock, which serializes operations
+   on its entries.  See directory.c. */
+void
+inode_lock_dir (struct inode *inode)
+{
+  lock_acquire (&inode->dir_lock);
+}
+
+/* Releases directory INODE's lock. */
+void
+inode_unlock_dir (struct inode *inode)
+{
+  lock_release (&inode->dir_lock);
+}
+
+/* Returns the index of INODE's directory entries, if INODE is a
+   directory and one has been built, otherwise a null pointer.
+   The caller must hold INODE's directory lock.  See
+   directory.c. */
+struct dir_index *
+inode_get_dir_index (const struct inode *inode)
+{
+  return inode->dir_index;
+}
+
+/* Sets INDEX as the index of directory INODE's entries.  INODE
+   takes ownership of INDEX and frees it when INODE is freed.
+   The caller must hold INODE's directory lock. */
+void
+inode_set_dir_index (struct inode *inode, struct dir_index *index)
+{
+  inode->dir_index = index;
+}
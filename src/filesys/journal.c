@@ -0,0 +1,478 @@
+#include "filesys/journal.h"
+#include <debug.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "filesys/cache.h"
+#include "filesys/filesys.h"
+#include "filesys/free-map.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Metadata journal.
+
+   A file system operation such as creating a file changes
+   several metadata sectors: the free map, the new inode, and the
+   directory that gets the new entry.  If only some of those
+   changes reached the disk before a crash, sectors would be
+   leaked or directory entries left dangling.  The journal makes
+   each operation atomic by writing the metadata sectors it
+   changes to a reserved region of the disk, the log, before any
+   of them is written to its real location.
+
+   Operations.  Code that changes metadata brackets the change
+   with journal_begin() and journal_end() and makes the change
+   with journal_write() or journal_zero() instead of
+   cache_write() or cache_zero().  Operations nest, so an
+   operation can be made up of smaller ones that are also used
+   alone.  File data is not journaled.
+
+   Transactions.  Every sector changed by an operation joins the
+   running transaction and is "held" in the sector cache, which
+   means that the cache never writes it back, until the
+   transaction commits.  Many operations share a transaction: it
+   commits only when it has grown so large that another operation
+   might not fit in the cache, every COMMIT_INTERVAL ticks, and
+   at shutdown.  Committing such a group of operations at once
+   writes each sector they changed to the log only once, however
+   many times it was changed.
+
+   Commit.  Once no operation is in progress, the transaction is
+   written to the log as a descriptor sector that lists the
+   sectors in the transaction, the sectors' contents, and a
+   commit sector.  Writes are synchronous, so once the commit
+   sector is on disk the whole transaction is.  The sectors are
+   then released, and the cache writes them back in due course.
+
+   Checkpoints.  The log is reused from the start after every
+   sector logged so far has been written back to its real
+   location, which cache_flush() does.  The header in the
+   journal's first sector gives the sequence number of the first
+   transaction in the log; older records left further on in the
+   log carry smaller sequence numbers and are ignored.
+
+   Recovery.  journal_init() replays every committed transaction
+   in the log, in order, by copying its sectors to their real
+   locations, before anything else reads the file system.
+
+   Released sectors.  Until the transaction that releases a
+   sector commits, a crash would leave the sector in use, so the
+   free map does not hand it out again before then; see
+   free-map.c.  And since replaying the log would overwrite a
+   released sector with whatever was logged for it, a commit
+   that releases a sector logged since the last checkpoint is
+   followed by a checkpoint. */
+
+/* Magic numbers. */
+#define HEADER_MAGIC 0x4c4e524a         /* "JRNL" */
+#define DESC_MAGIC 0x43534544           /* "DESC" */
+#define COMMIT_MAGIC 0x54494d43         /* "CMIT" */
+
+/* Largest number of sectors in a transaction.  Held sectors stay
+   in the cache, so this is the size of the cache. */
+#define TXN_MAX 64
+
+/* Sectors that a transaction may reach before new operations must
+   wait for it to commit, leaving the rest of the cache for
+   everything else. */
+#define TXN_LIMIT (TXN_MAX / 2)
+
+/* Sectors reserved for each operation in progress: an estimate
+   of how many sectors one operation changes.  Most change fewer;
+   making a directory in a directory that must grow changes about
+   ten. */
+#define OP_CREDITS 8
+
+/* Ticks between commits. */
+#define COMMIT_INTERVAL (5 * TIMER_FREQ)
+
+/* Number of sector numbers in a descriptor. */
+#define DESC_CNT ((BLOCK_SECTOR_SIZE - 3 * sizeof (uint32_t)) \
+                  / sizeof (block_sector_t))
+
+/* Journal header, descriptor, or commit sector. */
+struct journal_block
+  {
+    uint32_t magic;                     /* One of the magic numbers. */
+    uint32_t seq;                       /* Transaction sequence number. */
+    uint32_t cnt;                       /* Number of sectors. */
+    block_sector_t sectors[DESC_CNT];   /* Sectors, in a descriptor. */
+  };
+
+/* Is the journal in use? */
+static bool active;
+
+/* Protects the variables below. */
+static struct lock journal_lock;
+
+/* Signaled when an operation ends or a commit completes. */
+static struct condition journal_changed;
+
+static int op_cnt;                      /* Operations in progress. */
+static bool committing;                 /* Commit in progress? */
+static bool commit_wanted;              /* journal_commit() waiting? */
+
+/* Running transaction. */
+static block_sector_t txn_sectors[TXN_MAX];  /* Sectors changed. */
+static size_t txn_cnt;                  /* Number of sectors. */
+static size_t txn_op_cnt;               /* Operations in it. */
+
+/* Log.  Used only by the committing thread. */
+static uint32_t next_seq;               /* Next transaction's number. */
+static size_t log_pos;                  /* Next free log sector. */
+static block_sector_t logged[JOURNAL_SECTORS];  /* Sectors logged... */
+static size_t logged_cnt;               /* ...since last checkpoint. */
+static struct journal_block desc_block;
+static uint8_t sector_buf[BLOCK_SECTOR_SIZE];
+
+/* A transaction's descriptor followed by its sectors, as written
+   to the log. */
+static uint8_t log_buf[(TXN_MAX + 1) * BLOCK_SECTOR_SIZE];
+
+/* Statistics. */
+static unsigned long long txn_total;    /* Transactions committed. */
+static unsigned long long op_total;     /* Operations committed. */
+static unsigned long long logged_total; /* Sectors written to the log. */
+static unsigned long long checkpoint_cnt;  /* Checkpoints. */
+static unsigned long long replay_cnt;   /* Transactions replayed. */
+
+static thread_func commit_daemon NO_RETURN;
+
+/* Writes a journal header that starts the log with transaction
+   SEQ. */
+static void
+write_header (uint32_t seq)
+{
+  memset (&desc_block, 0, sizeof desc_block);
+  desc_block.magic = HEADER_MAGIC;
+  desc_block.seq = seq;
+  block_write (fs_device, JOURNAL_SECTOR, &desc_block);
+}
+
+/* Creates an empty journal on a newly formatted file system. */
+void
+journal_create (void)
+{
+  ASSERT (sizeof (struct journal_block) == BLOCK_SECTOR_SIZE);
+
+  write_header (1);
+
+  /* Erase anything left in the log by an earlier file system. */
+  memset (sector_buf, 0, sizeof sector_buf);
+  block_write (fs_device, JOURNAL_SECTOR + 1, sector_buf);
+}
+
+/* Replays every committed transaction in the log. */
+static void
+replay (void)
+{
+  static struct journal_block commit_block;
+  size_t pos = 1;
+
+  for (;;)
+    {
+      size_t cnt, i;
+
+      /* Read the descriptor and the commit sector.  If either is
+         missing or doesn't match, the transaction never
+         committed, and nothing after it did either. */
+      if (pos + 2 > JOURNAL_SECTORS)
+        break;
+      block_read (fs_device, JOURNAL_SECTOR + pos, &desc_block);
+      cnt = desc_block.cnt;
+      if (desc_block.magic != DESC_MAGIC || desc_block.seq != next_seq
+          || cnt > DESC_CNT || pos + cnt + 2 > JOURNAL_SECTORS)
+        break;
+      block_read (fs_device, JOURNAL_SECTOR + pos + cnt + 1, &commit_block);
+      if (commit_block.magic != COMMIT_MAGIC
+          || commit_block.seq != next_seq || commit_block.cnt != cnt)
+        break;
+
+      /* Copy the sectors to their real locations. */
+      for (i = 0; i < cnt; i++)
+        {
+          block_read (fs_device, JOURNAL_SECTOR + pos + 1 + i, sector_buf);
+          block_write (fs_device, desc_block.sectors[i], sector_buf);
+        }
+
+      pos += cnt + 2;
+      next_seq++;
+      replay_cnt++;
+    }
+}
+
+/* Initializes the journal, replaying any transactions that were
+   committed before the file system was last shut down, and
+   starts journaling metadata changes. */
+void
+journal_init (void)
+{
+  lock_init (&journal_lock);
+  cond_init (&journal_changed);
+
+  block_read (fs_device, JOURNAL_SECTOR, &desc_block);
+  if (desc_block.magic != HEADER_MAGIC)
+    PANIC ("no journal found--reformat the file system with -f");
+  next_seq = desc_block.seq;
+
+  replay ();
+  if (replay_cnt > 0)
+    printf ("Replayed %llu journal transactions.\n", replay_cnt);
+
+  /* The replayed sectors are on disk, so start the log over. */
+  write_header (next_seq);
+  log_pos = 1;
+
+  active = true;
+  thread_create ("journal", PRI_DEFAULT, commit_daemon, NULL);
+}
+
+/* Commits the running transaction and stops journaling. */
+void
+journal_done (void)
+{
+  if (!active)
+    return;
+
+  journal_commit ();
+  lock_acquire (&journal_lock);
+  active = false;
+  lock_release (&journal_lock);
+}
+
+/* Returns true if metadata changes are being journaled. */
+bool
+journal_active (void)
+{
+  return active;
+}
+
+/* Returns true if the running transaction has room for one more
+   operation.  The caller must hold journal_lock. */
+static bool
+has_room (void)
+{
+  return txn_cnt + (op_cnt + 1) * OP_CREDITS <= TXN_LIMIT;
+}
+
+static void commit (void);
+
+/* Starts an operation that changes metadata, which must be
+   finished with journal_end().  Operations may nest, in which
+   case only the outermost counts. */
+void
+journal_begin (void)
+{
+  struct thread *t = thread_current ();
+
+  if (!active || t->journal_depth++ > 0)
+    return;
+
+  lock_acquire (&journal_lock);
+  while (committing || commit_wanted || !has_room ())
+    {
+      if (!committing && op_cnt == 0 && txn_cnt > 0)
+        commit ();
+      else
+        cond_wait (&journal_changed, &journal_lock);
+    }
+  op_cnt++;
+  txn_op_cnt++;
+  lock_release (&journal_lock);
+}
+
+/* Finishes an operation started with journal_begin().  Its
+   changes commit along with the rest of the running
+   transaction. */
+void
+journal_end (void)
+{
+  struct thread *t = thread_current ();
+
+  if (!active)
+    return;
+  ASSERT (t->journal_depth > 0);
+  if (--t->journal_depth > 0)
+    return;
+
+  lock_acquire (&journal_lock);
+  op_cnt--;
+  cond_broadcast (&journal_changed, &journal_lock);
+  lock_release (&journal_lock);
+}
+
+/* Adds SECTOR to the running transaction, holding it in the
+   cache until the transaction commits. */
+static void
+add_sector (block_sector_t sector)
+{
+  size_t i;
+
+  ASSERT (thread_current ()->journal_depth > 0);
+
+  lock_acquire (&journal_lock);
+  for (i = 0; i < txn_cnt; i++)
+    if (txn_sectors[i] == sector)
+      break;
+  if (i == txn_cnt)
+    {
+      ASSERT (txn_cnt < TXN_MAX);
+      txn_sectors[txn_cnt++] = sector;
+      cache_hold (sector);
+    }
+  lock_release (&journal_lock);
+}
+
+/* Writes SIZE bytes from BUFFER into metadata sector SECTOR,
+   starting at byte offset OFS within the sector, as part of the
+   current operation. */
+void
+journal_write (block_sector_t sector, const void *buffer,
+               size_t ofs, size_t size)
+{
+  if (active)
+    add_sector (sector);
+  cache_write (sector, buffer, ofs, size);
+}
+
+/* Fills newly allocated metadata sector SECTOR with zeros, as
+   part of the current operation. */
+void
+journal_zero (block_sector_t sector)
+{
+  /* Zeroing first saves reading SECTOR from disk just to hold
+     it.  Should the zeros be written back before SECTOR is held,
+     no harm is done, since SECTOR was free until now. */
+  cache_zero (sector);
+  if (active)
+    add_sector (sector);
+}
+
+/* Starts over at the beginning of the log, after writing every
+   sector logged so far back to its real location.  Only the
+   committing thread may call this. */
+static void
+checkpoint (void)
+{
+  cache_flush ();
+  write_header (next_seq);
+  log_pos = 1;
+  logged_cnt = 0;
+  checkpoint_cnt++;
+}
+
+/* Returns true if any sector logged since the last checkpoint
+   has been released by the transaction being committed. */
+static bool
+logged_released (void)
+{
+  size_t i;
+
+  for (i = 0; i < logged_cnt; i++)
+    if (free_map_pending (logged[i]))
+      return true;
+  return false;
+}
+
+/* Commits the running transaction.  The caller must hold
+   journal_lock, and no operation may be in progress. */
+static void
+commit (void)
+{
+  size_t cnt = txn_cnt;
+  size_t i;
+
+  ASSERT (lock_held_by_current_thread (&journal_lock));
+  ASSERT (op_cnt == 0 && !committing);
+
+  committing = true;
+  lock_release (&journal_lock);
+
+  if (cnt > 0)
+    {
+      /* Write the descriptor and the sectors together, then the
+         commit sector, which must not reach the disk first. */
+      memset (&desc_block, 0, sizeof desc_block);
+      desc_block.magic = DESC_MAGIC;
+      desc_block.seq = next_seq;
+      desc_block.cnt = cnt;
+      memcpy (desc_block.sectors, txn_sectors, cnt * sizeof *txn_sectors);
+      memcpy (log_buf, &desc_block, BLOCK_SECTOR_SIZE);
+      for (i = 0; i < cnt; i++)
+        {
+          cache_read (txn_sectors[i], log_buf + (i + 1) * BLOCK_SECTOR_SIZE,
+                      0, BLOCK_SECTOR_SIZE);
+          logged[logged_cnt++] = txn_sectors[i];
+        }
+      block_write_multi (fs_device, JOURNAL_SECTOR + log_pos, cnt + 1,
+                         log_buf);
+      desc_block.magic = COMMIT_MAGIC;
+      block_write (fs_device, JOURNAL_SECTOR + log_pos + cnt + 1,
+                   &desc_block);
+
+      /* Let the cache write the sectors back. */
+      for (i = 0; i < cnt; i++)
+        cache_release (txn_sectors[i]);
+
+      log_pos += cnt + 2;
+      next_seq++;
+      txn_total++;
+      op_total += txn_op_cnt;
+      logged_total += cnt + 2;
+
+      /* Make sure the next transaction fits in the log, and that
+         replaying the log cannot overwrite released sectors. */
+      if (log_pos + TXN_MAX + 2 > JOURNAL_SECTORS || logged_released ())
+        checkpoint ();
+    }
+
+  /* The sectors released by the transaction may be reused now. */
+  free_map_commit ();
+
+  lock_acquire (&journal_lock);
+  txn_cnt = 0;
+  txn_op_cnt = 0;
+  committing = false;
+  cond_broadcast (&journal_changed, &journal_lock);
+}
+
+/* Commits the running transaction, waiting for operations in
+   progress to finish first.  The caller must not be in an
+   operation itself. */
+void
+journal_commit (void)
+{
+  if (!active)
+    return;
+  ASSERT (thread_current ()->journal_depth == 0);
+
+  lock_acquire (&journal_lock);
+  commit_wanted = true;
+  while (committing || op_cnt > 0)
+    cond_wait (&journal_changed, &journal_lock);
+  commit_wanted = false;
+  if (txn_cnt > 0)
+    commit ();
+  lock_release (&journal_lock);
+}
+
+/* Journal thread.  Commits every COMMIT_INTERVAL ticks. */
+static void
+commit_daemon (void *aux UNUSED)
+{
+  for (;;)
+    {
+      timer_sleep (COMMIT_INTERVAL);
+      journal_commit ();
+    }
+}
+
+/* Prints journal statistics. */
+void
+journal_print_stats (void)
+{
+  printf ("Journal: %llu transactions of %llu operations, "
+          "%llu sectors logged, %llu checkpoints, %llu replayed\n",
+          txn_total, op_total, logged_total, checkpoint_cnt, replay_cnt);
+}
@@ -0,0 +1,21 @@
+#ifndef FILESYS_JOURNAL_H
+#define FILESYS_JOURNAL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "devices/block.h"
+
+void journal_create (void);
+void journal_init (void);
+void journal_done (void);
+bool journal_active (void);
+
+void journal_begin (void);
+void journal_end (void);
+void journal_write (block_sector_t, const void *, size_t ofs, size_t size);
+void journal_zero (block_sector_t);
+void journal_commit (void);
+
+void journal_print_stats (void);
+
+#endif /* filesys/journal.h */
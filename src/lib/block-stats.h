@@ -0,0 +1,48 @@
+#ifndef __LIB_BLOCK_STATS_H
+#define __LIB_BLOCK_STATS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Number of buckets in a latency histogram.  Bucket 0 counts
+   latencies under 2 microseconds, and bucket I > 0 counts those
+   from 2**I up to 2**(I+1) microseconds, except that the last
+   bucket also counts all longer ones. */
+#define BLOCK_HIST_CNT 20
+
+/* I/O statistics for a block device, as returned by the
+   block_stats() system call and printed at shutdown. */
+struct block_stats
+  {
+    char name[16];              /* Device name, e.g. "hda1". */
+    char type[8];               /* Type name, e.g. "filesys". */
+    uint32_t size;              /* Size in sectors. */
+    bool partition;             /* Part of another device? */
+
+    unsigned long long request_cnt;     /* Requests submitted. */
+    unsigned long long read_bytes;      /* Bytes read. */
+    unsigned long long write_bytes;     /* Bytes written. */
+
+    /* A "transfer" is a request to a partition, or a batch of
+       merged requests given to a device's driver.  A transfer is
+       sequential if it starts at the sector after the previous
+       one ended. */
+    unsigned long long transfer_cnt;    /* Transfers. */
+    unsigned long long seq_cnt;         /* Sequential transfers. */
+    unsigned long long seek_distance;   /* Total sectors between them. */
+
+    /* Requests submitted but not yet completed. */
+    unsigned in_flight;                 /* Right now. */
+    unsigned in_flight_max;             /* Most at once. */
+    unsigned long long depth_total;     /* Sum over arrivals, counting
+                                           the new request. */
+
+    /* Latencies, in microseconds.  "Wait" is the time a request
+       spends queued, "service" the time its driver takes. */
+    unsigned long long wait_usecs;      /* Total wait. */
+    unsigned long long service_usecs;   /* Total service. */
+    unsigned long long wait_hist[BLOCK_HIST_CNT];
+    unsigned long long service_hist[BLOCK_HIST_CNT];
+  };
+
+#endif /* lib/block-stats.h */
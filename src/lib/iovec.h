@@ -0,0 +1,17 @@
+#ifndef __LIB_IOVEC_H
+#define __LIB_IOVEC_H
+
+#include <stddef.h>
+
+/* One buffer in a vectored read or write, for readv() and
+   writev(). */
+struct iovec
+  {
+    void *iov_base;             /* Start of buffer. */
+    size_t iov_len;             /* Size of buffer, in bytes. */
+  };
+
+/* Maximum number of buffers in one vectored read or write. */
+#define IOV_MAX 16
+
+#endif /* lib/iovec.h */
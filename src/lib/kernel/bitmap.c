@@ -359,6 +359,33 @@ bitmap_write (const struct bitmap *b, struct file *file)
   off_t size = byte_cnt (b->bit_cnt);
   return file_write_at (file, b->bits, size, 0) == size;
 }
+
+/* Writes the part of B's file image that holds bits START
+   through START + CNT - 1 to FILE, rounded out to whole multiples
+   of UNIT bytes, so that a caller that tracks FILE in units of
+   disk sectors rewrites only the sectors that changed.  Returns
+   true if successful, false otherwise. */
+bool
+bitmap_write_part (const struct bitmap *b, struct file *file,
+                   size_t start, size_t cnt, size_t unit)
+{
+  off_t size = byte_cnt (b->bit_cnt);
+  off_t first, last;
+
+  ASSERT (start <= b->bit_cnt);
+  ASSERT (cnt <= b->bit_cnt - start);
+  ASSERT (unit > 0);
+
+  if (cnt == 0)
+    return true;
+  first = start / CHAR_BIT / unit * unit;
+  last = ((start + cnt - 1) / CHAR_BIT / unit + 1) * unit;
+  if (last > size)
+    last = size;
+  return (file_write_at (file, (uint8_t *) b->bits + first, last - first,
+                         first)
+          == last - first);
+}
 #endif /* FILESYS */
 
 /* Debugging. */
@@ -6,8 +6,10 @@
    See hash.h for basic information. */
 
 #include "hash.h"
+#include <string.h>
 #include "../debug.h"
 #include "threads/malloc.h"
+#include "threads/vaddr.h"
 
 #define list_elem_to_hash_elem(LIST_ELEM)                       \
         list_entry(LIST_ELEM, struct hash_elem, list_elem)
@@ -257,50 +259,160 @@ hash_empty (struct hash *h)
   return h->elem_cnt == 0;
 }
 
-/* Fowler-Noll-Vo hash constants, for 32-bit word sizes. */
-#define FNV_32_PRIME 16777619u
-#define FNV_32_BASIS 2166136261u
+/* The sample hash functions below follow MurmurHash3: the input
+   is consumed a 32-bit word at a time, each word is scrambled and
+   folded into the running hash, and a finalizer spreads every
+   input bit across every output bit.  The finalizer matters most
+   because the table only uses the low bits of the hash to pick a
+   bucket, and keys such as sector numbers or page addresses
+   differ only in a few bits. */
+
+/* Scrambling constants. */
+#define MIX_C1 0xcc9e2d51u
+#define MIX_C2 0x1b873593u
+
+/* Seed for the running hash. */
+#define HASH_SEED 0x9747b28cu
+
+/* Returns X rotated left by R bits. */
+static inline uint32_t
+rotl32 (uint32_t x, int r)
+{
+  return (x << r) | (x >> (32 - r));
+}
+
+/* Returns the 4 bytes at P, in host byte order, wherever P points. */
+static inline uint32_t
+load_word (const unsigned char *p)
+{
+  uint32_t w;
+  memcpy (&w, p, sizeof w);
+  return w;
+}
+
+/* Scrambles word K. */
+static inline uint32_t
+scramble (uint32_t k)
+{
+  k *= MIX_C1;
+  k = rotl32 (k, 15);
+  return k * MIX_C2;
+}
+
+/* Folds word K into running hash H and returns the result. */
+static inline uint32_t
+mix (uint32_t h, uint32_t k)
+{
+  h ^= scramble (k);
+  h = rotl32 (h, 13);
+  return h * 5 + 0xe6546b64u;
+}
+
+/* Returns H with its bits thoroughly mixed, so that every bit of
+   H affects every bit of the result. */
+static inline uint32_t
+finalize (uint32_t h)
+{
+  h ^= h >> 16;
+  h *= 0x85ebca6bu;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35u;
+  h ^= h >> 16;
+  return h;
+}
 
 /* Returns a hash of the SIZE bytes in BUF. */
 unsigned
 hash_bytes (const void *buf_, size_t size)
 {
-  /* Fowler-Noll-Vo 32-bit hash, for bytes. */
   const unsigned char *buf = buf_;
-  unsigned hash;
+  uint32_t hash = HASH_SEED;
+  uint32_t tail = 0;
+  size_t i;
 
   ASSERT (buf != NULL);
 
-  hash = FNV_32_BASIS;
-  while (size-- > 0)
-    hash = (hash * FNV_32_PRIME) ^ *buf++;
+  for (i = 0; i + sizeof (uint32_t) <= size; i += sizeof (uint32_t))
+    hash = mix (hash, load_word (buf + i));
+
+  switch (size & 3)
+    {
+    case 3:
+      tail ^= buf[i + 2] << 16;
+      /* Fall through. */
+    case 2:
+      tail ^= buf[i + 1] << 8;
+      /* Fall through. */
+    case 1:
+      tail ^= buf[i];
+      hash ^= scramble (tail);
+    }
 
-  return hash;
-} 
+  return finalize (hash ^ size);
+}
 
-/* Returns a hash of string S. */
+/* Returns a hash of string S.  Equal strings hash the same no
+   matter where they are stored. */
 unsigned
-hash_string (const char *s_) 
+hash_string (const char *s_)
 {
   const unsigned char *s = (const unsigned char *) s_;
-  unsigned hash;
+  uint32_t hash = HASH_SEED;
+  uint32_t tail;
+  size_t len = 0;
+  int n;
 
   ASSERT (s != NULL);
 
-  hash = FNV_32_BASIS;
-  while (*s != '\0')
-    hash = (hash * FNV_32_PRIME) ^ *s++;
+  for (;;)
+    {
+      /* Load the next four bytes at once if that cannot run off
+         the end of the page.  Bytes past the null terminator in
+         the same page are harmless to read. */
+      if (pg_ofs (s) <= PGSIZE - sizeof (uint32_t))
+        {
+          uint32_t w = load_word (s);
+          if (((w - 0x01010101u) & ~w & 0x80808080u) == 0)
+            {
+              hash = mix (hash, w);
+              s += sizeof w;
+              len += sizeof w;
+              continue;
+            }
+        }
+
+      /* The string ends in the next four bytes, or they straddle
+         a page boundary.  Take them one at a time. */
+      tail = 0;
+      for (n = 0; n < 4 && s[n] != '\0'; n++)
+        tail |= (uint32_t) s[n] << (8 * n);
+      s += n;
+      len += n;
+      if (n < 4)
+        break;
+      hash = mix (hash, tail);
+    }
 
-  return hash;
+  if (n > 0)
+    hash ^= scramble (tail);
+  return finalize (hash ^ len);
 }
 
 /* Returns a hash of integer I. */
 unsigned
 hash_int (int i) 
 {
-  return hash_bytes (&i, sizeof i);
+  return finalize ((uint32_t) i ^ HASH_SEED);
+}
+
+/* Returns a hash of pointer P.  Suitable for page-aligned
+   addresses, whose low bits are all zero. */
+unsigned
+hash_ptr (const void *p)
+{
+  return finalize ((uintptr_t) p ^ HASH_SEED);
 }
-
+
 /* Returns the bucket in H that E belongs in. */
 static struct list *
 find_bucket (struct hash *h, struct hash_elem *e) 
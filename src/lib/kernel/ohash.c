@@ -0,0 +1,498 @@
+/* Open-addressing hash table.
+
+   See ohash.h for basic information. */
+
+#include "ohash.h"
+#include "../debug.h"
+#include "threads/malloc.h"
+
+/* Smallest number of slots in a table. */
+#define MIN_SLOTS 8
+
+/* Slots of the old table migrated per insertion or deletion
+   while a resize is in progress.  A resize starts when the
+   table is 3/4 full (or 1/8 full, for shrinking), and must
+   finish before the new table reaches that load itself; any
+   value above 2 guarantees that. */
+#define MIGRATE_STEP 16
+
+static struct ohash_slot *find_slot (struct ohash *, unsigned hash,
+                                     struct hash_elem *,
+                                     struct ohash_table **);
+static void put_slot (struct ohash_table *, unsigned hash,
+                      struct hash_elem *);
+static void remove_slot (struct ohash_table *, size_t idx);
+static void make_room (struct ohash *);
+static void maybe_shrink (struct ohash *);
+static bool resize (struct ohash *, size_t slot_cnt);
+static void migrate (struct ohash *, size_t slot_cnt);
+static bool init_table (struct ohash_table *, size_t slot_cnt);
+static void clear_table (struct ohash *, struct ohash_table *,
+                         hash_action_func *);
+
+/* Initializes hash table H to compute hash values using HASH and
+   compare hash elements using LESS, given auxiliary data AUX. */
+bool
+ohash_init (struct ohash *h,
+            hash_hash_func *hash, hash_less_func *less, void *aux)
+{
+  h->old.slots = NULL;
+  h->migrate_idx = h->migrate_left = 0;
+  h->hash = hash;
+  h->less = less;
+  h->aux = aux;
+  return init_table (&h->cur, MIN_SLOTS);
+}
+
+/* Removes all the elements from H.
+
+   If DESTRUCTOR is non-null, then it is called for each element
+   in the hash.  DESTRUCTOR may, if appropriate, deallocate the
+   memory used by the hash element.  However, modifying hash
+   table H while ohash_clear() is running, using any of the
+   functions ohash_clear(), ohash_destroy(), ohash_insert(),
+   ohash_replace(), or ohash_delete(), yields undefined behavior,
+   whether done in DESTRUCTOR or elsewhere. */
+void
+ohash_clear (struct ohash *h, hash_action_func *destructor)
+{
+  if (h->old.slots != NULL)
+    {
+      clear_table (h, &h->old, destructor);
+      free (h->old.slots);
+      h->old.slots = NULL;
+    }
+  clear_table (h, &h->cur, destructor);
+}
+
+/* Destroys hash table H.
+
+   If DESTRUCTOR is non-null, then it is first called for each
+   element in the hash.  DESTRUCTOR may, if appropriate,
+   deallocate the memory used by the hash element.  However,
+   modifying hash table H while ohash_destroy() is running, using
+   any of the functions ohash_clear(), ohash_destroy(),
+   ohash_insert(), ohash_replace(), or ohash_delete(), yields
+   undefined behavior, whether done in DESTRUCTOR or
+   elsewhere. */
+void
+ohash_destroy (struct ohash *h, hash_action_func *destructor)
+{
+  if (destructor != NULL)
+    ohash_clear (h, destructor);
+  free (h->old.slots);
+  free (h->cur.slots);
+}
+
+/* Inserts NEW into hash table H and returns a null pointer, if
+   no equal element is already in the table.
+   If an equal element is already in the table, returns it
+   without inserting NEW. */
+struct hash_elem *
+ohash_insert (struct ohash *h, struct hash_elem *new)
+{
+  unsigned hash = h->hash (new, h->aux);
+  struct ohash_slot *old = find_slot (h, hash, new, NULL);
+
+  if (old != NULL)
+    return old->elem;
+
+  make_room (h);
+  put_slot (&h->cur, hash, new);
+  migrate (h, MIGRATE_STEP);
+  return NULL;
+}
+
+/* Inserts NEW into hash table H, replacing any equal element
+   already in the table, which is returned. */
+struct hash_elem *
+ohash_replace (struct ohash *h, struct hash_elem *new)
+{
+  unsigned hash = h->hash (new, h->aux);
+  struct ohash_slot *slot = find_slot (h, hash, new, NULL);
+
+  if (slot != NULL)
+    {
+      /* Equal elements have equal hashes, so NEW can take over
+         the old element's slot. */
+      struct hash_elem *old = slot->elem;
+      slot->elem = new;
+      return old;
+    }
+
+  make_room (h);
+  put_slot (&h->cur, hash, new);
+  migrate (h, MIGRATE_STEP);
+  return NULL;
+}
+
+/* Finds and returns an element equal to E in hash table H, or a
+   null pointer if no equal element exists in the table. */
+struct hash_elem *
+ohash_find (struct ohash *h, struct hash_elem *e)
+{
+  struct ohash_slot *slot = find_slot (h, h->hash (e, h->aux), e, NULL);
+  return slot != NULL ? slot->elem : NULL;
+}
+
+/* Finds, removes, and returns an element equal to E in hash
+   table H.  Returns a null pointer if no equal element existed
+   in the table.
+
+   If the elements of the hash table are dynamically allocated,
+   or own resources that are, then it is the caller's
+   responsibility to deallocate them. */
+struct hash_elem *
+ohash_delete (struct ohash *h, struct hash_elem *e)
+{
+  struct ohash_table *table;
+  struct ohash_slot *slot = find_slot (h, h->hash (e, h->aux), e, &table);
+  struct hash_elem *found;
+
+  if (slot == NULL)
+    return NULL;
+
+  found = slot->elem;
+  remove_slot (table, slot - table->slots);
+  migrate (h, MIGRATE_STEP);
+  maybe_shrink (h);
+  return found;
+}
+
+/* Calls ACTION for each element in hash table H in arbitrary
+   order.
+   Modifying hash table H while ohash_apply() is running, using
+   any of the functions ohash_clear(), ohash_destroy(),
+   ohash_insert(), ohash_replace(), or ohash_delete(), yields
+   undefined behavior, whether done from ACTION or elsewhere. */
+void
+ohash_apply (struct ohash *h, hash_action_func *action)
+{
+  struct ohash_iterator i;
+
+  ASSERT (action != NULL);
+
+  ohash_first (&i, h);
+  while (ohash_next (&i))
+    action (ohash_cur (&i), h->aux);
+}
+
+/* Initializes I for iterating hash table H.
+
+   Iteration idiom:
+
+      struct ohash_iterator i;
+
+      ohash_first (&i, h);
+      while (ohash_next (&i))
+        {
+          struct foo *f = hash_entry (ohash_cur (&i), struct foo, elem);
+          ...do something with f...
+        }
+
+   Modifying hash table H during iteration, using any of the
+   functions ohash_clear(), ohash_destroy(), ohash_insert(),
+   ohash_replace(), or ohash_delete(), invalidates all
+   iterators. */
+void
+ohash_first (struct ohash_iterator *i, struct ohash *h)
+{
+  ASSERT (i != NULL);
+  ASSERT (h != NULL);
+
+  i->hash = h;
+  i->table = h->old.slots != NULL ? &h->old : &h->cur;
+  i->idx = 0;
+  i->elem = NULL;
+}
+
+/* Advances I to the next element in the hash table and returns
+   it.  Returns a null pointer if no elements are left.  Elements
+   are returned in arbitrary order.
+
+   Modifying a hash table H during iteration, using any of the
+   functions ohash_clear(), ohash_destroy(), ohash_insert(),
+   ohash_replace(), or ohash_delete(), invalidates all
+   iterators. */
+struct hash_elem *
+ohash_next (struct ohash_iterator *i)
+{
+  ASSERT (i != NULL);
+
+  for (;;)
+    {
+      while (i->idx < i->table->slot_cnt)
+        {
+          i->elem = i->table->slots[i->idx++].elem;
+          if (i->elem != NULL)
+            return i->elem;
+        }
+
+      if (i->table != &i->hash->old)
+        break;
+      i->table = &i->hash->cur;
+      i->idx = 0;
+    }
+
+  i->elem = NULL;
+  return NULL;
+}
+
+/* Returns the current element in the hash table iteration, or a
+   null pointer at the end of the table.  Undefined behavior
+   after calling ohash_first() but before ohash_next(). */
+struct hash_elem *
+ohash_cur (struct ohash_iterator *i)
+{
+  return i->elem;
+}
+
+/* Returns the number of elements in H. */
+size_t
+ohash_size (struct ohash *h)
+{
+  return h->cur.elem_cnt + (h->old.slots != NULL ? h->old.elem_cnt : 0);
+}
+
+/* Returns true if H contains no elements, false otherwise. */
+bool
+ohash_empty (struct ohash *h)
+{
+  return ohash_size (h) == 0;
+}
+
+/* Returns true if hash elements A and B are equal in H. */
+static inline bool
+equal (struct ohash *h, const struct hash_elem *a, const struct hash_elem *b)
+{
+  return !h->less (a, b, h->aux) && !h->less (b, a, h->aux);
+}
+
+/* Searches TABLE in H for an element equal to E, whose hash
+   value is HASH.  Returns its slot if found or a null pointer
+   otherwise. */
+static struct ohash_slot *
+find_in_table (struct ohash *h, struct ohash_table *table, unsigned hash,
+               struct hash_elem *e)
+{
+  size_t mask = table->slot_cnt - 1;
+  size_t i;
+
+  for (i = hash & mask; table->slots[i].elem != NULL; i = (i + 1) & mask)
+    if (table->slots[i].hash == hash && equal (h, table->slots[i].elem, e))
+      return &table->slots[i];
+  return NULL;
+}
+
+/* Searches H for an element equal to E, whose hash value is
+   HASH.  Returns its slot if found, and stores the table that
+   contains it in *TABLEP if TABLEP is non-null.  Returns a null
+   pointer if not found. */
+static struct ohash_slot *
+find_slot (struct ohash *h, unsigned hash, struct hash_elem *e,
+           struct ohash_table **tablep)
+{
+  struct ohash_table *table = &h->cur;
+  struct ohash_slot *slot = find_in_table (h, table, hash, e);
+
+  if (slot == NULL && h->old.slots != NULL)
+    {
+      table = &h->old;
+      slot = find_in_table (h, table, hash, e);
+    }
+
+  if (tablep != NULL)
+    *tablep = table;
+  return slot;
+}
+
+/* Stores E, whose hash value is HASH, in the first free slot of
+   its probe sequence in TABLE.  TABLE must not already contain
+   an equal element, and must have a free slot. */
+static void
+put_slot (struct ohash_table *table, unsigned hash, struct hash_elem *e)
+{
+  size_t mask = table->slot_cnt - 1;
+  size_t i;
+
+  ASSERT (table->elem_cnt + 1 < table->slot_cnt);
+
+  for (i = hash & mask; table->slots[i].elem != NULL; i = (i + 1) & mask)
+    continue;
+  table->slots[i].hash = hash;
+  table->slots[i].elem = e;
+  table->elem_cnt++;
+}
+
+/* Removes the element in slot IDX of TABLE.  Instead of leaving
+   a tombstone, moves later entries of the same probe run back
+   into the hole whenever that keeps them reachable from their
+   home slots. */
+static void
+remove_slot (struct ohash_table *table, size_t idx)
+{
+  size_t mask = table->slot_cnt - 1;
+  size_t hole = idx;
+  size_t i;
+
+  for (i = (idx + 1) & mask; table->slots[i].elem != NULL;
+       i = (i + 1) & mask)
+    {
+      size_t home = table->slots[i].hash & mask;
+
+      /* The entry at I may fill the hole unless its home slot
+         lies strictly after the hole in probe order. */
+      if (((i - home) & mask) >= ((i - hole) & mask))
+        {
+          table->slots[hole] = table->slots[i];
+          hole = i;
+        }
+    }
+
+  table->slots[hole].elem = NULL;
+  table->elem_cnt--;
+}
+
+/* Makes sure that H's current table can take one more element,
+   starting a resize if it is getting full. */
+static void
+make_room (struct ohash *h)
+{
+  size_t need = h->cur.elem_cnt + 1;
+
+  /* Stay below a load factor of 3/4. */
+  if (need * 4 <= h->cur.slot_cnt * 3)
+    return;
+
+  /* A resize in progress normally finishes well before the new
+     table fills up, so let it run its course unless the table is
+     actually full. */
+  if (h->old.slots != NULL && need < h->cur.slot_cnt)
+    return;
+
+  if (!resize (h, h->cur.slot_cnt * 2) && need >= h->cur.slot_cnt)
+    PANIC ("ohash: out of memory growing table");
+}
+
+/* Starts shrinking H's current table if it is mostly empty. */
+static void
+maybe_shrink (struct ohash *h)
+{
+  if (h->old.slots == NULL
+      && h->cur.slot_cnt > MIN_SLOTS
+      && h->cur.elem_cnt * 8 < h->cur.slot_cnt)
+    {
+      /* Failure is harmless: the table just stays larger than
+         necessary. */
+      resize (h, h->cur.slot_cnt / 2);
+    }
+}
+
+/* Replaces H's current table by a new one with SLOT_CNT slots
+   and starts migrating the elements from the old table.
+   Returns true if successful, false if memory could not be
+   allocated. */
+static bool
+resize (struct ohash *h, size_t slot_cnt)
+{
+  struct ohash_table new;
+  size_t i;
+
+  /* Only one migration at a time. */
+  migrate (h, SIZE_MAX);
+
+  if (!init_table (&new, slot_cnt))
+    return false;
+
+  h->old = h->cur;
+  h->cur = new;
+
+  /* Begin migrating at a free slot.  migrate() only stops right
+     after a free slot, so that no probe run of the old table is
+     ever left half migrated. */
+  for (i = 0; h->old.slots[i].elem != NULL; i++)
+    continue;
+  h->migrate_idx = i;
+  h->migrate_left = h->old.slot_cnt;
+
+  migrate (h, MIGRATE_STEP);
+  return true;
+}
+
+/* Moves the elements in at least SLOT_CNT slots of H's old
+   table, if any, into its current table, then continues to the
+   end of the probe run it is in.  Frees the old table once it is
+   empty. */
+static void
+migrate (struct ohash *h, size_t slot_cnt)
+{
+  struct ohash_table *old = &h->old;
+  size_t mask;
+
+  if (old->slots == NULL)
+    return;
+
+  mask = old->slot_cnt - 1;
+  while (h->migrate_left > 0 && old->elem_cnt > 0)
+    {
+      struct ohash_slot *slot = &old->slots[h->migrate_idx];
+      bool was_free = slot->elem == NULL;
+
+      if (!was_free)
+        {
+          put_slot (&h->cur, slot->hash, slot->elem);
+          slot->elem = NULL;
+          old->elem_cnt--;
+        }
+      h->migrate_idx = (h->migrate_idx + 1) & mask;
+      h->migrate_left--;
+
+      if (slot_cnt > 0)
+        slot_cnt--;
+      if (slot_cnt == 0 && was_free)
+        break;
+    }
+
+  if (h->migrate_left == 0 || old->elem_cnt == 0)
+    {
+      free (old->slots);
+      old->slots = NULL;
+    }
+}
+
+/* Initializes TABLE with SLOT_CNT free slots.  Returns true if
+   successful, false on allocation failure. */
+static bool
+init_table (struct ohash_table *table, size_t slot_cnt)
+{
+  size_t i;
+
+  ASSERT (slot_cnt >= MIN_SLOTS && (slot_cnt & (slot_cnt - 1)) == 0);
+
+  table->slots = malloc (sizeof *table->slots * slot_cnt);
+  if (table->slots == NULL)
+    return false;
+  table->slot_cnt = slot_cnt;
+  table->elem_cnt = 0;
+  for (i = 0; i < slot_cnt; i++)
+    table->slots[i].elem = NULL;
+  return true;
+}
+
+/* Removes all the elements from TABLE in H, calling DESTRUCTOR
+   on each if it is non-null. */
+static void
+clear_table (struct ohash *h, struct ohash_table *table,
+             hash_action_func *destructor)
+{
+  size_t i;
+
+  for (i = 0; i < table->slot_cnt; i++)
+    if (table->slots[i].elem != NULL)
+      {
+        if (destructor != NULL)
+          destructor (table->slots[i].elem, h->aux);
+        table->slots[i].elem = NULL;
+      }
+  table->elem_cnt = 0;
+}
@@ -0,0 +1,97 @@
+#ifndef __LIB_KERNEL_OHASH_H
+#define __LIB_KERNEL_OHASH_H
+
+/* Open-addressing hash table.
+
+   This is a drop-in alternative to the chained hash table in
+   hash.h.  Elements embed the same struct hash_elem, hash_entry()
+   converts back to the containing structure in the same way, and
+   the same hash_hash_func and hash_less_func callbacks are used.
+   Every hash_*() function has an ohash_*() counterpart with the
+   same arguments and semantics, so switching a table from one
+   implementation to the other only means renaming the calls.
+
+   Instead of an array of lists, the table is a flat array of
+   slots, each holding an element pointer and that element's
+   cached hash value.  Lookups probe linearly from the element's
+   home slot, and compare cached hashes before calling the `less'
+   function, so a lookup usually touches one or two adjacent
+   slots and no element memory other than the match.  Deletion
+   shifts the following entries of the probe run back into the
+   hole, so the table never accumulates tombstones.
+
+   Growing or shrinking the table does not move every element at
+   once.  A new array is allocated and becomes the target of all
+   insertions, and each later insertion or deletion migrates a
+   few slots of the old array into it until the old array is
+   empty.  Lookups consult both arrays in the meantime.
+
+   The chained table never fails to insert.  This one needs a
+   free slot, so if the array is full and a larger one cannot be
+   allocated, insertion panics the kernel.  Tables are kept at
+   most three-quarters full, so this only happens when the
+   kernel is out of memory. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "hash.h"
+
+/* A slot in an open-addressing table. */
+struct ohash_slot
+  {
+    unsigned hash;              /* Cached hash of `elem'. */
+    struct hash_elem *elem;     /* Element, or null if slot is free. */
+  };
+
+/* An array of slots. */
+struct ohash_table
+  {
+    struct ohash_slot *slots;   /* Array of `slot_cnt' slots. */
+    size_t slot_cnt;            /* Number of slots, a power of 2. */
+    size_t elem_cnt;            /* Number of occupied slots. */
+  };
+
+/* Open-addressing hash table. */
+struct ohash
+  {
+    struct ohash_table cur;     /* Table that receives insertions. */
+    struct ohash_table old;     /* Table being migrated, if `slots' nonnull. */
+    size_t migrate_idx;         /* Next slot of `old' to migrate. */
+    size_t migrate_left;        /* Slots of `old' not yet migrated. */
+    hash_hash_func *hash;       /* Hash function. */
+    hash_less_func *less;       /* Comparison function. */
+    void *aux;                  /* Auxiliary data for `hash' and `less'. */
+  };
+
+/* An open-addressing hash table iterator. */
+struct ohash_iterator
+  {
+    struct ohash *hash;         /* The hash table. */
+    struct ohash_table *table;  /* Current slot array. */
+    size_t idx;                 /* Next slot to examine in `table'. */
+    struct hash_elem *elem;     /* Current hash element. */
+  };
+
+/* Basic life cycle. */
+bool ohash_init (struct ohash *, hash_hash_func *, hash_less_func *,
+                 void *aux);
+void ohash_clear (struct ohash *, hash_action_func *);
+void ohash_destroy (struct ohash *, hash_action_func *);
+
+/* Search, insertion, deletion. */
+struct hash_elem *ohash_insert (struct ohash *, struct hash_elem *);
+struct hash_elem *ohash_replace (struct ohash *, struct hash_elem *);
+struct hash_elem *ohash_find (struct ohash *, struct hash_elem *);
+struct hash_elem *ohash_delete (struct ohash *, struct hash_elem *);
+
+/* Iteration. */
+void ohash_apply (struct ohash *, hash_action_func *);
+void ohash_first (struct ohash_iterator *, struct ohash *);
+struct hash_elem *ohash_next (struct ohash_iterator *);
+struct hash_elem *ohash_cur (struct ohash_iterator *);
+
+/* Information. */
+size_t ohash_size (struct ohash *);
+bool ohash_empty (struct ohash *);
+
+#endif /* lib/kernel/ohash.h */
@@ -0,0 +1,493 @@
+#include "rbtree.h"
+#include "../debug.h"
+
+/* Red-black tree.
+
+   See rbtree.h for basic information.
+
+   Every element is red or black, and the tree maintains two
+   invariants: a red element never has a red child, and every
+   path from an element down to a null child passes through the
+   same number of black elements.  Together they keep the
+   longest root-to-leaf path at most twice the shortest, so the
+   height stays O(log n).
+
+   The algorithms are those of Cormen et al., "Introduction to
+   Algorithms", chapter 13, except that null pointers stand in
+   for the sentinel leaf.  Where the book relies on the
+   sentinel's parent pointer during deletion, we track the
+   parent separately. */
+
+static void rotate_left (struct rbtree *, struct rb_elem *);
+static void rotate_right (struct rbtree *, struct rb_elem *);
+static void insert_fixup (struct rbtree *, struct rb_elem *);
+static void remove_fixup (struct rbtree *, struct rb_elem *,
+                          struct rb_elem *parent);
+static void transplant (struct rbtree *, struct rb_elem *old,
+                        struct rb_elem *new);
+static void augment_path (struct rbtree *, struct rb_elem *);
+static struct rb_elem *subtree_min (struct rb_elem *);
+static struct rb_elem *subtree_max (struct rb_elem *);
+
+/* Initializes T as an empty tree ordered by LESS, given
+   auxiliary data AUX.  If AUGMENT is non-null, it is called to
+   maintain per-element augmented data, as described in
+   rbtree.h. */
+void
+rb_init (struct rbtree *t, rb_less_func *less, rb_augment_func *augment,
+         void *aux)
+{
+  ASSERT (t != NULL);
+  ASSERT (less != NULL);
+
+  t->root = NULL;
+  t->elem_cnt = 0;
+  t->less = less;
+  t->augment = augment;
+  t->aux = aux;
+}
+
+/* Inserts E into T, after any elements equal to it. */
+void
+rb_insert (struct rbtree *t, struct rb_elem *e)
+{
+  struct rb_elem *parent = NULL;
+  struct rb_elem **link = &t->root;
+
+  ASSERT (t != NULL);
+  ASSERT (e != NULL);
+
+  while (*link != NULL)
+    {
+      parent = *link;
+      link = t->less (e, parent, t->aux) ? &parent->left : &parent->right;
+    }
+
+  e->parent = parent;
+  e->left = e->right = NULL;
+  e->red = true;
+  *link = e;
+  t->elem_cnt++;
+
+  augment_path (t, e);
+  insert_fixup (t, e);
+}
+
+/* Removes E, which must be in T, from T. */
+void
+rb_remove (struct rbtree *t, struct rb_elem *e)
+{
+  struct rb_elem *child, *parent;
+  bool removed_red = e->red;
+
+  ASSERT (t != NULL);
+  ASSERT (e != NULL);
+  ASSERT (t->elem_cnt > 0);
+
+  if (e->left == NULL)
+    {
+      child = e->right;
+      parent = e->parent;
+      transplant (t, e, child);
+    }
+  else if (e->right == NULL)
+    {
+      child = e->left;
+      parent = e->parent;
+      transplant (t, e, child);
+    }
+  else
+    {
+      /* E has two children.  Its successor, which has no left
+         child, takes its place in the tree. */
+      struct rb_elem *succ = subtree_min (e->right);
+
+      removed_red = succ->red;
+      child = succ->right;
+      if (succ->parent == e)
+        parent = succ;
+      else
+        {
+          parent = succ->parent;
+          transplant (t, succ, child);
+          succ->right = e->right;
+          succ->right->parent = succ;
+        }
+      transplant (t, e, succ);
+      succ->left = e->left;
+      succ->left->parent = succ;
+      succ->red = e->red;
+    }
+  t->elem_cnt--;
+
+  /* Every element whose subtree lost E lies on the path from
+     PARENT to the root, including the successor, if any, at its
+     new position. */
+  augment_path (t, parent);
+
+  /* Removing a black element shortens the black paths through
+     CHILD by one. */
+  if (!removed_red)
+    remove_fixup (t, child, parent);
+}
+
+/* Returns an element of T equal to KEY, or a null pointer if
+   there is none.  If there are several, returns the first. */
+struct rb_elem *
+rb_find (struct rbtree *t, const struct rb_elem *key)
+{
+  struct rb_elem *e = rb_lower_bound (t, key);
+  return e != NULL && !t->less (key, e, t->aux) ? e : NULL;
+}
+
+/* Returns the first element of T that is not less than KEY, or a
+   null pointer if every element is less than KEY. */
+struct rb_elem *
+rb_lower_bound (struct rbtree *t, const struct rb_elem *key)
+{
+  struct rb_elem *e = t->root;
+  struct rb_elem *bound = NULL;
+
+  while (e != NULL)
+    if (t->less (e, key, t->aux))
+      e = e->right;
+    else
+      {
+        bound = e;
+        e = e->left;
+      }
+  return bound;
+}
+
+/* Returns the first element of T that is greater than KEY, or a
+   null pointer if no element is greater than KEY. */
+struct rb_elem *
+rb_upper_bound (struct rbtree *t, const struct rb_elem *key)
+{
+  struct rb_elem *e = t->root;
+  struct rb_elem *bound = NULL;
+
+  while (e != NULL)
+    if (t->less (key, e, t->aux))
+      {
+        bound = e;
+        e = e->left;
+      }
+    else
+      e = e->right;
+  return bound;
+}
+
+/* Returns the root element of T, or a null pointer if T is
+   empty.  Useful for searches that walk an augmented tree
+   themselves. */
+struct rb_elem *
+rb_root (struct rbtree *t)
+{
+  return t->root;
+}
+
+/* Returns the least element of T, or a null pointer if T is
+   empty. */
+struct rb_elem *
+rb_first (struct rbtree *t)
+{
+  return t->root != NULL ? subtree_min (t->root) : NULL;
+}
+
+/* Returns the greatest element of T, or a null pointer if T is
+   empty. */
+struct rb_elem *
+rb_last (struct rbtree *t)
+{
+  return t->root != NULL ? subtree_max (t->root) : NULL;
+}
+
+/* Returns the element that follows E in its tree, or a null
+   pointer if E is the last element. */
+struct rb_elem *
+rb_next (struct rb_elem *e)
+{
+  ASSERT (e != NULL);
+
+  if (e->right != NULL)
+    return subtree_min (e->right);
+  while (e->parent != NULL && e == e->parent->right)
+    e = e->parent;
+  return e->parent;
+}
+
+/* Returns the element that precedes E in its tree, or a null
+   pointer if E is the first element. */
+struct rb_elem *
+rb_prev (struct rb_elem *e)
+{
+  ASSERT (e != NULL);
+
+  if (e->left != NULL)
+    return subtree_max (e->left);
+  while (e->parent != NULL && e == e->parent->left)
+    e = e->parent;
+  return e->parent;
+}
+
+/* Returns the number of elements in T. */
+size_t
+rb_size (struct rbtree *t)
+{
+  return t->elem_cnt;
+}
+
+/* Returns true if T is empty, false otherwise. */
+bool
+rb_empty (struct rbtree *t)
+{
+  return t->root == NULL;
+}
+
+/* Returns true if E is a red element.  Null children count as
+   black. */
+static inline bool
+is_red (const struct rb_elem *e)
+{
+  return e != NULL && e->red;
+}
+
+/* Recomputes E's augmented data, if T is augmented. */
+static inline void
+augment (struct rbtree *t, struct rb_elem *e)
+{
+  if (t->augment != NULL)
+    t->augment (e, t->aux);
+}
+
+/* Recomputes the augmented data of E and each of its ancestors,
+   bottom-up, if T is augmented.  E may be null. */
+static void
+augment_path (struct rbtree *t, struct rb_elem *e)
+{
+  if (t->augment != NULL)
+    for (; e != NULL; e = e->parent)
+      t->augment (e, t->aux);
+}
+
+/* Makes NEW take the place of OLD as a child of OLD's parent, or
+   as T's root.  NEW may be null.  Does not touch OLD's
+   children. */
+static void
+transplant (struct rbtree *t, struct rb_elem *old, struct rb_elem *new)
+{
+  if (old->parent == NULL)
+    t->root = new;
+  else if (old == old->parent->left)
+    old->parent->left = new;
+  else
+    old->parent->right = new;
+  if (new != NULL)
+    new->parent = old->parent;
+}
+
+/* Rotates left around X, whose right child Y takes its place:
+
+         X                Y
+        / \              / \
+       a   Y     ==>    X   c
+          / \          / \
+         b   c        a   b
+
+   Only X and Y change subtrees, so only they need their
+   augmented data recomputed. */
+static void
+rotate_left (struct rbtree *t, struct rb_elem *x)
+{
+  struct rb_elem *y = x->right;
+
+  x->right = y->left;
+  if (y->left != NULL)
+    y->left->parent = x;
+  transplant (t, x, y);
+  y->left = x;
+  x->parent = y;
+
+  augment (t, x);
+  augment (t, y);
+}
+
+/* Rotates right around X, whose left child Y takes its place.
+   The mirror image of rotate_left(). */
+static void
+rotate_right (struct rbtree *t, struct rb_elem *x)
+{
+  struct rb_elem *y = x->left;
+
+  x->left = y->right;
+  if (y->right != NULL)
+    y->right->parent = x;
+  transplant (t, x, y);
+  y->right = x;
+  x->parent = y;
+
+  augment (t, x);
+  augment (t, y);
+}
+
+/* Restores the red-black invariants after inserting red element
+   E into T, which may have given a red element a red child. */
+static void
+insert_fixup (struct rbtree *t, struct rb_elem *e)
+{
+  while (is_red (e->parent))
+    {
+      struct rb_elem *parent = e->parent;
+      struct rb_elem *grandparent = parent->parent;
+
+      if (parent == grandparent->left)
+        {
+          struct rb_elem *uncle = grandparent->right;
+
+          if (is_red (uncle))
+            {
+              /* Push the grandparent's blackness down a level
+                 and continue from the grandparent. */
+              parent->red = uncle->red = false;
+              grandparent->red = true;
+              e = grandparent;
+            }
+          else
+            {
+              if (e == parent->right)
+                {
+                  e = parent;
+                  rotate_left (t, e);
+                  parent = e->parent;
+                }
+              parent->red = false;
+              grandparent->red = true;
+              rotate_right (t, grandparent);
+            }
+        }
+      else
+        {
+          struct rb_elem *uncle = grandparent->left;
+
+          if (is_red (uncle))
+            {
+              parent->red = uncle->red = false;
+              grandparent->red = true;
+              e = grandparent;
+            }
+          else
+            {
+              if (e == parent->left)
+                {
+                  e = parent;
+                  rotate_right (t, e);
+                  parent = e->parent;
+                }
+              parent->red = false;
+              grandparent->red = true;
+              rotate_left (t, grandparent);
+            }
+        }
+    }
+  t->root->red = false;
+}
+
+/* Restores the red-black invariants after a black element was
+   removed from T, leaving every path through E, a child of
+   PARENT, one black element short.  E may be null. */
+static void
+remove_fixup (struct rbtree *t, struct rb_elem *e, struct rb_elem *parent)
+{
+  while (e != t->root && !is_red (e))
+    {
+      if (e == parent->left)
+        {
+          struct rb_elem *sibling = parent->right;
+
+          if (is_red (sibling))
+            {
+              sibling->red = false;
+              parent->red = true;
+              rotate_left (t, parent);
+              sibling = parent->right;
+            }
+          if (!is_red (sibling->left) && !is_red (sibling->right))
+            {
+              /* Take a black level off the sibling's side too and
+                 move the shortage up to the parent. */
+              sibling->red = true;
+              e = parent;
+              parent = e->parent;
+            }
+          else
+            {
+              if (!is_red (sibling->right))
+                {
+                  sibling->left->red = false;
+                  sibling->red = true;
+                  rotate_right (t, sibling);
+                  sibling = parent->right;
+                }
+              sibling->red = parent->red;
+              parent->red = false;
+              sibling->right->red = false;
+              rotate_left (t, parent);
+              e = t->root;
+            }
+        }
+      else
+        {
+          struct rb_elem *sibling = parent->left;
+
+          if (is_red (sibling))
+            {
+              sibling->red = false;
+              parent->red = true;
+              rotate_right (t, parent);
+              sibling = parent->left;
+            }
+          if (!is_red (sibling->left) && !is_red (sibling->right))
+            {
+              sibling->red = true;
+              e = parent;
+              parent = e->parent;
+            }
+          else
+            {
+              if (!is_red (sibling->left))
+                {
+                  sibling->right->red = false;
+                  sibling->red = true;
+                  rotate_left (t, sibling);
+                  sibling = parent->left;
+                }
+              sibling->red = parent->red;
+              parent->red = false;
+              sibling->left->red = false;
+              rotate_right (t, parent);
+              e = t->root;
+            }
+        }
+    }
+  if (e != NULL)
+    e->red = false;
+}
+
+/* Returns the least element in the subtree rooted at E. */
+static struct rb_elem *
+subtree_min (struct rb_elem *e)
+{
+  while (e->left != NULL)
+    e = e->left;
+  return e;
+}
+
+/* Returns the greatest element in the subtree rooted at E. */
+static struct rb_elem *
+subtree_max (struct rb_elem *e)
+{
+  while (e->right != NULL)
+    e = e->right;
+  return e;
+}
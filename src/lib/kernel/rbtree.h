@@ -0,0 +1,127 @@
+#ifndef __LIB_KERNEL_RBTREE_H
+#define __LIB_KERNEL_RBTREE_H
+
+/* Red-black tree.
+
+   A balanced binary search tree that keeps its elements in the
+   order defined by a caller-supplied `less' function.  Insertion,
+   deletion, and lookup all take O(log n) time, which makes it a
+   better fit than list_insert_ordered() for large ordered sets
+   such as sleeping threads by wakeup time, free extents by
+   address or size, or memory-mapped regions by address.
+
+   Like lists and hash tables, the tree does not allocate memory.
+   Each structure that can be in a tree embeds a struct rb_elem
+   member, and rb_entry() converts a struct rb_elem back to the
+   structure that contains it:
+
+      struct foo
+        {
+          struct rb_elem elem;
+          int64_t key;
+          ...other members...
+        };
+
+      static bool
+      foo_less (const struct rb_elem *a, const struct rb_elem *b,
+                void *aux UNUSED)
+      {
+        return (rb_entry (a, struct foo, elem)->key
+                < rb_entry (b, struct foo, elem)->key);
+      }
+
+      struct rbtree foo_tree;
+      struct rb_elem *e;
+
+      rb_init (&foo_tree, foo_less, NULL, NULL);
+      ...
+      for (e = rb_first (&foo_tree); e != NULL; e = rb_next (e))
+        {
+          struct foo *f = rb_entry (e, struct foo, elem);
+          ...do something with f...
+        }
+
+   Equal elements are allowed; an element is inserted after any
+   elements equal to it, so equal elements iterate in insertion
+   order, as with list_insert_ordered().
+
+   Augmented trees.  A tree may also be given an `augment'
+   function that recomputes per-node summary data, stored by the
+   caller alongside the struct rb_elem, from the node itself and
+   its two children (e->left and e->right, either of which may be
+   null).  The tree calls it whenever the set of elements below a
+   node changes, bottom-up, so each node's summary is always
+   current.  The classic use is an interval tree: order intervals
+   by start address and keep in each node the greatest end
+   address in its subtree, so that a search can skip any subtree
+   whose maximum end lies below the query. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Red-black tree element. */
+struct rb_elem
+  {
+    struct rb_elem *parent;     /* Parent, or null at the root. */
+    struct rb_elem *left;       /* Left child (lesser elements). */
+    struct rb_elem *right;      /* Right child (greater elements). */
+    bool red;                   /* Red or black? */
+  };
+
+/* Converts pointer to tree element RB_ELEM into a pointer to the
+   structure that RB_ELEM is embedded inside.  Supply the name of
+   the outer structure STRUCT and the member name MEMBER of the
+   tree element.  See the big comment at the top of the file for
+   an example. */
+#define rb_entry(RB_ELEM, STRUCT, MEMBER)               \
+        ((STRUCT *) ((uint8_t *) &(RB_ELEM)->parent     \
+                     - offsetof (STRUCT, MEMBER.parent)))
+
+/* Compares the value of two tree elements A and B, given
+   auxiliary data AUX.  Returns true if A is less than B, or
+   false if A is greater than or equal to B. */
+typedef bool rb_less_func (const struct rb_elem *a,
+                           const struct rb_elem *b,
+                           void *aux);
+
+/* Recomputes the augmented data of element E from E itself and
+   from E->left and E->right, whose data is already current,
+   given auxiliary data AUX. */
+typedef void rb_augment_func (struct rb_elem *e, void *aux);
+
+/* Red-black tree. */
+struct rbtree
+  {
+    struct rb_elem *root;       /* Root element, or null if empty. */
+    size_t elem_cnt;            /* Number of elements. */
+    rb_less_func *less;         /* Comparison function. */
+    rb_augment_func *augment;   /* Augmentation function, or null. */
+    void *aux;                  /* Auxiliary data for `less', `augment'. */
+  };
+
+/* Initialization. */
+void rb_init (struct rbtree *, rb_less_func *, rb_augment_func *,
+              void *aux);
+
+/* Insertion and deletion. */
+void rb_insert (struct rbtree *, struct rb_elem *);
+void rb_remove (struct rbtree *, struct rb_elem *);
+
+/* Search. */
+struct rb_elem *rb_find (struct rbtree *, const struct rb_elem *);
+struct rb_elem *rb_lower_bound (struct rbtree *, const struct rb_elem *);
+struct rb_elem *rb_upper_bound (struct rbtree *, const struct rb_elem *);
+
+/* Traversal. */
+struct rb_elem *rb_root (struct rbtree *);
+struct rb_elem *rb_first (struct rbtree *);
+struct rb_elem *rb_last (struct rbtree *);
+struct rb_elem *rb_next (struct rb_elem *);
+struct rb_elem *rb_prev (struct rb_elem *);
+
+/* Properties. */
+size_t rb_size (struct rbtree *);
+bool rb_empty (struct rbtree *);
+
+#endif /* lib/kernel/rbtree.h */
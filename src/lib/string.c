@@ -1,5 +1,37 @@
 #include <string.h>
 #include <debug.h>
+#include <stdint.h>
+
+/* memcpy(), memset(), memcmp(), and strlen() work a 32-bit word
+   at a time once the block is long enough for it to pay off.
+   They first step byte by byte until the destination (or, for
+   the read-only functions, the first operand) is word-aligned,
+   then handle whole words, then finish the tail byte by byte.
+   x86 tolerates unaligned loads, so the second operand of a copy
+   or comparison is accessed as a word wherever it happens to
+   fall. */
+
+/* A machine word.  The attributes tell GCC that a word may alias
+   any other object and may sit at any address. */
+typedef uint32_t word_t __attribute__ ((may_alias, aligned (1)));
+
+/* Blocks shorter than this are handled a byte at a time. */
+#define WORD_MIN 16
+
+/* Returns the number of bytes from P to the next word
+   boundary. */
+static inline size_t
+word_align_gap (const void *p)
+{
+  return -(uintptr_t) p & (sizeof (word_t) - 1);
+}
+
+/* Returns nonzero if word W contains a zero byte. */
+static inline uint32_t
+word_has_zero (uint32_t w)
+{
+  return (w - 0x01010101) & ~w & 0x80808080;
+}
 
 /* Copies SIZE bytes from SRC to DST, which must not overlap.
    Returns DST. */
@@ -12,6 +44,23 @@ memcpy (void *dst_, const void *src_, size_t size)
   ASSERT (dst != NULL || size == 0);
   ASSERT (src != NULL || size == 0);
 
+  if (size >= WORD_MIN) 
+    {
+      size_t head = word_align_gap (dst);
+      size_t words = (size - head) / sizeof (word_t);
+      size_t tail = (size - head) % sizeof (word_t);
+
+      asm volatile ("rep movsb\n\t"
+                    "movl %3, %%ecx\n\t"
+                    "rep movsl\n\t"
+                    "movl %4, %%ecx\n\t"
+                    "rep movsb"
+                    : "+D" (dst), "+S" (src), "+c" (head)
+                    : "g" (words), "g" (tail)
+                    : "memory");
+      return dst_;
+    }
+
   while (size-- > 0)
     *dst++ = *src++;
 
@@ -58,6 +107,20 @@ memcmp (const void *a_, const void *b_, size_t size)
   ASSERT (a != NULL || size == 0);
   ASSERT (b != NULL || size == 0);
 
+  if (size >= WORD_MIN) 
+    {
+      /* Compare up to A's word boundary, then whole words until
+         a pair differs.  The byte loop below then locates the
+         differing byte. */
+      for (; word_align_gap (a) != 0; a++, b++, size--)
+        if (*a != *b)
+          return *a > *b ? +1 : -1;
+      for (; size >= sizeof (word_t); a += sizeof (word_t),
+             b += sizeof (word_t), size -= sizeof (word_t))
+        if (*(const word_t *) a != *(const word_t *) b)
+          break;
+    }
+
   for (; size-- > 0; a++, b++)
     if (*a != *b)
       return *a > *b ? +1 : -1;
@@ -281,6 +344,24 @@ memset (void *dst_, int value, size_t size)
   unsigned char *dst = dst_;
 
   ASSERT (dst != NULL || size == 0);
+
+  if (size >= WORD_MIN) 
+    {
+      size_t head = word_align_gap (dst);
+      size_t words = (size - head) / sizeof (word_t);
+      size_t tail = (size - head) % sizeof (word_t);
+      uint32_t pattern = (unsigned char) value * 0x01010101u;
+
+      asm volatile ("rep stosb\n\t"
+                    "movl %2, %%ecx\n\t"
+                    "rep stosl\n\t"
+                    "movl %3, %%ecx\n\t"
+                    "rep stosb"
+                    : "+D" (dst), "+c" (head)
+                    : "g" (words), "g" (tail), "a" (pattern)
+                    : "memory");
+      return dst_;
+    }
   
   while (size-- > 0)
     *dst++ = value;
@@ -296,7 +377,16 @@ strlen (const char *string)
 
   ASSERT (string != NULL);
 
-  for (p = string; *p != '\0'; p++)
+  /* Reach a word boundary, then test a word at a time.  An
+     aligned word never straddles a page boundary, so reading the
+     bytes that follow the null terminator in the same word is
+     safe. */
+  for (p = string; word_align_gap (p) != 0; p++)
+    if (*p == '\0')
+      return p - string;
+  while (!word_has_zero (*(const word_t *) p))
+    p += sizeof (word_t);
+  for (; *p != '\0'; p++)
     continue;
   return p - string;
 }
@@ -32,7 +32,17 @@ enum
     SYS_MKDIR,                  /* Create a directory. */
     SYS_READDIR,                /* Reads a directory entry. */
     SYS_ISDIR,                  /* Tests if a fd represents a directory. */
-    SYS_INUMBER                 /* Returns the inode number for a fd. */
+    SYS_INUMBER,                /* Returns the inode number for a fd. */
+
+    /* Vectored and positioned I/O. */
+    SYS_READV,                  /* Read into several buffers. */
+    SYS_WRITEV,                 /* Write from several buffers. */
+    SYS_PREAD,                  /* Read at a given position. */
+    SYS_PWRITE,                 /* Write at a given position. */
+    SYS_COPY_FILE_RANGE,        /* Copy between files in the kernel. */
+
+    /* Statistics. */
+    SYS_BLOCK_STATS             /* Get a block device's I/O statistics. */
   };
 
 #endif /* lib/syscall-nr.h */
@@ -0,0 +1,101 @@
+/* Multi-sector block I/O benchmark.
+
+   Writes RUN_SECTORS sectors of the scratch device one sector at
+   a time with block_write(), then all at once with
+   block_write_multi(), and reads them back both ways, reporting
+   the time taken by each.  On an IDE disk, the single-sector
+   calls issue one ATA command per sector, while the
+   multi-sector calls issue one command per MAX_SECTORS_PER_CMD
+   sectors.  Checks that every sector reads back as written.
+
+   Needs a scratch disk of at least RUN_SECTORS sectors. */
+
+#undef NDEBUG
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/block.h"
+#include "devices/timer.h"
+#include "threads/palloc.h"
+#include "threads/test.h"
+#include "threads/vaddr.h"
+
+/* Number of sectors transferred by each pass. */
+#define RUN_SECTORS 512
+
+/* Pages in a buffer of RUN_SECTORS sectors. */
+#define RUN_PAGES (RUN_SECTORS * BLOCK_SECTOR_SIZE / PGSIZE)
+
+/* Fills BUF with the data for sector SECTOR, varied by SALT. */
+static void
+fill (uint8_t *buf, block_sector_t sector, int salt)
+{
+  memset (buf, (sector + salt) % 251, BLOCK_SECTOR_SIZE);
+}
+
+/* Checks that BUF holds RUN_SECTORS sectors filled by fill()
+   with SALT. */
+static void
+check (const uint8_t *buf, int salt)
+{
+  static uint8_t expected[BLOCK_SECTOR_SIZE];
+  block_sector_t sector;
+
+  for (sector = 0; sector < RUN_SECTORS; sector++)
+    {
+      fill (expected, sector, salt);
+      ASSERT (!memcmp (buf + sector * BLOCK_SECTOR_SIZE, expected,
+                       BLOCK_SECTOR_SIZE));
+    }
+}
+
+/* Prints the time since START, labeled with LABEL. */
+static void
+report (const char *label, int64_t start)
+{
+  printf ("%-22s %8lld ticks\n", label, timer_elapsed (start));
+}
+
+/* Runs the benchmark. */
+void
+test (void)
+{
+  struct block *block = block_get_role (BLOCK_SCRATCH);
+  uint8_t *buf = palloc_get_multiple (PAL_ASSERT, RUN_PAGES);
+  block_sector_t sector;
+  int64_t start;
+
+  ASSERT (block != NULL);
+  ASSERT (block_size (block) >= RUN_SECTORS);
+
+  /* One sector at a time. */
+  for (sector = 0; sector < RUN_SECTORS; sector++)
+    fill (buf + sector * BLOCK_SECTOR_SIZE, sector, 0);
+  start = timer_ticks ();
+  for (sector = 0; sector < RUN_SECTORS; sector++)
+    block_write (block, sector, buf + sector * BLOCK_SECTOR_SIZE);
+  report ("block_write", start);
+
+  memset (buf, 0, RUN_SECTORS * BLOCK_SECTOR_SIZE);
+  start = timer_ticks ();
+  for (sector = 0; sector < RUN_SECTORS; sector++)
+    block_read (block, sector, buf + sector * BLOCK_SECTOR_SIZE);
+  report ("block_read", start);
+  check (buf, 0);
+
+  /* All at once. */
+  for (sector = 0; sector < RUN_SECTORS; sector++)
+    fill (buf + sector * BLOCK_SECTOR_SIZE, sector, 1);
+  start = timer_ticks ();
+  block_write_multi (block, 0, RUN_SECTORS, buf);
+  report ("block_write_multi", start);
+
+  memset (buf, 0, RUN_SECTORS * BLOCK_SECTOR_SIZE);
+  start = timer_ticks ();
+  block_read_multi (block, 0, RUN_SECTORS, buf);
+  report ("block_read_multi", start);
+  check (buf, 1);
+
+  palloc_free_multiple (buf, RUN_PAGES);
+  printf ("block-multi: PASS\n");
+}
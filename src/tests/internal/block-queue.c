@@ -0,0 +1,115 @@
+/* Block request queue benchmark.
+
+   Reads SECTOR_CNT sectors of the scratch device, one sector per
+   request, in random order: first with block_read(), waiting for
+   each request before making the next, and then by submitting
+   every request with block_submit() before waiting for any.  In
+   the second pass the dispatcher sees many requests at once, so
+   it can sort them into one sweep across the disk and merge
+   adjacent ones into larger transfers.  Reports the time taken
+   by each pass and checks the data read.
+
+   Needs a scratch disk of at least SECTOR_CNT sectors. */
+
+#undef NDEBUG
+#include <debug.h>
+#include <random.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/block.h"
+#include "devices/timer.h"
+#include "threads/palloc.h"
+#include "threads/test.h"
+#include "threads/vaddr.h"
+
+/* Number of sectors read by each pass. */
+#define SECTOR_CNT 256
+
+/* Pages in a buffer of SECTOR_CNT sectors. */
+#define BUF_PAGES (SECTOR_CNT * BLOCK_SECTOR_SIZE / PGSIZE)
+
+static block_sector_t order[SECTOR_CNT];
+static struct block_request requests[SECTOR_CNT];
+
+/* Puts the sector numbers 0...SECTOR_CNT - 1 in random order in
+   ORDER. */
+static void
+shuffle (void)
+{
+  size_t i;
+
+  for (i = 0; i < SECTOR_CNT; i++)
+    order[i] = i;
+  for (i = 0; i < SECTOR_CNT; i++)
+    {
+      size_t j = i + random_ulong () % (SECTOR_CNT - i);
+      block_sector_t t = order[i];
+      order[i] = order[j];
+      order[j] = t;
+    }
+}
+
+/* Checks that BUF holds sectors 0...SECTOR_CNT - 1 as written by
+   test(), then clears it. */
+static void
+check (uint8_t *buf)
+{
+  block_sector_t sector;
+  size_t i;
+
+  for (sector = 0; sector < SECTOR_CNT; sector++)
+    for (i = 0; i < BLOCK_SECTOR_SIZE; i++)
+      ASSERT (buf[sector * BLOCK_SECTOR_SIZE + i] == sector % 251);
+  memset (buf, 0, SECTOR_CNT * BLOCK_SECTOR_SIZE);
+}
+
+/* Runs the benchmark. */
+void
+test (void)
+{
+  struct block *block = block_get_role (BLOCK_SCRATCH);
+  uint8_t *buf = palloc_get_multiple (PAL_ASSERT, BUF_PAGES);
+  block_sector_t sector;
+  int64_t start;
+  size_t i;
+
+  ASSERT (block != NULL);
+  ASSERT (block_size (block) >= SECTOR_CNT);
+
+  for (sector = 0; sector < SECTOR_CNT; sector++)
+    memset (buf + sector * BLOCK_SECTOR_SIZE, sector % 251,
+            BLOCK_SECTOR_SIZE);
+  block_write_multi (block, 0, SECTOR_CNT, buf);
+  memset (buf, 0, SECTOR_CNT * BLOCK_SECTOR_SIZE);
+  shuffle ();
+
+  /* One request at a time. */
+  start = timer_ticks ();
+  for (i = 0; i < SECTOR_CNT; i++)
+    block_read (block, order[i], buf + order[i] * BLOCK_SECTOR_SIZE);
+  printf ("%-10s %8lld ticks\n", "one by one", timer_elapsed (start));
+  check (buf);
+
+  /* All requests at once. */
+  start = timer_ticks ();
+  for (i = 0; i < SECTOR_CNT; i++)
+    {
+      struct block_request *r = &requests[i];
+
+      r->write = false;
+      r->sector = order[i];
+      r->cnt = 1;
+      r->buffer = buf + order[i] * BLOCK_SECTOR_SIZE;
+      r->done = NULL;
+      r->aux = NULL;
+      block_submit (block, r);
+    }
+  for (i = 0; i < SECTOR_CNT; i++)
+    block_wait (&requests[i]);
+  printf ("%-10s %8lld ticks\n", "queued", timer_elapsed (start));
+  check (buf);
+
+  block_print_stats ();
+  palloc_free_multiple (buf, BUF_PAGES);
+  printf ("block-queue: PASS\n");
+}
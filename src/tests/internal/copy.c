@@ -0,0 +1,127 @@
+/* File copy benchmark.
+
+   Writes a FILE_SIZE file, then copies it twice: once the way
+   examples/cp.c does, reading and writing CP_BUF_SIZE bytes at a
+   time through a separate buffer, and once with file_copy(), the
+   kernel side of the copy_file_range system call.  Reports the
+   time taken by each copy and checks that both copies match the
+   original.  Run from the kernel, the loop does not pay for
+   cp's crossings into the kernel and back, so the real gap is
+   wider than reported; examples/cpbench.c makes the same
+   comparison from a user program.
+
+   Needs 3 * FILE_SIZE bytes free in the file system. */
+
+#undef NDEBUG
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "filesys/file.h"
+#include "filesys/filesys.h"
+#include "threads/test.h"
+
+/* Size of the file copied, in bytes. */
+#define FILE_SIZE (2 * 1024 * 1024)
+
+/* Size of examples/cp.c's buffer. */
+#define CP_BUF_SIZE 1024
+
+/* Size of the buffers used to write and check the files. */
+#define BUF_SIZE 4096
+
+static char buf[BUF_SIZE], check_buf[BUF_SIZE];
+
+/* Fills BUF with the data that belongs at offset OFS of the
+   original file. */
+static void
+fill (off_t ofs)
+{
+  size_t i;
+
+  for (i = 0; i < BUF_SIZE; i++)
+    buf[i] = (ofs + i) % 251;
+}
+
+/* Opens file NAME, which must exist. */
+static struct file *
+open_file (const char *name)
+{
+  struct file *file = filesys_open (name);
+  ASSERT (file != NULL);
+  return file;
+}
+
+/* Copies "copy-src" to NAME with a cp-style loop if USE_LOOP is
+   true, otherwise with file_copy(), and prints the time taken. */
+static void
+copy (const char *name, bool use_loop)
+{
+  struct file *in, *out;
+  int64_t start;
+
+  ASSERT (filesys_create (name, 0));
+  in = open_file ("copy-src");
+  out = open_file (name);
+
+  start = timer_ticks ();
+  if (use_loop)
+    {
+      static char cp_buf[CP_BUF_SIZE];
+      off_t bytes_read;
+
+      while ((bytes_read = file_read (in, cp_buf, sizeof cp_buf)) > 0)
+        ASSERT (file_write (out, cp_buf, bytes_read) == bytes_read);
+    }
+  else
+    ASSERT (file_copy (out, in, FILE_SIZE) == FILE_SIZE);
+  printf ("%-18s %8lld ticks\n", use_loop ? "read/write loop" : "file_copy",
+          timer_elapsed (start));
+
+  file_close (in);
+  file_close (out);
+}
+
+/* Checks that file NAME matches the original. */
+static void
+check (const char *name)
+{
+  struct file *file = open_file (name);
+  off_t ofs;
+
+  ASSERT (file_length (file) == FILE_SIZE);
+  for (ofs = 0; ofs < FILE_SIZE; ofs += BUF_SIZE)
+    {
+      fill (ofs);
+      ASSERT (file_read (file, check_buf, BUF_SIZE) == BUF_SIZE);
+      ASSERT (!memcmp (buf, check_buf, BUF_SIZE));
+    }
+  file_close (file);
+}
+
+/* Runs the benchmark. */
+void
+test (void)
+{
+  struct file *file;
+  off_t ofs;
+
+  ASSERT (filesys_create ("copy-src", 0));
+  file = open_file ("copy-src");
+  for (ofs = 0; ofs < FILE_SIZE; ofs += BUF_SIZE)
+    {
+      fill (ofs);
+      ASSERT (file_write (file, buf, BUF_SIZE) == BUF_SIZE);
+    }
+  file_close (file);
+
+  copy ("copy-loop", true);
+  copy ("copy-kernel", false);
+  check ("copy-loop");
+  check ("copy-kernel");
+
+  ASSERT (filesys_remove ("copy-src"));
+  ASSERT (filesys_remove ("copy-loop"));
+  ASSERT (filesys_remove ("copy-kernel"));
+  printf ("copy: PASS\n");
+}
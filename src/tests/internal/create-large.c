@@ -0,0 +1,73 @@
+/* Test for creating files with a large initial size.
+
+   Creates a file whose initial size is FILE_SIZE bytes, far more
+   than one journal operation may change, and checks that it
+   reads back as zeros and can be written at its end.  Then tries
+   to create a second file of the same size, which must fail for
+   lack of space without leaving the file behind, and succeeds
+   once the first file is removed.
+
+   Needs between FILE_SIZE and 2 * FILE_SIZE bytes free. */
+
+#undef NDEBUG
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/block.h"
+#include "filesys/file.h"
+#include "filesys/filesys.h"
+#include "filesys/journal.h"
+#include "threads/test.h"
+
+/* Initial size of each file, in bytes. */
+#define FILE_SIZE (6 * 1024 * 1024)
+
+/* Distance between the sectors checked for zeros. */
+#define CHECK_STRIDE (64 * 1024)
+
+static char buf[BLOCK_SECTOR_SIZE];
+
+/* Checks that file NAME is FILE_SIZE bytes long, that it reads
+   as zeros, and that its last byte can be written. */
+static void
+check (const char *name)
+{
+  struct file *file = filesys_open (name);
+  off_t ofs;
+  size_t i;
+
+  ASSERT (file != NULL);
+  ASSERT (file_length (file) == FILE_SIZE);
+  for (ofs = 0; ofs < FILE_SIZE; ofs += CHECK_STRIDE)
+    {
+      ASSERT (file_read_at (file, buf, sizeof buf, ofs) == sizeof buf);
+      for (i = 0; i < sizeof buf; i++)
+        ASSERT (buf[i] == 0);
+    }
+
+  ASSERT (file_write_at (file, "x", 1, FILE_SIZE - 1) == 1);
+  ASSERT (file_read_at (file, buf, 1, FILE_SIZE - 1) == 1);
+  ASSERT (buf[0] == 'x');
+  ASSERT (file_length (file) == FILE_SIZE);
+  file_close (file);
+}
+
+/* Runs the test. */
+void
+test (void)
+{
+  ASSERT (filesys_create ("big1", FILE_SIZE));
+  check ("big1");
+
+  ASSERT (!filesys_create ("big2", FILE_SIZE));
+  ASSERT (filesys_open ("big2") == NULL);
+
+  /* Sectors released by the removal may not be allocated again
+     until the transaction that released them commits. */
+  ASSERT (filesys_remove ("big1"));
+  journal_commit ();
+  ASSERT (filesys_create ("big2", FILE_SIZE));
+  check ("big2");
+  ASSERT (filesys_remove ("big2"));
+  printf ("create-large: PASS\n");
+}
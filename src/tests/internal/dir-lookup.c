@@ -0,0 +1,62 @@
+/* Lookup benchmark for large directories.
+
+   Creates FILE_CNT empty files in one directory, then opens each
+   of them by name, in a scattered order, and reports the time
+   taken by each phase.  With a linear directory scan both phases
+   take time quadratic in FILE_CNT; with the directory index they
+   should grow roughly linearly.
+
+   Needs FILE_CNT free sectors plus room for the directory. */
+
+#undef NDEBUG
+#include <debug.h>
+#include <stdio.h>
+#include "devices/timer.h"
+#include "filesys/file.h"
+#include "filesys/filesys.h"
+#include "threads/test.h"
+
+/* Number of files to create. */
+#define FILE_CNT 5000
+
+/* Stride through the files when looking them up.  Relatively
+   prime to FILE_CNT, so that every file is visited once. */
+#define LOOKUP_STRIDE 997
+
+/* Returns the name of file I. */
+static const char *
+file_name (int i)
+{
+  static char name[16];
+  snprintf (name, sizeof name, "d%d", i);
+  return name;
+}
+
+/* Runs the benchmark. */
+void
+test (void)
+{
+  int64_t start;
+  int i, j;
+
+  start = timer_ticks ();
+  for (i = 0; i < FILE_CNT; i++)
+    ASSERT (filesys_create (file_name (i), 0));
+  printf ("created %d files in %lld ticks\n",
+          FILE_CNT, timer_elapsed (start));
+
+  start = timer_ticks ();
+  for (i = j = 0; i < FILE_CNT; i++, j = (j + LOOKUP_STRIDE) % FILE_CNT)
+    {
+      struct file *file = filesys_open (file_name (j));
+      ASSERT (file != NULL);
+      file_close (file);
+    }
+  printf ("opened %d files in %lld ticks\n",
+          FILE_CNT, timer_elapsed (start));
+
+  ASSERT (filesys_open ("missing") == NULL);
+  for (i = 0; i < FILE_CNT; i++)
+    ASSERT (filesys_remove (file_name (i)));
+  printf ("dir-lookup: PASS\n");
+}
@@ -0,0 +1,146 @@
+/* Fragmentation benchmark for the file system's block
+   allocator.
+
+   Creates a set of files in two ways: each written with a single
+   large write, and all of them grown together by appending small
+   chunks round-robin, which is the pattern that scatters a naive
+   first-fit allocator's sectors across the disk.  For each set,
+   reports the average number of extents (runs of consecutive
+   sectors) per file, as counted by inode_extent_cnt(), and the
+   throughput of reading the files back sequentially.
+
+   Needs FILE_CNT * FILE_SIZE bytes free. */
+
+#undef NDEBUG
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "filesys/file.h"
+#include "filesys/filesys.h"
+#include "filesys/inode.h"
+#include "threads/test.h"
+
+/* Number of files in each set. */
+#define FILE_CNT 8
+
+/* Size of each file, in bytes. */
+#define FILE_SIZE (64 * 1024)
+
+/* Size of each append in the interleaved set. */
+#define CHUNK_SIZE 100
+
+/* Size of each read when reading the files back. */
+#define READ_SIZE 4096
+
+static char buf[FILE_SIZE];
+
+static void create_files (void);
+static void write_bulk (struct file *[FILE_CNT]);
+static void write_interleaved (struct file *[FILE_CNT]);
+static void measure (const char *, void (*) (struct file *[FILE_CNT]));
+
+/* Runs the benchmark. */
+void
+test (void)
+{
+  size_t i;
+
+  for (i = 0; i < sizeof buf; i++)
+    buf[i] = i % 251;
+
+  printf ("%-12s %10s %14s\n", "layout", "extents", "bytes/tick");
+  measure ("bulk", write_bulk);
+  measure ("interleaved", write_interleaved);
+  printf ("fragment: PASS\n");
+}
+
+/* Returns the name of file I in a set. */
+static const char *
+file_name (int i)
+{
+  static char name[16];
+  snprintf (name, sizeof name, "frag%d", i);
+  return name;
+}
+
+/* Creates the empty files of a set. */
+static void
+create_files (void)
+{
+  int i;
+
+  for (i = 0; i < FILE_CNT; i++)
+    ASSERT (filesys_create (file_name (i), 0));
+}
+
+/* Writes each file in one go. */
+static void
+write_bulk (struct file *files[FILE_CNT])
+{
+  int i;
+
+  for (i = 0; i < FILE_CNT; i++)
+    ASSERT (file_write (files[i], buf, FILE_SIZE) == FILE_SIZE);
+}
+
+/* Grows all of the files together, a chunk at a time. */
+static void
+write_interleaved (struct file *files[FILE_CNT])
+{
+  int ofs, i;
+
+  for (ofs = 0; ofs < FILE_SIZE; ofs += CHUNK_SIZE)
+    {
+      int size = FILE_SIZE - ofs < CHUNK_SIZE ? FILE_SIZE - ofs : CHUNK_SIZE;
+      for (i = 0; i < FILE_CNT; i++)
+        ASSERT (file_write (files[i], buf + ofs, size) == size);
+    }
+}
+
+/* Creates a set of files with WRITE, prints its average extents
+   per file and sequential read throughput, and removes it. */
+static void
+measure (const char *layout, void (*write) (struct file *[FILE_CNT]))
+{
+  static char read_buf[READ_SIZE];
+  struct file *files[FILE_CNT];
+  size_t extent_cnt = 0;
+  int64_t start, ticks;
+  int i;
+
+  create_files ();
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      files[i] = filesys_open (file_name (i));
+      ASSERT (files[i] != NULL);
+    }
+  write (files);
+
+  for (i = 0; i < FILE_CNT; i++)
+    extent_cnt += inode_extent_cnt (file_get_inode (files[i]));
+
+  start = timer_ticks ();
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      off_t ofs;
+
+      file_seek (files[i], 0);
+      for (ofs = 0; ofs < FILE_SIZE; ofs += READ_SIZE)
+        {
+          ASSERT (file_read (files[i], read_buf, READ_SIZE) == READ_SIZE);
+          ASSERT (!memcmp (read_buf, buf + ofs, READ_SIZE));
+        }
+    }
+  ticks = timer_elapsed (start);
+
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      file_close (files[i]);
+      ASSERT (filesys_remove (file_name (i)));
+    }
+
+  printf ("%-12s %8zu.%zu %14lld\n", layout,
+          extent_cnt / FILE_CNT, extent_cnt * 10 / FILE_CNT % 10,
+          ticks > 0 ? (long long) FILE_CNT * FILE_SIZE / ticks : -1LL);
+}
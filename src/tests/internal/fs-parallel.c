@@ -0,0 +1,138 @@
+/* Throughput benchmark for file system access by several
+   threads at once.
+
+   Creates THREAD_CNT files, one per worker thread, then has each
+   worker write its own file and read it back PASS_CNT times,
+   first with the workers running one after another and then
+   with all of them running together.  Reports the throughput of
+   each run.  Kernel threads stand in for user processes, which
+   reach the file system through the same calls.  When the file
+   system serializes all access behind one lock, running the
+   workers together gains nothing; with per-file locking, one
+   worker's disk waits overlap with the others' work.
+
+   Needs THREAD_CNT * FILE_SIZE bytes free. */
+
+#undef NDEBUG
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "filesys/file.h"
+#include "filesys/filesys.h"
+#include "threads/synch.h"
+#include "threads/test.h"
+#include "threads/thread.h"
+
+/* Number of worker threads, and of files. */
+#define THREAD_CNT 4
+
+/* Size of each file, in bytes.  All of the files together are
+   several times the size of the sector cache, so reads go to
+   disk. */
+#define FILE_SIZE (64 * 1024)
+
+/* Size of each read or write. */
+#define BLOCK_SIZE 4096
+
+/* Number of times each worker reads its file. */
+#define PASS_CNT 4
+
+/* A worker thread. */
+struct worker
+  {
+    int id;                     /* Index of the worker's file. */
+    struct semaphore done;      /* Upped when the worker finishes. */
+    char buf[BLOCK_SIZE];       /* Data buffer. */
+  };
+
+static struct worker workers[THREAD_CNT];
+
+/* Returns the name of file I. */
+static const char *
+file_name (int i)
+{
+  static char names[THREAD_CNT][16];
+  snprintf (names[i], sizeof names[i], "par%d", i);
+  return names[i];
+}
+
+/* Writes worker W's file and reads it back PASS_CNT times,
+   checking its contents. */
+static void
+work (void *w_)
+{
+  struct worker *w = w_;
+  struct file *file = filesys_open (file_name (w->id));
+  off_t ofs;
+  int pass;
+
+  ASSERT (file != NULL);
+  memset (w->buf, 'a' + w->id, sizeof w->buf);
+  for (ofs = 0; ofs < FILE_SIZE; ofs += BLOCK_SIZE)
+    ASSERT (file_write_at (file, w->buf, BLOCK_SIZE, ofs) == BLOCK_SIZE);
+  for (pass = 0; pass < PASS_CNT; pass++)
+    for (ofs = 0; ofs < FILE_SIZE; ofs += BLOCK_SIZE)
+      {
+        ASSERT (file_read_at (file, w->buf, BLOCK_SIZE, ofs) == BLOCK_SIZE);
+        ASSERT (w->buf[0] == 'a' + w->id
+                && w->buf[BLOCK_SIZE - 1] == 'a' + w->id);
+      }
+  file_close (file);
+  sema_up (&w->done);
+}
+
+/* Starts worker I. */
+static void
+start (int i)
+{
+  char name[16];
+
+  snprintf (name, sizeof name, "worker%d", i);
+  workers[i].id = i;
+  sema_init (&workers[i].done, 0);
+  thread_create (name, PRI_DEFAULT, work, &workers[i]);
+}
+
+/* Runs the workers one after another if TOGETHER is false, or
+   all at once if it is true, and prints the throughput,
+   labeled with LABEL. */
+static void
+measure (const char *label, bool together)
+{
+  long long bytes = (long long) THREAD_CNT * FILE_SIZE * (PASS_CNT + 1);
+  int64_t start_ticks = timer_ticks ();
+  int64_t ticks;
+  int i;
+
+  for (i = 0; i < THREAD_CNT; i++)
+    {
+      start (i);
+      if (!together)
+        sema_down (&workers[i].done);
+    }
+  if (together)
+    for (i = 0; i < THREAD_CNT; i++)
+      sema_down (&workers[i].done);
+  ticks = timer_elapsed (start_ticks);
+
+  printf ("%-12s %8lld ticks %10lld bytes/tick\n",
+          label, ticks, ticks > 0 ? bytes / ticks : -1LL);
+}
+
+/* Runs the benchmark. */
+void
+test (void)
+{
+  int i;
+
+  for (i = 0; i < THREAD_CNT; i++)
+    ASSERT (filesys_create (file_name (i), 0));
+
+  measure ("one by one", false);
+  measure ("together", true);
+
+  for (i = 0; i < THREAD_CNT; i++)
+    ASSERT (filesys_remove (file_name (i)));
+  printf ("fs-parallel: PASS\n");
+}
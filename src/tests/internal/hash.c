@@ -0,0 +1,188 @@
+/* Test program for the sample hash functions in
+   lib/kernel/hash.c.
+
+   Checks that hash_int(), hash_ptr(), hash_string(), and
+   hash_bytes() spread typical kernel keys (consecutive sector
+   numbers, page-aligned addresses, similar file names) evenly
+   over a power-of-2 number of buckets, the way struct hash uses
+   them, by computing a chi-square statistic over the bucket
+   counts.  Then measures their throughput against the
+   byte-at-a-time FNV-1 hash they replaced. */
+
+#undef NDEBUG
+#include <debug.h>
+#include <hash.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "threads/test.h"
+#include "threads/vaddr.h"
+
+/* Number of buckets, a power of 2 as in struct hash. */
+#define BUCKET_CNT 1024
+
+/* Keys hashed per distribution check. */
+#define KEY_CNT (16 * BUCKET_CNT)
+
+/* For BUCKET_CNT - 1 degrees of freedom the chi-square statistic
+   has mean 1023 and standard deviation about 45.  Allow four
+   standard deviations. */
+#define CHI_SQUARE_LIMIT (BUCKET_CNT - 1 + 4 * 45)
+
+/* Hash calls per throughput measurement. */
+#define BENCH_CNT (1024 * 1024)
+
+/* A source of keys: returns the hash of the I'th key. */
+typedef unsigned key_hash_func (int i);
+
+static unsigned counts[BUCKET_CNT];
+
+static void check_distribution (void);
+static void bench (void);
+
+/* Test the sample hash functions. */
+void
+test (void)
+{
+  printf ("testing hash distribution:\n");
+  check_distribution ();
+  bench ();
+  printf ("hash: PASS\n");
+}
+
+/* Consecutive sector numbers. */
+static unsigned
+sector_key (int i)
+{
+  return hash_int (i);
+}
+
+/* Consecutive user page addresses. */
+static unsigned
+page_key (int i)
+{
+  return hash_ptr ((uint8_t *) 0x08048000 + i * PGSIZE);
+}
+
+/* File names that differ only in a numeric suffix. */
+static unsigned
+name_key (int i)
+{
+  char name[16];
+  snprintf (name, sizeof name, "file-%d", i);
+  return hash_string (name);
+}
+
+/* Consecutive sector numbers, hashed as bytes. */
+static unsigned
+bytes_key (int i)
+{
+  uint32_t sector = i;
+  return hash_bytes (&sector, sizeof sector);
+}
+
+/* 512-byte blocks that differ only in their last word. */
+static unsigned
+block_key (int i)
+{
+  static uint32_t block[512 / sizeof (uint32_t)];
+  block[sizeof block / sizeof *block - 1] = i;
+  return hash_bytes (block, sizeof block);
+}
+
+/* Hashes KEY_CNT keys from KEY into BUCKET_CNT buckets, prints
+   the chi-square statistic, and fails if it is too far from
+   what a uniform distribution would give. */
+static void
+check_key_set (const char *name, key_hash_func *key)
+{
+  unsigned expect = KEY_CNT / BUCKET_CNT;
+  unsigned long long sum = 0;
+  unsigned chi_square;
+  int i;
+
+  memset (counts, 0, sizeof counts);
+  for (i = 0; i < KEY_CNT; i++)
+    counts[key (i) & (BUCKET_CNT - 1)]++;
+
+  for (i = 0; i < BUCKET_CNT; i++)
+    {
+      int d = (int) counts[i] - (int) expect;
+      sum += d * d;
+    }
+  chi_square = sum / expect;
+
+  printf ("  %-16s chi-square %u (limit %d)\n",
+          name, chi_square, CHI_SQUARE_LIMIT);
+  ASSERT (chi_square <= CHI_SQUARE_LIMIT);
+}
+
+/* Checks each of the key sets. */
+static void
+check_distribution (void)
+{
+  check_key_set ("sector numbers", sector_key);
+  check_key_set ("page addresses", page_key);
+  check_key_set ("file names", name_key);
+  check_key_set ("sector bytes", bytes_key);
+  check_key_set ("blocks", block_key);
+}
+
+/* The Fowler-Noll-Vo hash previously used by hash_bytes(). */
+static unsigned
+fnv_bytes (const void *buf_, size_t size)
+{
+  const unsigned char *buf = buf_;
+  unsigned hash = 2166136261u;
+
+  while (size-- > 0)
+    hash = (hash * 16777619u) ^ *buf++;
+  return hash;
+}
+
+/* The Fowler-Noll-Vo hash previously used by hash_string(). */
+static unsigned
+fnv_string (const char *s_)
+{
+  const unsigned char *s = (const unsigned char *) s_;
+  unsigned hash = 2166136261u;
+
+  while (*s != '\0')
+    hash = (hash * 16777619u) ^ *s++;
+  return hash;
+}
+
+/* Prints hash calls per timer tick for each function, next to
+   the FNV-1 version it replaced. */
+static void
+bench (void)
+{
+  static uint8_t block[512];
+  const char *name = "a-typical-file.name";
+  volatile unsigned sink = 0;
+  int64_t start, ticks[6];
+  int i, t = 0;
+
+#define TIME(STMT)                              \
+  start = timer_ticks ();                       \
+  for (i = 0; i < BENCH_CNT; i++)               \
+    STMT;                                       \
+  ticks[t++] = timer_elapsed (start);
+
+  TIME (sink += hash_int (i));
+  TIME (sink += fnv_bytes (&i, sizeof i));
+  TIME (sink += hash_string (name));
+  TIME (sink += fnv_string (name));
+  TIME (sink += hash_bytes (block, sizeof block));
+  TIME (sink += fnv_bytes (block, sizeof block));
+#undef TIME
+
+  printf ("hash calls per tick, new vs. FNV-1 (-1: under one tick):\n");
+  for (t = 0; t < 6; t += 2)
+    printf ("  %-16s %8lld %8lld\n",
+            t == 0 ? "int" : t == 2 ? "string" : "512-byte block",
+            ticks[t] > 0 ? (long long) (BENCH_CNT / ticks[t]) : -1LL,
+            ticks[t + 1] > 0
+            ? (long long) (BENCH_CNT / ticks[t + 1]) : -1LL);
+}
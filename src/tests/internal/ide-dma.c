@@ -0,0 +1,73 @@
+/* IDE DMA benchmark.
+
+   Writes RUN_SECTORS sectors to the scratch device, then reads
+   them back PASS_CNT times into each of two buffers: one from
+   palloc_get_multiple(), which the IDE driver can reach by DMA,
+   and one from vmalloc(), which it cannot, so that reads into it
+   fall back to PIO.  Reports the time taken by each and checks
+   the data read.  With no bus-master controller, both take the
+   same time.
+
+   Needs a scratch disk of at least RUN_SECTORS sectors. */
+
+#undef NDEBUG
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/block.h"
+#include "devices/timer.h"
+#include "threads/palloc.h"
+#include "threads/test.h"
+#include "threads/vaddr.h"
+#include "threads/vmalloc.h"
+
+/* Number of sectors in each read. */
+#define RUN_SECTORS 256
+
+/* Size of a buffer of RUN_SECTORS sectors. */
+#define RUN_SIZE (RUN_SECTORS * BLOCK_SECTOR_SIZE)
+
+/* Number of times the sectors are read into each buffer. */
+#define PASS_CNT 16
+
+/* Reads the sectors into BUF PASS_CNT times, compares them with
+   EXPECTED, and prints the time taken, labeled with LABEL. */
+static void
+measure (const char *label, struct block *block, uint8_t *buf,
+         const uint8_t *expected)
+{
+  int64_t start = timer_ticks ();
+  int pass;
+
+  for (pass = 0; pass < PASS_CNT; pass++)
+    block_read_multi (block, 0, RUN_SECTORS, buf);
+  printf ("%-8s %8lld ticks\n", label, timer_elapsed (start));
+  ASSERT (!memcmp (buf, expected, RUN_SIZE));
+}
+
+/* Runs the benchmark. */
+void
+test (void)
+{
+  struct block *block = block_get_role (BLOCK_SCRATCH);
+  uint8_t *data = palloc_get_multiple (PAL_ASSERT, RUN_SIZE / PGSIZE);
+  uint8_t *dma_buf = palloc_get_multiple (PAL_ASSERT, RUN_SIZE / PGSIZE);
+  uint8_t *pio_buf = vmalloc (RUN_SIZE);
+  size_t i;
+
+  ASSERT (block != NULL);
+  ASSERT (block_size (block) >= RUN_SECTORS);
+  ASSERT (pio_buf != NULL);
+
+  for (i = 0; i < RUN_SIZE; i++)
+    data[i] = i % 251;
+  block_write_multi (block, 0, RUN_SECTORS, data);
+
+  measure ("DMA", block, dma_buf, data);
+  measure ("PIO", block, pio_buf, data);
+
+  vfree (pio_buf);
+  palloc_free_multiple (dma_buf, RUN_SIZE / PGSIZE);
+  palloc_free_multiple (data, RUN_SIZE / PGSIZE);
+  printf ("ide-dma: PASS\n");
+}
@@ -0,0 +1,77 @@
+/* Benchmark for opening many files at once.
+
+   Creates FILE_CNT files and opens all of them, keeping every
+   one open, then closes them and opens them all again.  Reports
+   the time taken by each pass.  With the open inodes kept in a
+   list, each open searches every inode already open, so the
+   first pass takes time quadratic in FILE_CNT.
+
+   Needs FILE_CNT free sectors. */
+
+#undef NDEBUG
+#include <debug.h>
+#include <stdio.h>
+#include "devices/timer.h"
+#include "filesys/file.h"
+#include "filesys/filesys.h"
+#include "threads/test.h"
+
+/* Number of files. */
+#define FILE_CNT 2000
+
+static struct file *files[FILE_CNT];
+
+/* Returns the name of file I. */
+static const char *
+file_name (int i)
+{
+  static char name[16];
+  snprintf (name, sizeof name, "o%d", i);
+  return name;
+}
+
+/* Opens every file and prints the time taken, labeled with
+   PASS. */
+static void
+open_all (const char *pass)
+{
+  int64_t start = timer_ticks ();
+  int i;
+
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      files[i] = filesys_open (file_name (i));
+      ASSERT (files[i] != NULL);
+    }
+  printf ("%s: opened %d files in %lld ticks\n",
+          pass, FILE_CNT, timer_elapsed (start));
+}
+
+/* Closes every file. */
+static void
+close_all (void)
+{
+  int i;
+
+  for (i = 0; i < FILE_CNT; i++)
+    file_close (files[i]);
+}
+
+/* Runs the benchmark. */
+void
+test (void)
+{
+  int i;
+
+  for (i = 0; i < FILE_CNT; i++)
+    ASSERT (filesys_create (file_name (i), 0));
+
+  open_all ("first");
+  close_all ();
+  open_all ("again");
+  close_all ();
+
+  for (i = 0; i < FILE_CNT; i++)
+    ASSERT (filesys_remove (file_name (i)));
+  printf ("inode-open: PASS\n");
+}
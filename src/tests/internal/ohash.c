@@ -0,0 +1,148 @@
+/* Test program for lib/kernel/ohash.c.
+
+   Runs a long random sequence of insertions, deletions, and
+   lookups against an open-addressing hash table and checks every
+   result against a plain array of flags.  The hash function is
+   deliberately poor, so that probe runs get long and the
+   backward-shift deletion and incremental migration code are
+   exercised. */
+
+#undef NDEBUG
+#include <debug.h>
+#include <ohash.h>
+#include <random.h>
+#include <stdio.h>
+#include "threads/test.h"
+
+/* Number of distinct keys. */
+#define KEY_CNT 4096
+
+/* Number of random operations. */
+#define OP_CNT 200000
+
+/* A hash table element. */
+struct value
+  {
+    struct hash_elem elem;      /* Hash element. */
+    int key;                    /* Key. */
+  };
+
+static struct value values[KEY_CNT];
+static bool present[KEY_CNT];
+
+static unsigned value_hash (const struct hash_elem *, void *);
+static bool value_less (const struct hash_elem *, const struct hash_elem *,
+                        void *);
+static void verify_iteration (struct ohash *, size_t size);
+
+/* Test the open-addressing hash table implementation. */
+void
+test (void)
+{
+  struct ohash h;
+  size_t size = 0;
+  int i;
+
+  ASSERT (ohash_init (&h, value_hash, value_less, NULL));
+  for (i = 0; i < KEY_CNT; i++)
+    values[i].key = i;
+
+  printf ("testing random operations:");
+  for (i = 0; i < OP_CNT; i++)
+    {
+      /* Use the whole key space for the first half, so the
+         table grows, then a tenth of it, so the table shrinks. */
+      int key_cnt = i < OP_CNT / 2 ? KEY_CNT : KEY_CNT / 10;
+      struct value *v = &values[random_ulong () % key_cnt];
+      struct hash_elem *e;
+
+      switch (random_ulong () % 4)
+        {
+        case 0:
+          e = ohash_insert (&h, &v->elem);
+          ASSERT ((e != NULL) == present[v->key]);
+          if (!present[v->key])
+            size++;
+          present[v->key] = true;
+          break;
+
+        case 1:
+          e = ohash_replace (&h, &v->elem);
+          ASSERT ((e != NULL) == present[v->key]);
+          if (!present[v->key])
+            size++;
+          present[v->key] = true;
+          break;
+
+        case 2:
+          e = ohash_delete (&h, &v->elem);
+          ASSERT ((e != NULL) == present[v->key]);
+          if (present[v->key])
+            size--;
+          present[v->key] = false;
+          break;
+
+        case 3:
+          e = ohash_find (&h, &v->elem);
+          ASSERT ((e != NULL) == present[v->key]);
+          ASSERT (e == NULL || e == &v->elem);
+          break;
+        }
+      ASSERT (ohash_size (&h) == size);
+
+      if (i % 10000 == 0)
+        {
+          printf (" %d", i);
+          verify_iteration (&h, size);
+        }
+    }
+
+  ohash_destroy (&h, NULL);
+  printf (" done\n");
+  printf ("ohash: PASS\n");
+}
+
+/* Hashes a value by its key.  Multiplying by a small odd number
+   keeps neighboring keys close together, which makes probe runs
+   long. */
+static unsigned
+value_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  return hash_entry (e, struct value, elem)->key * 3u;
+}
+
+/* Returns true if value A's key is less than value B's. */
+static bool
+value_less (const struct hash_elem *a_, const struct hash_elem *b_,
+            void *aux UNUSED)
+{
+  const struct value *a = hash_entry (a_, struct value, elem);
+  const struct value *b = hash_entry (b_, struct value, elem);
+
+  return a->key < b->key;
+}
+
+/* Verifies that iterating H visits exactly the SIZE values
+   marked present, once each. */
+static void
+verify_iteration (struct ohash *h, size_t size)
+{
+  static bool seen[KEY_CNT];
+  struct ohash_iterator i;
+  size_t cnt = 0;
+  int key;
+
+  for (key = 0; key < KEY_CNT; key++)
+    seen[key] = false;
+
+  ohash_first (&i, h);
+  while (ohash_next (&i))
+    {
+      struct value *v = hash_entry (ohash_cur (&i), struct value, elem);
+      ASSERT (present[v->key]);
+      ASSERT (!seen[v->key]);
+      seen[v->key] = true;
+      cnt++;
+    }
+  ASSERT (cnt == size);
+}
@@ -0,0 +1,314 @@
+/* Test program for lib/kernel/rbtree.c.
+
+   Builds red-black trees from random sequences of insertions
+   and removals, with plenty of duplicate keys, and after every
+   step checks the red-black invariants, parent links, element
+   count, and augmented data.  Also checks in-order iteration in
+   both directions, rb_find(), rb_lower_bound(), and
+   rb_upper_bound() against a linear scan, and uses the
+   augmented data to answer interval overlap queries, checked
+   against a brute-force scan. */
+
+#undef NDEBUG
+#include <debug.h>
+#include <random.h>
+#include <rbtree.h>
+#include <stdio.h>
+#include "threads/test.h"
+
+/* Maximum number of elements in a tree. */
+#define MAX_SIZE 256
+
+/* Keys are drawn from [0, KEY_RANGE), so duplicates are common. */
+#define KEY_RANGE 128
+
+/* Interval lengths are drawn from [1, MAX_LEN]. */
+#define MAX_LEN 16
+
+/* Random operations per tree. */
+#define OP_CNT 2000
+
+/* Number of trees to build. */
+#define TREE_CNT 50
+
+/* An interval [start, end), ordered by start. */
+struct interval
+  {
+    struct rb_elem elem;        /* Tree element. */
+    int start;                  /* First value in interval. */
+    int end;                    /* One past last value in interval. */
+    int max_end;                /* Greatest `end' in this subtree. */
+    bool in_tree;               /* Currently in the tree? */
+  };
+
+static struct interval intervals[MAX_SIZE];
+
+static bool interval_less (const struct rb_elem *, const struct rb_elem *,
+                           void *);
+static void interval_augment (struct rb_elem *, void *);
+static void verify_tree (struct rbtree *);
+static void verify_order (struct rbtree *);
+static void verify_search (struct rbtree *);
+static void verify_overlaps (struct rbtree *);
+
+/* Test the red-black tree implementation. */
+void
+test (void)
+{
+  int tree;
+
+  printf ("testing random trees:");
+  for (tree = 0; tree < TREE_CNT; tree++)
+    {
+      struct rbtree t;
+      int op;
+      int i;
+
+      printf (" %d", tree);
+      rb_init (&t, interval_less, interval_augment, NULL);
+      for (i = 0; i < MAX_SIZE; i++)
+        intervals[i].in_tree = false;
+
+      for (op = 0; op < OP_CNT; op++)
+        {
+          struct interval *v = &intervals[random_ulong () % MAX_SIZE];
+
+          if (!v->in_tree)
+            {
+              v->start = random_ulong () % KEY_RANGE;
+              v->end = v->start + 1 + random_ulong () % MAX_LEN;
+              rb_insert (&t, &v->elem);
+              v->in_tree = true;
+            }
+          else
+            {
+              rb_remove (&t, &v->elem);
+              v->in_tree = false;
+            }
+
+          verify_tree (&t);
+          if (op % 16 == 0)
+            {
+              verify_order (&t);
+              verify_search (&t);
+              verify_overlaps (&t);
+            }
+        }
+
+      /* Empty the tree in order. */
+      while (!rb_empty (&t))
+        {
+          struct rb_elem *e = rb_first (&t);
+          rb_remove (&t, e);
+          rb_entry (e, struct interval, elem)->in_tree = false;
+          verify_tree (&t);
+        }
+      ASSERT (rb_size (&t) == 0);
+    }
+
+  printf (" done\n");
+  printf ("rbtree: PASS\n");
+}
+
+/* Orders intervals by start. */
+static bool
+interval_less (const struct rb_elem *a_, const struct rb_elem *b_,
+               void *aux UNUSED)
+{
+  const struct interval *a = rb_entry (a_, struct interval, elem);
+  const struct interval *b = rb_entry (b_, struct interval, elem);
+
+  return a->start < b->start;
+}
+
+/* Recomputes the greatest end in E's subtree. */
+static void
+interval_augment (struct rb_elem *e, void *aux UNUSED)
+{
+  struct interval *v = rb_entry (e, struct interval, elem);
+
+  v->max_end = v->end;
+  if (e->left != NULL)
+    {
+      int left_max = rb_entry (e->left, struct interval, elem)->max_end;
+      if (left_max > v->max_end)
+        v->max_end = left_max;
+    }
+  if (e->right != NULL)
+    {
+      int right_max = rb_entry (e->right, struct interval, elem)->max_end;
+      if (right_max > v->max_end)
+        v->max_end = right_max;
+    }
+}
+
+/* Verifies the subtree rooted at E, whose parent is PARENT and
+   whose starts must lie in [LO, HI].  Returns its black height
+   and adds its size to *CNT. */
+static int
+verify_subtree (struct rb_elem *e, struct rb_elem *parent,
+                int lo, int hi, size_t *cnt)
+{
+  struct interval *v;
+  int left_height, right_height;
+  int max_end;
+
+  if (e == NULL)
+    return 1;
+
+  v = rb_entry (e, struct interval, elem);
+  ASSERT (e->parent == parent);
+  ASSERT (v->in_tree);
+  ASSERT (v->start >= lo && v->start <= hi);
+
+  /* A red element has no red child. */
+  if (e->red)
+    {
+      ASSERT (e->left == NULL || !e->left->red);
+      ASSERT (e->right == NULL || !e->right->red);
+    }
+
+  /* Both subtrees have the same black height. */
+  left_height = verify_subtree (e->left, e, lo, v->start, cnt);
+  right_height = verify_subtree (e->right, e, v->start, hi, cnt);
+  ASSERT (left_height == right_height);
+
+  /* Augmented data is current. */
+  max_end = v->end;
+  if (e->left != NULL
+      && rb_entry (e->left, struct interval, elem)->max_end > max_end)
+    max_end = rb_entry (e->left, struct interval, elem)->max_end;
+  if (e->right != NULL
+      && rb_entry (e->right, struct interval, elem)->max_end > max_end)
+    max_end = rb_entry (e->right, struct interval, elem)->max_end;
+  ASSERT (v->max_end == max_end);
+
+  ++*cnt;
+  return left_height + !e->red;
+}
+
+/* Verifies the structure of tree T. */
+static void
+verify_tree (struct rbtree *t)
+{
+  size_t expect = 0;
+  size_t cnt = 0;
+  int i;
+
+  for (i = 0; i < MAX_SIZE; i++)
+    if (intervals[i].in_tree)
+      expect++;
+
+  ASSERT (rb_root (t) == NULL || !rb_root (t)->red);
+  verify_subtree (rb_root (t), NULL, 0, KEY_RANGE, &cnt);
+  ASSERT (cnt == expect);
+  ASSERT (rb_size (t) == expect);
+  ASSERT (rb_empty (t) == (expect == 0));
+}
+
+/* Verifies that iterating T forward and backward visits every
+   element once, in order. */
+static void
+verify_order (struct rbtree *t)
+{
+  struct rb_elem *e, *prev;
+  size_t cnt;
+
+  cnt = 0;
+  prev = NULL;
+  for (e = rb_first (t); e != NULL; e = rb_next (e))
+    {
+      ASSERT (prev == NULL || !interval_less (e, prev, NULL));
+      ASSERT (rb_prev (e) == prev);
+      prev = e;
+      cnt++;
+    }
+  ASSERT (prev == rb_last (t));
+  ASSERT (cnt == rb_size (t));
+
+  cnt = 0;
+  for (e = rb_last (t); e != NULL; e = rb_prev (e))
+    cnt++;
+  ASSERT (cnt == rb_size (t));
+}
+
+/* Verifies the search functions against a linear scan, for
+   every possible key. */
+static void
+verify_search (struct rbtree *t)
+{
+  struct interval key;
+  int k;
+
+  for (k = -1; k <= KEY_RANGE; k++)
+    {
+      struct rb_elem *lower = NULL, *upper = NULL;
+      struct rb_elem *e;
+
+      key.start = k;
+      for (e = rb_last (t); e != NULL; e = rb_prev (e))
+        {
+          int start = rb_entry (e, struct interval, elem)->start;
+          if (start >= k)
+            lower = e;
+          if (start > k)
+            upper = e;
+        }
+
+      ASSERT (rb_lower_bound (t, &key.elem) == lower);
+      ASSERT (rb_upper_bound (t, &key.elem) == upper);
+      ASSERT (rb_find (t, &key.elem)
+              == (lower != NULL && lower != upper ? lower : NULL));
+    }
+}
+
+/* Returns the number of intervals in the subtree rooted at E
+   that overlap [LO, HI), skipping subtrees that cannot contain
+   one.  Counts the elements visited in *VISITED. */
+static size_t
+count_overlaps (struct rb_elem *e, int lo, int hi, size_t *visited)
+{
+  struct interval *v;
+  size_t cnt;
+
+  if (e == NULL)
+    return 0;
+  v = rb_entry (e, struct interval, elem);
+  if (v->max_end <= lo)
+    return 0;
+  ++*visited;
+
+  cnt = count_overlaps (e->left, lo, hi, visited);
+  if (v->start < hi)
+    {
+      if (v->end > lo)
+        cnt++;
+      cnt += count_overlaps (e->right, lo, hi, visited);
+    }
+  return cnt;
+}
+
+/* Verifies interval overlap queries over T against a brute-force
+   scan of all intervals. */
+static void
+verify_overlaps (struct rbtree *t)
+{
+  int q;
+
+  for (q = 0; q < 16; q++)
+    {
+      int lo = random_ulong () % (KEY_RANGE + MAX_LEN);
+      int hi = lo + 1 + random_ulong () % MAX_LEN;
+      size_t expect = 0;
+      size_t visited = 0;
+      int i;
+
+      for (i = 0; i < MAX_SIZE; i++)
+        if (intervals[i].in_tree
+            && intervals[i].start < hi && intervals[i].end > lo)
+          expect++;
+
+      ASSERT (count_overlaps (rb_root (t), lo, hi, &visited) == expect);
+      ASSERT (visited <= rb_size (t));
+    }
+}
@@ -0,0 +1,89 @@
+/* Read throughput benchmark by read size.
+
+   Writes a file of FILE_SIZE bytes, then reads it sequentially
+   PASS_CNT times with each of several read sizes, into a
+   page-aligned buffer as a user process's read() would, and
+   reports the throughput for each size.  Reads of a whole
+   sector or more copy each sector straight from the sector cache
+   into the buffer, so larger reads should cost little more per
+   byte than the copy itself.
+
+   Needs FILE_SIZE bytes free. */
+
+#undef NDEBUG
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/block.h"
+#include "devices/timer.h"
+#include "filesys/file.h"
+#include "filesys/filesys.h"
+#include "threads/palloc.h"
+#include "threads/test.h"
+#include "threads/vaddr.h"
+
+/* Size of the file, in bytes. */
+#define FILE_SIZE (256 * 1024)
+
+/* Number of times the file is read with each read size. */
+#define PASS_CNT 4
+
+/* Largest read size, in bytes. */
+#define MAX_READ (64 * 1024)
+
+static const int read_sizes[] = {512, 4096, MAX_READ};
+
+/* Reads FILE from start to end PASS_CNT times, SIZE bytes at a
+   time, into BUF, and prints the throughput. */
+static void
+measure (struct file *file, char *buf, int size)
+{
+  int64_t start = timer_ticks ();
+  int64_t ticks;
+  int pass;
+
+  for (pass = 0; pass < PASS_CNT; pass++)
+    {
+      off_t ofs;
+
+      file_seek (file, 0);
+      for (ofs = 0; ofs < FILE_SIZE; ofs += size)
+        {
+          ASSERT (file_read (file, buf, size) == size);
+          ASSERT (buf[0] == (char) (ofs / BLOCK_SECTOR_SIZE));
+        }
+    }
+  ticks = timer_elapsed (start);
+
+  printf ("%6d-byte reads: %10lld bytes/tick\n", size,
+          ticks > 0 ? (long long) FILE_SIZE * PASS_CNT / ticks : -1LL);
+}
+
+/* Runs the benchmark. */
+void
+test (void)
+{
+  char *buf = palloc_get_multiple (PAL_ASSERT, MAX_READ / PGSIZE);
+  struct file *file;
+  off_t ofs;
+  size_t i;
+
+  ASSERT (filesys_create ("read-size", 0));
+  file = filesys_open ("read-size");
+  ASSERT (file != NULL);
+
+  /* Mark each sector with its number. */
+  for (ofs = 0; ofs < FILE_SIZE; ofs += BLOCK_SECTOR_SIZE)
+    {
+      memset (buf, ofs / BLOCK_SECTOR_SIZE, BLOCK_SECTOR_SIZE);
+      ASSERT (file_write (file, buf, BLOCK_SECTOR_SIZE) == BLOCK_SECTOR_SIZE);
+    }
+
+  for (i = 0; i < sizeof read_sizes / sizeof *read_sizes; i++)
+    measure (file, buf, read_sizes[i]);
+
+  file_close (file);
+  ASSERT (filesys_remove ("read-size"));
+  palloc_free_multiple (buf, MAX_READ / PGSIZE);
+  printf ("read-size: PASS\n");
+}
@@ -0,0 +1,98 @@
+/* Seek distance benchmark for the file system's block
+   allocator.
+
+   Runs a small-file workload: creates files of 1 to 4 kB, removes
+   some of them to leave holes, and creates more, then writes
+   everything back to disk and reads every file.  Reports the
+   average distance, in sectors, between consecutive accesses to
+   the file system device during the workload, as an estimate of
+   how far an IDE disk's head would have had to travel. */
+
+#undef NDEBUG
+#include <debug.h>
+#include <random.h>
+#include <stdio.h>
+#include "devices/block.h"
+#include "filesys/cache.h"
+#include "filesys/file.h"
+#include "filesys/filesys.h"
+#include "threads/test.h"
+
+/* Number of files created in each round. */
+#define FILE_CNT 64
+
+/* Number of create/remove rounds. */
+#define ROUND_CNT 4
+
+/* Largest file, in bytes. */
+#define MAX_SIZE 4096
+
+static char buf[MAX_SIZE];
+
+/* Returns the name of file I. */
+static const char *
+file_name (int i)
+{
+  static char name[16];
+  snprintf (name, sizeof name, "small%d", i);
+  return name;
+}
+
+/* Creates file I with between 1 kB and MAX_SIZE bytes of data. */
+static void
+create_file (int i)
+{
+  int size = 1024 + random_ulong () % (MAX_SIZE - 1024 + 1);
+  struct file *file;
+
+  ASSERT (filesys_create (file_name (i), 0));
+  file = filesys_open (file_name (i));
+  ASSERT (file != NULL);
+  ASSERT (file_write (file, buf, size) == size);
+  file_close (file);
+}
+
+/* Reads all of file I. */
+static void
+read_file (int i)
+{
+  struct file *file = filesys_open (file_name (i));
+  ASSERT (file != NULL);
+  while (file_read (file, buf, sizeof buf) > 0)
+    continue;
+  file_close (file);
+}
+
+/* Runs the benchmark. */
+void
+test (void)
+{
+  unsigned long long start_cnt, start_distance, cnt, distance;
+  int round, i;
+
+  block_seek_stats (fs_device, &start_cnt, &start_distance);
+
+  for (i = 0; i < FILE_CNT; i++)
+    create_file (i);
+  for (round = 1; round < ROUND_CNT; round++)
+    {
+      /* Remove every other file and make new ones. */
+      for (i = round % 2; i < FILE_CNT; i += 2)
+        ASSERT (filesys_remove (file_name (i)));
+      for (i = round % 2; i < FILE_CNT; i += 2)
+        create_file (i);
+    }
+  cache_flush ();
+  for (i = 0; i < FILE_CNT; i++)
+    read_file (i);
+
+  block_seek_stats (fs_device, &cnt, &distance);
+  cnt -= start_cnt;
+  distance -= start_distance;
+  printf ("%llu sector accesses, %llu sectors average seek distance\n",
+          cnt, cnt > 0 ? distance / cnt : 0);
+
+  for (i = 0; i < FILE_CNT; i++)
+    ASSERT (filesys_remove (file_name (i)));
+  printf ("seek: PASS\n");
+}
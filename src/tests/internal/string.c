@@ -0,0 +1,260 @@
+/* Test program for the block functions in lib/string.c.
+
+   Checks memcpy(), memset(), memcmp(), and strlen() against
+   simple byte-at-a-time reference versions for every
+   combination of source and destination misalignment and for
+   lengths on both sides of the word-at-a-time cutoff.  Then
+   times each function against its reference for sizes from 1
+   byte to 64 kB. */
+
+#undef NDEBUG
+#include <debug.h>
+#include <random.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "threads/test.h"
+
+/* Largest length checked for correctness. */
+#define MAX_LEN 100
+
+/* Largest size timed by the benchmark. */
+#define MAX_BENCH (64 * 1024)
+
+/* Bytes moved per timed run, so that every size takes long
+   enough to measure in timer ticks. */
+#define BENCH_BYTES (16 * 1024 * 1024)
+
+/* Slack around the test region, to catch writes outside it. */
+#define GUARD 8
+
+static uint8_t src_buf[MAX_BENCH + 2 * GUARD];
+static uint8_t dst_buf[MAX_BENCH + 2 * GUARD];
+static uint8_t ref_buf[MAX_BENCH + 2 * GUARD];
+
+static void test_memcpy (void);
+static void test_memset (void);
+static void test_memcmp (void);
+static void test_strlen (void);
+static void bench (void);
+
+/* Test and time the string block functions. */
+void
+test (void)
+{
+  printf ("testing memcpy...");
+  test_memcpy ();
+  printf (" memset...");
+  test_memset ();
+  printf (" memcmp...");
+  test_memcmp ();
+  printf (" strlen...");
+  test_strlen ();
+  printf (" done\n");
+  printf ("string: PASS\n");
+
+  bench ();
+}
+
+/* Copies SIZE bytes from SRC to DST a byte at a time. */
+static void
+ref_memcpy (uint8_t *dst, const uint8_t *src, size_t size)
+{
+  while (size-- > 0)
+    *dst++ = *src++;
+}
+
+/* Sets SIZE bytes at DST to VALUE a byte at a time. */
+static void
+ref_memset (uint8_t *dst, int value, size_t size)
+{
+  while (size-- > 0)
+    *dst++ = value;
+}
+
+/* Compares SIZE bytes at A and B a byte at a time. */
+static int
+ref_memcmp (const uint8_t *a, const uint8_t *b, size_t size)
+{
+  for (; size-- > 0; a++, b++)
+    if (*a != *b)
+      return *a > *b ? +1 : -1;
+  return 0;
+}
+
+/* Returns the length of S, counting a byte at a time. */
+static size_t
+ref_strlen (const char *s)
+{
+  const char *p;
+
+  for (p = s; *p != '\0'; p++)
+    continue;
+  return p - s;
+}
+
+/* Returns the sign of X. */
+static int
+sign (int x)
+{
+  return x < 0 ? -1 : x > 0;
+}
+
+static void
+test_memcpy (void)
+{
+  size_t src_ofs, dst_ofs, len;
+
+  for (src_ofs = 0; src_ofs < GUARD; src_ofs++)
+    for (dst_ofs = 0; dst_ofs < GUARD; dst_ofs++)
+      for (len = 0; len <= MAX_LEN; len++)
+        {
+          random_bytes (src_buf, sizeof src_buf);
+          random_bytes (dst_buf, MAX_LEN + 2 * GUARD);
+          ref_memcpy (ref_buf, dst_buf, MAX_LEN + 2 * GUARD);
+
+          ASSERT (memcpy (dst_buf + dst_ofs, src_buf + src_ofs, len)
+                  == dst_buf + dst_ofs);
+          ref_memcpy (ref_buf + dst_ofs, src_buf + src_ofs, len);
+          ASSERT (!ref_memcmp (dst_buf, ref_buf, MAX_LEN + 2 * GUARD));
+        }
+}
+
+static void
+test_memset (void)
+{
+  size_t dst_ofs, len;
+
+  for (dst_ofs = 0; dst_ofs < GUARD; dst_ofs++)
+    for (len = 0; len <= MAX_LEN; len++)
+      {
+        int value = random_ulong () % 512 - 128;
+
+        random_bytes (dst_buf, MAX_LEN + 2 * GUARD);
+        ref_memcpy (ref_buf, dst_buf, MAX_LEN + 2 * GUARD);
+
+        ASSERT (memset (dst_buf + dst_ofs, value, len) == dst_buf + dst_ofs);
+        ref_memset (ref_buf + dst_ofs, value, len);
+        ASSERT (!ref_memcmp (dst_buf, ref_buf, MAX_LEN + 2 * GUARD));
+      }
+}
+
+static void
+test_memcmp (void)
+{
+  size_t a_ofs, b_ofs, len;
+
+  for (a_ofs = 0; a_ofs < GUARD; a_ofs++)
+    for (b_ofs = 0; b_ofs < GUARD; b_ofs++)
+      for (len = 0; len <= MAX_LEN; len++)
+        {
+          uint8_t *a = src_buf + a_ofs;
+          uint8_t *b = dst_buf + b_ofs;
+          size_t i;
+
+          /* Equal blocks. */
+          random_bytes (a, len);
+          ref_memcpy (b, a, len);
+          ASSERT (memcmp (a, b, len) == 0);
+
+          /* Blocks differing at each position in turn, with the
+             difference in either direction. */
+          for (i = 0; i < len; i++)
+            {
+              b[i] = a[i] ^ (1 << (random_ulong () % 8));
+              ASSERT (sign (memcmp (a, b, len))
+                      == ref_memcmp (a, b, len));
+              ASSERT (sign (memcmp (b, a, len))
+                      == ref_memcmp (b, a, len));
+              b[i] = a[i];
+            }
+        }
+}
+
+static void
+test_strlen (void)
+{
+  size_t ofs, len;
+
+  for (ofs = 0; ofs < GUARD; ofs++)
+    for (len = 0; len <= MAX_LEN; len++)
+      {
+        char *s = (char *) src_buf + ofs;
+        size_t i;
+
+        for (i = 0; i < len; i++)
+          s[i] = random_ulong () % 255 + 1;
+        s[len] = '\0';
+
+        /* Nonzero garbage after the terminator must not matter. */
+        for (i = len + 1; i < len + 1 + GUARD; i++)
+          s[i] = random_ulong () % 255 + 1;
+
+        ASSERT (strlen (s) == len);
+        ASSERT (ref_strlen (s) == len);
+      }
+}
+
+/* Prints how long it takes to process BENCH_BYTES with each
+   function and its reference, in SIZE-byte blocks, as KB per
+   timer tick. */
+static void
+bench_size (size_t size)
+{
+  size_t iter_cnt = BENCH_BYTES / size;
+  int64_t ticks[8];
+  int64_t start;
+  size_t i;
+  int t = 0;
+
+  /* Keep the compiler from discarding the comparison results. */
+  volatile int sink = 0;
+  volatile size_t len_sink = 0;
+
+  /* A string of SIZE - 1 nonzero bytes for strlen(). */
+  memset (src_buf, 'x', size - 1);
+  src_buf[size - 1] = '\0';
+  memcpy (ref_buf, src_buf, size);
+
+#define TIME(STMT)                              \
+  start = timer_ticks ();                       \
+  for (i = 0; i < iter_cnt; i++)                \
+    STMT;                                       \
+  ticks[t++] = timer_elapsed (start);
+
+  TIME (memcpy (dst_buf, src_buf + 1, size));
+  TIME (ref_memcpy (dst_buf, src_buf + 1, size));
+  TIME (memset (dst_buf, 0, size));
+  TIME (ref_memset (dst_buf, 0, size));
+  TIME (sink += memcmp (src_buf, ref_buf, size));
+  TIME (sink += ref_memcmp (src_buf, ref_buf, size));
+  TIME (len_sink += strlen ((char *) src_buf));
+  TIME (len_sink += ref_strlen ((char *) src_buf));
+#undef TIME
+
+  printf ("%6zu:", size);
+  for (t = 0; t < 8; t++)
+    printf (" %7lld", ticks[t] > 0
+            ? (long long) (BENCH_BYTES / 1024 / ticks[t]) : -1LL);
+  printf ("\n");
+}
+
+/* Times the block functions against their byte-at-a-time
+   references.  A rate of -1 means the run took less than one
+   tick. */
+static void
+bench (void)
+{
+  size_t size;
+
+  printf ("KB/tick, word vs. byte:\n"
+          "  size:  memcpy    byte  memset    byte  memcmp    byte"
+          "  strlen    byte\n");
+  for (size = 1; size <= MAX_BENCH; size *= 2)
+    {
+      bench_size (size);
+      if (size > 1 && size < MAX_BENCH)
+        bench_size (size + size / 2 + 1);
+    }
+}
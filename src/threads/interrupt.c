@@ -206,6 +206,26 @@ intr_register_int (uint8_t vec_no, int dpl, enum intr_level level,
   register_handler (vec_no, dpl, level, handler, name);
 }
 
+/* Returns true if external interrupt VEC_NO has been raised but
+   not yet delivered, as happens while interrupts are off. */
+bool
+intr_ext_pending (uint8_t vec_no)
+{
+  ASSERT (vec_no >= 0x20 && vec_no <= 0x2f);
+
+  /* OCW3: read the Interrupt Request Register. */
+  if (vec_no < 0x28)
+    {
+      outb (PIC0_CTRL, 0x0a);
+      return (inb (PIC0_CTRL) >> (vec_no - 0x20)) & 1;
+    }
+  else
+    {
+      outb (PIC1_CTRL, 0x0a);
+      return (inb (PIC1_CTRL) >> (vec_no - 0x28)) & 1;
+    }
+}
+
 /* Returns true during processing of an external interrupt
    and false at all other times. */
 bool
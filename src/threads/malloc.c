@@ -8,6 +8,7 @@
 #include "threads/palloc.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
+#include "threads/vmalloc.h"
 
 /* A simple implementation of malloc().
 
@@ -30,9 +31,12 @@
 
    We can't handle blocks bigger than 2 kB using this scheme,
    because they're too big to fit in a single page with a
-   descriptor.  We handle those by allocating contiguous pages
-   with the page allocator and sticking the allocation size at
-   the beginning of the allocated block's arena header. */
+   descriptor.  We handle those by allocating whole pages and
+   sticking the allocation size at the beginning of the
+   allocated block's arena header.  A single page comes straight
+   from the page allocator.  Anything larger comes from
+   vmalloc(), which doesn't need physically contiguous pages and
+   so keeps working when the kernel pool is fragmented. */
 
 /* Descriptor. */
 struct desc
@@ -107,7 +111,7 @@ malloc (size_t size)
       /* SIZE is too big for any descriptor.
          Allocate enough pages to hold SIZE plus an arena. */
       size_t page_cnt = DIV_ROUND_UP (size + sizeof *a, PGSIZE);
-      a = palloc_get_multiple (0, page_cnt);
+      a = page_cnt > 1 ? vmalloc (page_cnt * PGSIZE) : palloc_get_page (0);
       if (a == NULL)
         return NULL;
 
@@ -257,7 +261,10 @@ free (void *p)
       else
         {
           /* It's a big block.  Free its pages. */
-          palloc_free_multiple (a, a->free_cnt);
+          if (is_vmalloc_vaddr (a))
+            vfree (a);
+          else
+            palloc_free_page (a);
           return;
         }
     }
@@ -129,6 +129,13 @@ struct thread
 
     /* added for Project 3. */
 
+#endif
+#ifdef FILESYS
+    /* Owned by filesys/filesys.c. */
+    struct dir *cwd;                    /* Working directory, or null for root. */
+
+    /* Owned by filesys/journal.c. */
+    int journal_depth;                  /* Nesting of journal operations. */
 #endif
     
     int64_t wakeup_ticks;    
@@ -0,0 +1,194 @@
+#include "threads/vmalloc.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "threads/init.h"
+#include "threads/palloc.h"
+#include "threads/pte.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Virtually contiguous allocator.
+
+   palloc_get_multiple() can only satisfy a multi-page request
+   from physically contiguous free pages, so it starts failing
+   once the kernel pool is fragmented even if most of it is
+   free.  vmalloc() instead obtains the pages it needs one at a
+   time from the kernel pool and maps them side by side in a
+   range of kernel virtual memory reserved for the purpose.
+
+   The page tables that cover the range are created once, in
+   vmalloc_init(), before any process page directory is copied
+   from init_page_dir.  Every page directory therefore shares
+   the same page tables for the range, and mapping or unmapping
+   a page only has to touch a PTE.
+
+   Each allocation is followed by one unmapped guard page.  This
+   catches overruns, and also tells vfree() where an allocation
+   ends, so that no size needs to be stored anywhere. */
+
+/* Page tables covering the vmalloc range. */
+#define VMALLOC_PT_CNT DIV_ROUND_UP (VMALLOC_PAGES, PGSIZE / sizeof (uint32_t))
+
+static struct lock vmalloc_lock;        /* Protects used_map and PTEs. */
+static struct bitmap *used_map;         /* Virtual pages in use. */
+static uint32_t *vmalloc_pts[VMALLOC_PT_CNT];
+
+static void unmap_pages (uint8_t *base, size_t page_cnt);
+static void release_range (uint8_t *base, size_t page_cnt);
+static uint32_t *lookup_pte (const void *);
+static void invalidate_page (const void *);
+
+/* Creates the page tables for the vmalloc range in
+   init_page_dir.  Must be called after paging_init() and before
+   any other page directory is created. */
+void
+vmalloc_init (void)
+{
+  size_t i;
+
+  ASSERT (pg_ofs (VMALLOC_BASE) == 0);
+  ASSERT (pt_no (VMALLOC_BASE) == 0);
+
+  lock_init (&vmalloc_lock);
+  used_map = bitmap_create (VMALLOC_PAGES);
+  if (used_map == NULL)
+    PANIC ("vmalloc: can't allocate virtual page map");
+
+  for (i = 0; i < VMALLOC_PT_CNT; i++)
+    {
+      uint8_t *vaddr = (uint8_t *) VMALLOC_BASE + i * PTSPAN;
+      uint32_t *pde = init_page_dir + pd_no (vaddr);
+
+      ASSERT (*pde == 0);
+      vmalloc_pts[i] = palloc_get_page (PAL_ASSERT | PAL_ZERO);
+      *pde = pde_create (vmalloc_pts[i]);
+    }
+}
+
+/* Obtains and returns at least SIZE bytes of virtually
+   contiguous, page-aligned kernel memory.  The memory is not
+   initialized.  Returns a null pointer if either virtual space
+   or physical pages are exhausted. */
+void *
+vmalloc (size_t size)
+{
+  size_t page_cnt = DIV_ROUND_UP (size, PGSIZE);
+  size_t page_idx;
+  uint8_t *base;
+  size_t i;
+
+  ASSERT (used_map != NULL);
+  if (page_cnt == 0)
+    return NULL;
+
+  /* Reserve the virtual range plus its trailing guard page. */
+  lock_acquire (&vmalloc_lock);
+  page_idx = bitmap_scan_and_flip (used_map, 0, page_cnt + 1, false);
+  lock_release (&vmalloc_lock);
+  if (page_idx == BITMAP_ERROR)
+    return NULL;
+  base = (uint8_t *) VMALLOC_BASE + page_idx * PGSIZE;
+
+  /* Back the range page by page.  The pages need not be
+     physically adjacent. */
+  for (i = 0; i < page_cnt; i++)
+    {
+      void *kpage = palloc_get_page (0);
+      if (kpage == NULL)
+        break;
+      *lookup_pte (base + i * PGSIZE) = pte_create_kernel (kpage, true);
+    }
+
+  if (i < page_cnt)
+    {
+      unmap_pages (base, i);
+      release_range (base, page_cnt + 1);
+      return NULL;
+    }
+  return base;
+}
+
+/* Frees memory P, which must have been returned by vmalloc(). */
+void
+vfree (void *p)
+{
+  uint8_t *base = p;
+  size_t page_cnt;
+
+  if (p == NULL)
+    return;
+
+  ASSERT (is_vmalloc_vaddr (p));
+  ASSERT (pg_ofs (p) == 0);
+
+  /* The allocation ends at the first unmapped page, which is its
+     guard page. */
+  for (page_cnt = 0; *lookup_pte (base + page_cnt * PGSIZE) & PTE_P;
+       page_cnt++)
+    continue;
+
+  unmap_pages (base, page_cnt);
+  release_range (base, page_cnt + 1);
+}
+
+/* Returns true if VADDR lies in the vmalloc range. */
+bool
+is_vmalloc_vaddr (const void *vaddr)
+{
+  return (vaddr >= VMALLOC_BASE
+          && pg_no (vaddr) < pg_no (VMALLOC_BASE) + VMALLOC_PAGES);
+}
+
+/* Unmaps the PAGE_CNT pages starting at BASE and returns them to
+   the page allocator. */
+static void
+unmap_pages (uint8_t *base, size_t page_cnt)
+{
+  size_t i;
+
+  for (i = 0; i < page_cnt; i++)
+    {
+      uint8_t *vaddr = base + i * PGSIZE;
+      uint32_t *pte = lookup_pte (vaddr);
+
+      ASSERT (*pte & PTE_P);
+      palloc_free_page (pte_get_page (*pte));
+      *pte = 0;
+      invalidate_page (vaddr);
+    }
+}
+
+/* Marks the PAGE_CNT virtual pages starting at BASE free. */
+static void
+release_range (uint8_t *base, size_t page_cnt)
+{
+  size_t page_idx = pg_no (base) - pg_no (VMALLOC_BASE);
+
+  lock_acquire (&vmalloc_lock);
+  ASSERT (bitmap_all (used_map, page_idx, page_cnt));
+  bitmap_set_multiple (used_map, page_idx, page_cnt, false);
+  lock_release (&vmalloc_lock);
+}
+
+/* Returns the PTE for VADDR, which must be in the vmalloc
+   range. */
+static uint32_t *
+lookup_pte (const void *vaddr)
+{
+  size_t page_idx = pg_no (vaddr) - pg_no (VMALLOC_BASE);
+
+  ASSERT (is_vmalloc_vaddr (vaddr));
+  return &vmalloc_pts[page_idx >> PTBITS][pt_no (vaddr)];
+}
+
+/* Drops any TLB entry for VADDR.  Every page directory shares the
+   vmalloc page tables, and CR3 reloads flush the TLB, so doing
+   this on the running CPU is enough. */
+static void
+invalidate_page (const void *vaddr)
+{
+  asm volatile ("invlpg (%0)" : : "r" (vaddr) : "memory");
+}
@@ -0,0 +1,19 @@
+#ifndef THREADS_VMALLOC_H
+#define THREADS_VMALLOC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Kernel virtual range reserved for vmalloc() mappings.  It lies
+   well above the 64 MB of physical memory that is mapped
+   starting at PHYS_BASE, and must be aligned on a 4 MB
+   boundary. */
+#define VMALLOC_BASE ((void *) 0xe0000000)
+#define VMALLOC_PAGES 4096      /* 16 MB of virtual space. */
+
+void vmalloc_init (void);
+void *vmalloc (size_t);
+void vfree (void *);
+bool is_vmalloc_vaddr (const void *);
+
+#endif /* threads/vmalloc.h */
@@ -120,6 +120,13 @@ start_process (void *file_name_)
   if_.eflags = FLAG_IF | FLAG_MBS;
   success = load (file_name, &if_.eip, &if_.esp);
 
+#ifdef FILESYS
+  /* Inherit the parent's working directory.  The parent is
+     waiting for us to load, so its directory can't go away. */
+  if (thread_current ()->parent->cwd != NULL)
+    thread_current ()->cwd = dir_reopen (thread_current ()->parent->cwd);
+#endif
+
   /* modified
      when memory load is complete, resume parent process (using semaphore) */
   sema_up(&(thread_current()->parent->load_sema));
@@ -184,6 +191,11 @@ process_exit (void)
   uint32_t *pd;
 
   if(cur->loaded == false) cur->exit_status = -1;
+
+#ifdef FILESYS
+  dir_close (cur->cwd);
+  cur->cwd = NULL;
+#endif
   /* Destroy the current process's page directory and switch back
      to the kernel-only page directory. */
   pd = cur->pagedir;
@@ -1,26 +1,28 @@
 #include "userprog/syscall.h"
+#include <iovec.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 #include <syscall-nr.h>
 #include "threads/interrupt.h"
 #include "threads/thread.h"
 #include "userprog/process.h"
 #include "threads/vaddr.h"
 #include "pagedir.h"
+#include "devices/block.h"
 #include "devices/shutdown.h"
 #include "devices/input.h"
 #include "filesys/filesys.h"
 #include "filesys/file.h"
-#include "threads/synch.h"
+#include "filesys/directory.h"
+#include "filesys/inode.h"
 
 typedef int pid_t;
 static void syscall_handler (struct intr_frame *);
 
-struct lock my_lock;
-
 void
 syscall_init (void) 
 {
-    lock_init(&my_lock);
     intr_register_int (0x30, 3, INTR_ON, syscall_handler, "syscall");
 }
 
@@ -29,6 +31,14 @@ pid_t exec(char *filename);
 void halt(void);
 int wait(pid_t pid);
 int read(int fd, void* buffer, unsigned size);
+int readv(int fd, const struct iovec* iov, int iovcnt);
+int writev(int fd, const struct iovec* iov, int iovcnt);
+int pread(int fd, void* buffer, unsigned size, unsigned offset);
+int pwrite(int fd, const void* buffer, unsigned size, unsigned offset);
+int copy_file_range(int fd_in, int fd_out, unsigned size);
+bool block_stats(int index, struct block_stats* stats);
+static void check_user_buffer(const void* buffer, unsigned size, bool writable);
+static int user_io(struct file* f, void* buffer, unsigned size, off_t ofs, bool write);
 int write(int fd, const void* buffer, unsigned size);
 void exit(int status);
 int fibonacci(int n);
@@ -42,6 +52,12 @@ int filesize(int fd);
 void seek(int fd, unsigned position);
 unsigned tell(int fd);
 
+bool chdir(const char* dir);
+bool mkdir(const char* dir);
+bool readdir(int fd, char* name);
+bool isdir(int fd);
+int inumber(int fd);
+
 static void
 syscall_handler (struct intr_frame *f UNUSED) 
 {
@@ -84,10 +100,8 @@ syscall_handler (struct intr_frame *f UNUSED)
             f->eax = remove((char*)(*(my_esp+1)));
             break;
         case SYS_OPEN:
-            lock_acquire(&my_lock);
             check_valid_addr(my_esp+1);
             f->eax = open((char*)(*(my_esp+1)));
-            lock_release(&my_lock);
             break;
         case SYS_FILESIZE:
             check_valid_addr(my_esp+1);
@@ -95,20 +109,17 @@ syscall_handler (struct intr_frame *f UNUSED)
             break;
 
         case SYS_READ:
-            lock_acquire(&my_lock);
+            /* the file system does its own locking */
             check_valid_addr(my_esp+1);
             check_valid_addr(my_esp+2);
             check_valid_addr(my_esp+3);
             f->eax=read((int)*(my_esp+1), (void*)*(my_esp+2), (unsigned)*(my_esp+3));
-            lock_release(&my_lock);
             break;
         case SYS_WRITE:
-            lock_acquire(&my_lock);
             check_valid_addr(my_esp+6);
             check_valid_addr(my_esp+7);
             check_valid_addr(my_esp+8);            
             f->eax=write((int)*(my_esp+6), (void*)*(my_esp+7), (unsigned)*(my_esp+8));
-            lock_release(&my_lock);
             break;
         
         case SYS_SEEK:
@@ -126,6 +137,64 @@ syscall_handler (struct intr_frame *f UNUSED)
             check_valid_addr(my_esp+1);
             close((int)(*(my_esp+1)));
             break;
+        case SYS_CHDIR:
+            check_valid_addr(my_esp+1);
+            f->eax = chdir((const char*)*(my_esp+1));
+            break;
+        case SYS_MKDIR:
+            check_valid_addr(my_esp+1);
+            f->eax = mkdir((const char*)*(my_esp+1));
+            break;
+        case SYS_READDIR:
+            check_valid_addr(my_esp+1);
+            check_valid_addr(my_esp+2);
+            f->eax = readdir((int)*(my_esp+1), (char*)*(my_esp+2));
+            break;
+        case SYS_ISDIR:
+            check_valid_addr(my_esp+1);
+            f->eax = isdir((int)*(my_esp+1));
+            break;
+        case SYS_INUMBER:
+            check_valid_addr(my_esp+1);
+            f->eax = inumber((int)*(my_esp+1));
+            break;
+        case SYS_READV:
+            check_valid_addr(my_esp+1);
+            check_valid_addr(my_esp+2);
+            check_valid_addr(my_esp+3);
+            f->eax = readv((int)*(my_esp+1), (const struct iovec*)*(my_esp+2), (int)*(my_esp+3));
+            break;
+        case SYS_WRITEV:
+            check_valid_addr(my_esp+1);
+            check_valid_addr(my_esp+2);
+            check_valid_addr(my_esp+3);
+            f->eax = writev((int)*(my_esp+1), (const struct iovec*)*(my_esp+2), (int)*(my_esp+3));
+            break;
+        case SYS_PREAD:
+            check_valid_addr(my_esp+1);
+            check_valid_addr(my_esp+2);
+            check_valid_addr(my_esp+3);
+            check_valid_addr(my_esp+4);
+            f->eax = pread((int)*(my_esp+1), (void*)*(my_esp+2), (unsigned)*(my_esp+3), (unsigned)*(my_esp+4));
+            break;
+        case SYS_PWRITE:
+            check_valid_addr(my_esp+1);
+            check_valid_addr(my_esp+2);
+            check_valid_addr(my_esp+3);
+            check_valid_addr(my_esp+4);
+            f->eax = pwrite((int)*(my_esp+1), (const void*)*(my_esp+2), (unsigned)*(my_esp+3), (unsigned)*(my_esp+4));
+            break;
+        case SYS_COPY_FILE_RANGE:
+            check_valid_addr(my_esp+1);
+            check_valid_addr(my_esp+2);
+            check_valid_addr(my_esp+3);
+            f->eax = copy_file_range((int)*(my_esp+1), (int)*(my_esp+2), (unsigned)*(my_esp+3));
+            break;
+        case SYS_BLOCK_STATS:
+            check_valid_addr(my_esp+1);
+            check_valid_addr(my_esp+2);
+            f->eax = block_stats((int)*(my_esp+1), (struct block_stats*)*(my_esp+2));
+            break;
         case SYS_FIBONACCI:
             check_valid_addr(my_esp+1);
             f->eax = fibonacci((int)*(my_esp+1));
@@ -183,9 +252,12 @@ int read(int fd, void* buffer, unsigned size) {
                 if(fd <2 || fd>= 128) return -1;
         struct file* f = (thread_current()->fd)[fd];
         if(f==NULL) exit(-1);
-        check_valid_addr(buffer);
+        /* directories are read with readdir() */
+        if(inode_is_dir(file_get_inode(f))) return -1;
+        check_user_buffer(buffer, size, true);
         
-        int res = file_read(f,buffer,(off_t)size);
+        int res = user_io(f, buffer, size, file_tell(f), false);
+        file_seek(f, file_tell(f) + res);
         ans = res;        
     }
     else
@@ -193,9 +265,125 @@ int read(int fd, void* buffer, unsigned size) {
     return ans;
 }
 
+/* Returns the kernel's mapping of user address UADDR. Kills the
+   process if UADDR's page is unmapped, or if WRITABLE is true and
+   the page is read-only. */
+static void* user_to_kernel(const void* uaddr, bool writable){
+    uint32_t* pd = thread_current()->pagedir;
+    if(!is_user_vaddr(uaddr)) exit(-1);
+    if(writable && !pagedir_is_writable(pd, uaddr)) exit(-1);
+    void* kaddr = pagedir_get_page(pd, uaddr);
+    if(kaddr == NULL) exit(-1);
+    return kaddr;
+}
+
+/* Kills the process unless every page of user BUFFER, SIZE bytes
+   long, is mapped, and writable if WRITABLE is true. */
+static void check_user_buffer(const void* buffer, unsigned size, bool writable){
+    const uint8_t* start = buffer;
+    const uint8_t* last = start + size - 1;
+    const uint8_t* page;
+
+    if(size == 0) return;
+    if(last < start || !is_user_vaddr(last)) exit(-1);
+    for(page = pg_round_down(start); page <= last; page += PGSIZE)
+        user_to_kernel(page, writable);
+}
+
+/* Reads SIZE bytes at offset OFS of F into user BUFFER, or writes
+   them from BUFFER if WRITE is true, one user page at a time. The
+   caller must have checked BUFFER with check_user_buffer(). The
+   file system copies straight between its cached sectors and each
+   page, through the kernel's mapping of the page, so a
+   page-aligned transfer moves whole pages. Returns the number of
+   bytes transferred. */
+static int user_io(struct file* f, void* buffer, unsigned size, off_t ofs, bool write){
+    uint32_t* pd = thread_current()->pagedir;
+    unsigned done = 0;
+
+    while(done < size){
+        uint8_t* upage = (uint8_t*)buffer + done;
+        unsigned chunk = PGSIZE - pg_ofs(upage);
+        if(chunk > size - done) chunk = size - done;
+
+        void* kpage = user_to_kernel(upage, !write);
+        int res;
+        if(write)
+            res = file_write_at(f, kpage, (off_t)chunk, ofs + done);
+        else{
+            res = file_read_at(f, kpage, (off_t)chunk, ofs + done);
+            if(res > 0) pagedir_set_dirty(pd, upage, true);
+        }
+        done += res;
+        if(res < (int)chunk) break;
+    }
+    return done;
+}
+
+/* Returns the open ordinary file for FD, or NULL if FD is not one. */
+static struct file* get_plain_file(int fd){
+    if(fd <3 || fd>= 128) return NULL;
+    struct file* f = (thread_current()->fd)[fd];
+    if(f==NULL || inode_is_dir(file_get_inode(f))) return NULL;
+    return f;
+}
+
+/* Reads into (or, if WRITE is true, writes from) the IOVCNT user
+   buffers described by user array IOV, in order, starting at F's
+   current position, which is advanced. Every iovec is copied in
+   and every buffer is checked before any I/O starts, and the
+   sectors a read will need are queued for read-ahead all at once,
+   so that adjacent ones reach the disk together. */
+static int iov_io(int fd, const struct iovec* iov, int iovcnt, bool write){
+    struct iovec kiov[IOV_MAX];
+    unsigned total = 0;
+    int i;
+
+    if(iovcnt < 0 || iovcnt > IOV_MAX) return -1;
+    check_user_buffer(iov, iovcnt * sizeof *iov, false);
+    memcpy(kiov, iov, iovcnt * sizeof *iov);
+    for(i = 0; i < iovcnt; i++){
+        check_user_buffer(kiov[i].iov_base, kiov[i].iov_len, !write);
+        if(total + kiov[i].iov_len < total || total + kiov[i].iov_len > INT32_MAX) return -1;
+        total += kiov[i].iov_len;
+    }
+
+    /* console */
+    if(fd == 0 && !write){
+        for(i = 0; i < iovcnt; i++){
+            size_t j;
+            for(j = 0; j < kiov[i].iov_len; j++)
+                *((char*)kiov[i].iov_base + j) = input_getc();
+        }
+        return total;
+    }
+    if(fd == 1 && write){
+        for(i = 0; i < iovcnt; i++)
+            putbuf(kiov[i].iov_base, kiov[i].iov_len);
+        return total;
+    }
+
+    struct file* f = get_plain_file(fd);
+    if(f==NULL) return -1;
+
+    off_t pos = file_tell(f);
+    unsigned done = 0;
+    if(!write) inode_read_ahead(file_get_inode(f), total, pos);
+    for(i = 0; i < iovcnt; i++){
+        int res = user_io(f, kiov[i].iov_base, kiov[i].iov_len, pos + done, write);
+        done += res;
+        if((unsigned)res < kiov[i].iov_len) break;
+    }
+    file_seek(f, pos + done);
+    return done;
+}
+
 int write(int fd, const void* buffer, unsigned size){
     /* STDIN: 0, STDOUT: 1 */
     int ans = -1;
+    /* checked up front: a fault inside the file system would kill
+       us holding the inode lock and an open journal operation */
+    check_user_buffer(buffer, size, false);
     if(fd==1){
         putbuf(buffer, size);
         ans = size;        
@@ -204,9 +392,11 @@ int write(int fd, const void* buffer, unsigned size){
         if(fd <3 || fd>= 128) return -1;
         struct file* f = (thread_current()->fd)[fd];
         if(f==NULL) exit(-1);
+        /* directories can't be written */
+        if(inode_is_dir(file_get_inode(f))) return -1;
         
-        int res =file_write(f,(const void*)buffer,(off_t)size);
-       
+        int res = user_io(f, (void*)buffer, size, file_tell(f), true);
+        file_seek(f, file_tell(f) + res);
         ans = res;
     }
 
@@ -312,3 +502,110 @@ unsigned tell(int fd) {
     if(f==NULL) exit(-1);
     file_tell(f);
 }
+
+bool chdir(const char* dir){
+    if(dir==NULL) exit(-1);
+    return filesys_chdir(dir);
+}
+
+bool mkdir(const char* dir){
+    if(dir==NULL) exit(-1);
+    return filesys_mkdir(dir);
+}
+
+bool readdir(int fd, char* name){
+    if(fd <3 || fd>= 128) return false;
+    struct file* f = (thread_current()->fd)[fd];
+    if(f==NULL || !inode_is_dir(file_get_inode(f))) return false;
+    check_user_buffer(name, NAME_MAX + 1, true);
+
+    /* the directory's read position is kept in the file; the name
+       goes through a kernel buffer so that no user page is touched
+       while the directory is locked */
+    char kname[NAME_MAX + 1];
+    struct dir* dir = dir_open(inode_reopen(file_get_inode(f)));
+    if(dir==NULL) return false;
+    dir_seek(dir, file_tell(f));
+    bool success = dir_readdir(dir, kname);
+    file_seek(f, dir_tell(dir));
+    dir_close(dir);
+
+    if(success) strlcpy(name, kname, NAME_MAX + 1);
+    return success;
+}
+
+bool isdir(int fd){
+    if(fd <3 || fd>= 128) return false;
+    struct file* f = (thread_current()->fd)[fd];
+    if(f==NULL) return false;
+    return inode_is_dir(file_get_inode(f));
+}
+
+int inumber(int fd){
+    if(fd <3 || fd>= 128) return -1;
+    struct file* f = (thread_current()->fd)[fd];
+    if(f==NULL) return -1;
+    return (int)inode_get_inumber(file_get_inode(f));
+}
+
+int readv(int fd, const struct iovec* iov, int iovcnt){
+    return iov_io(fd, iov, iovcnt, false);
+}
+
+int writev(int fd, const struct iovec* iov, int iovcnt){
+    return iov_io(fd, iov, iovcnt, true);
+}
+
+/* pread() and pwrite() leave the file position alone.
+   offset must fit in an off_t, and size is clamped so that
+   offset + size does too */
+static bool clamp_pos(unsigned offset, unsigned* size){
+    if(offset > INT32_MAX) return false;
+    if(*size > INT32_MAX - offset) *size = INT32_MAX - offset;
+    return true;
+}
+
+int pread(int fd, void* buffer, unsigned size, unsigned offset){
+    struct file* f = get_plain_file(fd);
+    if(f==NULL) return -1;
+    check_user_buffer(buffer, size, true);
+    if(!clamp_pos(offset, &size)) return -1;
+    return user_io(f, buffer, size, (off_t)offset, false);
+}
+
+int pwrite(int fd, const void* buffer, unsigned size, unsigned offset){
+    struct file* f = get_plain_file(fd);
+    if(f==NULL) return -1;
+    check_user_buffer(buffer, size, false);
+    if(!clamp_pos(offset, &size)) return -1;
+    return user_io(f, (void*)buffer, size, (off_t)offset, true);
+}
+
+/* copies from fd_in's position to fd_out's without the data ever
+   reaching user memory; both positions advance. fails if fd_in and
+   fd_out are the same file, even through separate opens, since the
+   copy could overwrite data before reading it */
+int copy_file_range(int fd_in, int fd_out, unsigned size){
+    struct file* in = get_plain_file(fd_in);
+    struct file* out = get_plain_file(fd_out);
+    if(in==NULL || out==NULL) return -1;
+    if(file_get_inode(in) == file_get_inode(out)) return -1;
+    if(size > INT32_MAX) size = INT32_MAX;
+    return file_copy(out, in, (off_t)size);
+}
+
+/* fills stats for the index'th registered block device; false once
+   index runs past the last one, so iostat can loop from 0 */
+bool block_stats(int index, struct block_stats* stats){
+    struct block* block;
+    struct block_stats s;
+
+    check_user_buffer(stats, sizeof *stats, true);
+    if(index < 0) return false;
+    for(block = block_first(); block != NULL && index > 0; index--)
+        block = block_next(block);
+    if(block == NULL) return false;
+    block_get_stats(block, &s);
+    memcpy(stats, &s, sizeof s);
+    return true;
+}